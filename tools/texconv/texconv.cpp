@@ -0,0 +1,473 @@
+// texconv : conversion hors ligne des textures en blocs BCn (conteneur KTX2, cf. vulkan_avance/Ktx2.h)
+//
+// Compilation (Linux, gcc/clang) depuis la racine du depot :
+//   g++ -O2 -std=c++17 -pthread tools/texconv/texconv.cpp libs/simdjson/simdjson.cpp -o texconv
+//
+// Utilisation :
+//   texconv [--type color|normal|orm|mask] [--linear] input.png [output.ktx2]
+//   texconv --gltf scene.gltf
+// Le fichier .ktx2 est ecrit a cote de l'image source (meme nom), Texture::Load le prend a la place de l'image.
+// En mode --gltf le type de chaque image est deduit du slot de materiau qui la reference.
+//
+// Formats par type :
+//   color  : BC1 sRGB, BC3 sRGB si l'image a de la transparence (albedo, emissive)
+//   normal : BC5 (X et Y, Z est reconstruit dans le shader), normales renormalisees a chaque mip
+//   orm    : BC1 lineaire (occlusion / roughness / metalness, canaux independants)
+//   mask   : BC4 (un seul canal, occlusion seule)
+// Les mips sont filtrees (boite 2x2) en espace lineaire.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../../libs/stb/stb_image.h"
+#define STB_DXT_IMPLEMENTATION
+#include "../../libs/stb/stb_dxt.h"
+#include "../../libs/simdjson/simdjson.h"
+
+#include "../../vulkan_avance/Ktx2.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum TextureType
+{
+	TYPE_COLOR,
+	TYPE_MASK,
+	TYPE_ORM,		// prioritaire sur MASK : une image ORM peut aussi servir d'occlusion
+	TYPE_NORMAL
+};
+
+static const char* TypeName(TextureType type)
+{
+	switch (type)
+	{
+	case TYPE_COLOR: return "color";
+	case TYPE_MASK: return "mask";
+	case TYPE_ORM: return "orm";
+	case TYPE_NORMAL: return "normal";
+	}
+	return "?";
+}
+
+struct ConvertJob
+{
+	std::string input;
+	std::string output;
+	TextureType type;
+	bool linear;		// couleur sans conversion sRGB
+};
+
+// image RGBA en flottants, espace lineaire
+struct FloatImage
+{
+	uint32_t width, height;
+	std::vector<float> pixels;
+
+	float* At(uint32_t x, uint32_t y) { return &pixels[((size_t)y * width + x) * 4]; }
+};
+
+static float SrgbToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+}
+
+static uint8_t Quantize(float c)
+{
+	return (uint8_t)std::min(255.f, std::max(0.f, c * 255.f + 0.5f));
+}
+
+static void NormalizeTexel(float* texel)
+{
+	float x = texel[0] * 2.f - 1.f, y = texel[1] * 2.f - 1.f, z = texel[2] * 2.f - 1.f;
+	float length = sqrtf(x * x + y * y + z * z);
+	if (length < 1e-6f) {
+		x = 0.f; y = 0.f; z = 1.f;
+	}
+	else {
+		x /= length; y /= length; z /= length;
+	}
+	texel[0] = x * 0.5f + 0.5f;
+	texel[1] = y * 0.5f + 0.5f;
+	texel[2] = z * 0.5f + 0.5f;
+}
+
+// niveau suivant, moyenne de 2x2 texels (le dernier texel est repete si la dimension est impaire)
+static FloatImage Downsample(FloatImage& src, TextureType type)
+{
+	FloatImage dst;
+	dst.width = std::max(1u, src.width / 2);
+	dst.height = std::max(1u, src.height / 2);
+	dst.pixels.resize((size_t)dst.width * dst.height * 4);
+	for (uint32_t y = 0; y < dst.height; y++)
+	{
+		uint32_t y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+		for (uint32_t x = 0; x < dst.width; x++)
+		{
+			uint32_t x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+			float* out = dst.At(x, y);
+			for (int c = 0; c < 4; c++)
+				out[c] = (src.At(x0, y0)[c] + src.At(x1, y0)[c] + src.At(x0, y1)[c] + src.At(x1, y1)[c]) * 0.25f;
+			if (type == TYPE_NORMAL)
+				NormalizeTexel(out);
+		}
+	}
+	return dst;
+}
+
+static uint32_t SelectFormat(TextureType type, bool linear, bool hasAlpha)
+{
+	switch (type)
+	{
+	case TYPE_NORMAL: return KTX2_FORMAT_BC5_UNORM;
+	case TYPE_MASK: return KTX2_FORMAT_BC4_UNORM;
+	case TYPE_ORM: return KTX2_FORMAT_BC1_RGB_UNORM;
+	case TYPE_COLOR:
+	default:
+		if (hasAlpha)
+			return linear ? KTX2_FORMAT_BC3_UNORM : KTX2_FORMAT_BC3_SRGB;
+		return linear ? KTX2_FORMAT_BC1_RGB_UNORM : KTX2_FORMAT_BC1_RGB_SRGB;
+	}
+}
+
+static bool IsSrgb(uint32_t vkFormat)
+{
+	return vkFormat == KTX2_FORMAT_BC1_RGB_SRGB || vkFormat == KTX2_FORMAT_BC3_SRGB;
+}
+
+// encode un niveau, les blocs du bord repetent le dernier texel
+static void EncodeLevel(FloatImage& level, uint32_t vkFormat, std::vector<uint8_t>& out)
+{
+	const uint32_t blockBytes = Ktx2BlockBytes(vkFormat);
+	const uint32_t blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+	const bool srgb = IsSrgb(vkFormat);
+	out.resize((size_t)blocksX * blocksY * blockBytes);
+
+	uint8_t rgba[16 * 4];
+	uint8_t channels[16 * 2];
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				uint32_t x = std::min(bx * 4 + (i & 3), level.width - 1);
+				uint32_t y = std::min(by * 4 + (i >> 2), level.height - 1);
+				const float* texel = level.At(x, y);
+				for (int c = 0; c < 3; c++)
+					rgba[i * 4 + c] = Quantize(srgb ? LinearToSrgb(texel[c]) : texel[c]);
+				rgba[i * 4 + 3] = Quantize(texel[3]);
+			}
+
+			uint8_t* dest = &out[((size_t)by * blocksX + bx) * blockBytes];
+			switch (vkFormat)
+			{
+			case KTX2_FORMAT_BC4_UNORM:
+				for (uint32_t i = 0; i < 16; i++)
+					channels[i] = rgba[i * 4];
+				stb_compress_bc4_block(dest, channels);
+				break;
+			case KTX2_FORMAT_BC5_UNORM:
+				for (uint32_t i = 0; i < 16; i++) {
+					channels[i * 2] = rgba[i * 4];
+					channels[i * 2 + 1] = rgba[i * 4 + 1];
+				}
+				stb_compress_bc5_block(dest, channels);
+				break;
+			case KTX2_FORMAT_BC3_UNORM:
+			case KTX2_FORMAT_BC3_SRGB:
+				stb_compress_dxt_block(dest, rgba, 1, STB_DXT_HIGHQUAL);
+				break;
+			default:
+				stb_compress_dxt_block(dest, rgba, 0, STB_DXT_HIGHQUAL);
+				break;
+			}
+		}
+	}
+}
+
+// Data Format Descriptor minimal (modele BCn, un sample par bloc de 64 bits)
+static std::vector<uint32_t> BuildDfd(uint32_t vkFormat)
+{
+	enum { MODEL_BC1A = 128, MODEL_BC3 = 130, MODEL_BC4 = 131, MODEL_BC5 = 132 };
+	enum { CHANNEL_RED = 0, CHANNEL_GREEN = 1, CHANNEL_BC3_ALPHA = 15, SAMPLE_LINEAR = 0x80 };
+	const bool srgb = IsSrgb(vkFormat);
+
+	uint32_t model = MODEL_BC1A;
+	std::vector<uint32_t> channels;		// canal (et qualificatifs) de chaque moitie de 64 bits
+	switch (vkFormat)
+	{
+	case KTX2_FORMAT_BC3_UNORM:
+	case KTX2_FORMAT_BC3_SRGB: model = MODEL_BC3; channels = { CHANNEL_BC3_ALPHA | (srgb ? (uint32_t)SAMPLE_LINEAR : 0u), CHANNEL_RED }; break;
+	case KTX2_FORMAT_BC4_UNORM: model = MODEL_BC4; channels = { CHANNEL_RED }; break;
+	case KTX2_FORMAT_BC5_UNORM: model = MODEL_BC5; channels = { CHANNEL_RED, CHANNEL_GREEN }; break;
+	default: channels = { CHANNEL_RED }; break;
+	}
+
+	const uint32_t blockSize = 24 + 16 * (uint32_t)channels.size();
+	std::vector<uint32_t> dfd;
+	dfd.push_back(4 + blockSize);						// dfdTotalSize
+	dfd.push_back(0);									// vendorId KHRONOS, descriptorType BASICFORMAT
+	dfd.push_back(2 | (blockSize << 16));				// versionNumber 1.3, descriptorBlockSize
+	dfd.push_back(model | (1 << 8) | ((srgb ? 2u : 1u) << 16));	// primaries BT709, transfer sRGB/lineaire, alpha non premultiplie
+	dfd.push_back(3 | (3 << 8));						// bloc 4x4x1x1 (dimensions - 1)
+	dfd.push_back(Ktx2BlockBytes(vkFormat));			// bytesPlane0
+	dfd.push_back(0);
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		dfd.push_back((uint32_t)(i * 64) | (63 << 16) | (channels[i] << 24));
+		dfd.push_back(0);			// samplePosition
+		dfd.push_back(0);			// sampleLower
+		dfd.push_back(0xFFFFFFFF);	// sampleUpper
+	}
+	return dfd;
+}
+
+static bool WriteKtx2(const std::string& path, uint32_t vkFormat, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels)
+{
+	const uint32_t levelCount = (uint32_t)levels.size();
+	const uint32_t blockBytes = Ktx2BlockBytes(vkFormat);
+	std::vector<uint32_t> dfd = BuildDfd(vkFormat);
+
+	Ktx2Header header = {};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = vkFormat;
+	header.typeSize = 1;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.faceCount = 1;
+	header.levelCount = levelCount;
+	header.dfdByteOffset = (uint32_t)(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level));
+	header.dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t));
+
+	// donnees : du plus petit niveau au plus grand, chacun aligne sur un bloc
+	std::vector<Ktx2Level> index(levelCount);
+	uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+	for (uint32_t i = levelCount; i-- > 0; )
+	{
+		offset = (offset + blockBytes - 1) / blockBytes * blockBytes;
+		index[i].byteOffset = offset;
+		index[i].byteLength = levels[i].size();
+		index[i].uncompressedByteLength = levels[i].size();
+		offset += levels[i].size();
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "error: cannot write " << path << std::endl;
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(index.data(), sizeof(Ktx2Level), levelCount, file);
+	fwrite(dfd.data(), sizeof(uint32_t), dfd.size(), file);
+	uint64_t written = header.dfdByteOffset + header.dfdByteLength;
+	for (uint32_t i = levelCount; i-- > 0; )
+	{
+		static const uint8_t zeros[16] = {};
+		fwrite(zeros, 1, (size_t)(index[i].byteOffset - written), file);
+		fwrite(levels[i].data(), 1, levels[i].size(), file);
+		written = index[i].byteOffset + levels[i].size();
+	}
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+static std::mutex logMutex;
+
+static bool Convert(const ConvertJob& job)
+{
+	int w, h, c;
+	uint8_t* pixels = stbi_load(job.input.c_str(), &w, &h, &c, STBI_rgb_alpha);
+	if (pixels == nullptr) {
+		std::lock_guard<std::mutex> lock(logMutex);
+		std::cout << "error: failed to load image " << job.input << " (" << stbi_failure_reason() << ")" << std::endl;
+		return false;
+	}
+
+	bool hasAlpha = false;
+	FloatImage level;
+	level.width = w;
+	level.height = h;
+	level.pixels.resize((size_t)w * h * 4);
+	for (size_t i = 0; i < (size_t)w * h; i++)
+	{
+		for (int k = 0; k < 4; k++) {
+			float value = pixels[i * 4 + k] / 255.f;
+			level.pixels[i * 4 + k] = (k < 3 && job.type == TYPE_COLOR && !job.linear) ? SrgbToLinear(value) : value;
+		}
+		hasAlpha |= pixels[i * 4 + 3] != 255;
+	}
+	stbi_image_free(pixels);
+	if (job.type == TYPE_NORMAL)
+		for (size_t i = 0; i < (size_t)w * h; i++)
+			NormalizeTexel(&level.pixels[i * 4]);
+
+	const uint32_t vkFormat = SelectFormat(job.type, job.linear, hasAlpha);
+	const uint32_t levelCount = (uint32_t)floor(log2(std::max(w, h))) + 1;
+	std::vector<std::vector<uint8_t>> levels(levelCount);
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		EncodeLevel(level, vkFormat, levels[i]);
+		if (i + 1 < levelCount)
+			level = Downsample(level, job.type);
+	}
+
+	if (!WriteKtx2(job.output, vkFormat, w, h, levels))
+		return false;
+
+	uint64_t compressedSize = 0;
+	for (const std::vector<uint8_t>& data : levels)
+		compressedSize += data.size();
+	std::lock_guard<std::mutex> lock(logMutex);
+	std::cout << job.input << " -> " << job.output << " (" << TypeName(job.type) << ", " << w << "x" << h << ", " << levelCount << " mips, "
+		<< (compressedSize >> 10) << " KiB)" << std::endl;
+	return true;
+}
+
+static std::string ReplaceExtension(const std::string& path, const char* extension)
+{
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + extension;
+	return path.substr(0, dot) + extension;
+}
+
+// une tache par image referencee par les materiaux, le type le plus exigeant l'emporte
+static bool CollectGltfJobs(const std::string& gltfPath, std::vector<ConvertJob>& jobs)
+{
+	simdjson::dom::parser parser;
+	simdjson::dom::element gltf;
+	if (parser.load(gltfPath).get(gltf) != simdjson::SUCCESS) {
+		std::cout << "error: failed to parse " << gltfPath << std::endl;
+		return false;
+	}
+
+	size_t slash = gltfPath.find_last_of("/\\");
+	std::string relativePath = slash != std::string::npos ? gltfPath.substr(0, slash + 1) : "";
+
+	std::map<int64_t, TextureType> images;
+	auto reference = [&](simdjson::dom::element textureInfo, TextureType type) {
+		int64_t textureId, imageId;
+		if (textureInfo["index"].get(textureId) != simdjson::SUCCESS)
+			return;
+		if (gltf["textures"].at(textureId)["source"].get(imageId) != simdjson::SUCCESS)
+			return;
+		auto it = images.find(imageId);
+		if (it == images.end() || it->second < type)
+			images[imageId] = type;
+	};
+
+	simdjson::dom::array materials;
+	if (gltf["materials"].get(materials) == simdjson::SUCCESS)
+	{
+		for (simdjson::dom::element material : materials)
+		{
+			simdjson::dom::element pbr;
+			if (material["pbrMetallicRoughness"].get(pbr) == simdjson::SUCCESS) {
+				reference(pbr["baseColorTexture"], TYPE_COLOR);
+				reference(pbr["metallicRoughnessTexture"], TYPE_ORM);
+			}
+			reference(material["normalTexture"], TYPE_NORMAL);
+			reference(material["occlusionTexture"], TYPE_MASK);
+			reference(material["emissiveTexture"], TYPE_COLOR);
+		}
+	}
+
+	for (const auto& image : images)
+	{
+		std::string_view uri;
+		if (gltf["images"].at(image.first)["uri"].get(uri) != simdjson::SUCCESS) {
+			std::cout << "warning: image " << image.first << " has no uri (embedded images are not converted)" << std::endl;
+			continue;
+		}
+		ConvertJob job;
+		job.input = relativePath + std::string(uri);
+		job.output = ReplaceExtension(job.input, ".ktx2");
+		job.type = image.second;
+		job.linear = false;
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+static void Usage()
+{
+	std::cout << "usage: texconv [--type color|normal|orm|mask] [--linear] input [output.ktx2]" << std::endl
+		<< "       texconv --gltf scene.gltf" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<ConvertJob> jobs;
+	ConvertJob job = { "", "", TYPE_COLOR, false };
+	const char* gltfPath = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--gltf" && i + 1 < argc)
+			gltfPath = argv[++i];
+		else if (arg == "--linear")
+			job.linear = true;
+		else if (arg == "--type" && i + 1 < argc) {
+			std::string type = argv[++i];
+			if (type == "color") job.type = TYPE_COLOR;
+			else if (type == "normal") job.type = TYPE_NORMAL;
+			else if (type == "orm") job.type = TYPE_ORM;
+			else if (type == "mask") job.type = TYPE_MASK;
+			else {
+				Usage();
+				return 1;
+			}
+		}
+		else if (job.input.empty())
+			job.input = arg;
+		else if (job.output.empty())
+			job.output = arg;
+		else {
+			Usage();
+			return 1;
+		}
+	}
+
+	if (gltfPath) {
+		if (!CollectGltfJobs(gltfPath, jobs))
+			return 1;
+	}
+	else if (!job.input.empty()) {
+		if (job.output.empty())
+			job.output = ReplaceExtension(job.input, ".ktx2");
+		jobs.push_back(job);
+	}
+	else {
+		Usage();
+		return 1;
+	}
+
+	// une image par thread
+	std::vector<char> results(jobs.size(), 0);
+	std::vector<std::thread> threads;
+	const size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t first = 0; first < jobs.size(); first += threadCount)
+	{
+		for (size_t i = first; i < std::min(jobs.size(), first + threadCount); i++)
+			threads.emplace_back([&, i]() { results[i] = Convert(jobs[i]); });
+		for (std::thread& thread : threads)
+			thread.join();
+		threads.clear();
+	}
+
+	return std::count(results.begin(), results.end(), 0) == 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "RenderContext.h"
+
+void DeferredDestroyQueue::Create(VkDevice logicalDevice, DeviceMemoryAllocator& memoryAllocator)
+{
+	device = logicalDevice;
+	allocator = &memoryAllocator;
+	entries.clear();
+	frame = 0;
+	destroyedCount = 0;
+}
+
+void DeferredDestroyQueue::Push(Kind kind, uint64_t handle, Allocation* allocation)
+{
+	if (handle == 0 && (allocation == nullptr || allocation->memory == VK_NULL_HANDLE))
+		return;
+
+	Entry entry = {};
+	entry.kind = kind;
+	entry.handle = handle;
+	if (allocation) {
+		entry.allocation = *allocation;
+		*allocation = {};
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	entry.frame = frame;
+	entries.push_back(std::move(entry));
+}
+
+void DeferredDestroyQueue::DestroyBuffer(VkBuffer buffer, Allocation& allocation) { Push(DESTROY_BUFFER, (uint64_t)buffer, &allocation); }
+void DeferredDestroyQueue::DestroyImage(VkImage image, Allocation& allocation) { Push(DESTROY_IMAGE, (uint64_t)image, &allocation); }
+void DeferredDestroyQueue::DestroyImageView(VkImageView view) { Push(DESTROY_IMAGE_VIEW, (uint64_t)view, nullptr); }
+void DeferredDestroyQueue::DestroySampler(VkSampler sampler) { Push(DESTROY_SAMPLER, (uint64_t)sampler, nullptr); }
+void DeferredDestroyQueue::DestroyPipeline(VkPipeline pipeline) { Push(DESTROY_PIPELINE, (uint64_t)pipeline, nullptr); }
+void DeferredDestroyQueue::DestroyPipelineLayout(VkPipelineLayout layout) { Push(DESTROY_PIPELINE_LAYOUT, (uint64_t)layout, nullptr); }
+void DeferredDestroyQueue::DestroyDescriptorPool(VkDescriptorPool pool) { Push(DESTROY_DESCRIPTOR_POOL, (uint64_t)pool, nullptr); }
+void DeferredDestroyQueue::DestroyDescriptorSetLayout(VkDescriptorSetLayout layout) { Push(DESTROY_DESCRIPTOR_SET_LAYOUT, (uint64_t)layout, nullptr); }
+void DeferredDestroyQueue::DestroyFramebuffer(VkFramebuffer framebuffer) { Push(DESTROY_FRAMEBUFFER, (uint64_t)framebuffer, nullptr); }
+void DeferredDestroyQueue::FreeAllocation(Allocation& allocation) { Push(DESTROY_ALLOCATION, 0, &allocation); }
+
+void DeferredDestroyQueue::Enqueue(std::function<void()> callback)
+{
+	Entry entry = {};
+	entry.kind = DESTROY_CALLBACK;
+	entry.callback = std::move(callback);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	entry.frame = frame;
+	entries.push_back(std::move(entry));
+}
+
+void DeferredDestroyQueue::Execute(Entry& entry)
+{
+	switch (entry.kind)
+	{
+	case DESTROY_BUFFER: vkDestroyBuffer(device, (VkBuffer)entry.handle, nullptr); break;
+	case DESTROY_IMAGE: vkDestroyImage(device, (VkImage)entry.handle, nullptr); break;
+	case DESTROY_IMAGE_VIEW: vkDestroyImageView(device, (VkImageView)entry.handle, nullptr); break;
+	case DESTROY_SAMPLER: vkDestroySampler(device, (VkSampler)entry.handle, nullptr); break;
+	case DESTROY_PIPELINE: vkDestroyPipeline(device, (VkPipeline)entry.handle, nullptr); break;
+	case DESTROY_PIPELINE_LAYOUT: vkDestroyPipelineLayout(device, (VkPipelineLayout)entry.handle, nullptr); break;
+	case DESTROY_DESCRIPTOR_POOL: vkDestroyDescriptorPool(device, (VkDescriptorPool)entry.handle, nullptr); break;
+	case DESTROY_DESCRIPTOR_SET_LAYOUT: vkDestroyDescriptorSetLayout(device, (VkDescriptorSetLayout)entry.handle, nullptr); break;
+	case DESTROY_FRAMEBUFFER: vkDestroyFramebuffer(device, (VkFramebuffer)entry.handle, nullptr); break;
+	case DESTROY_ALLOCATION: break;
+	case DESTROY_CALLBACK: entry.callback(); break;
+	}
+	// la memoire apres la ressource qui y est liee
+	allocator->Free(entry.allocation);
+	destroyedCount++;
+}
+
+void DeferredDestroyQueue::BeginFrame(uint64_t frameNumber, uint32_t framesInFlight, MemoryArena& frameArena)
+{
+	ArenaVector<Entry> ready{ ArenaAllocator<Entry>(frameArena) };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frame = frameNumber;
+
+		// les entrees sont dans l'ordre des frames : on s'arrete a la premiere encore potentiellement en vol
+		size_t count = 0;
+		while (count < entries.size() && entries[count].frame + framesInFlight <= frameNumber)
+			count++;
+		if (count == 0)
+			return;
+		ready.assign(std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.begin() + count));
+		entries.erase(entries.begin(), entries.begin() + count);
+	}
+
+	// hors du verrou : un callback peut demander d'autres destructions
+	for (Entry& entry : ready)
+		Execute(entry);
+}
+
+void DeferredDestroyQueue::Flush()
+{
+	// les callbacks peuvent demander d'autres destructions : on boucle jusqu'a ce que la file soit vide
+	for (;;)
+	{
+		std::vector<Entry> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (entries.empty())
+				break;
+			ready.swap(entries);
+		}
+		for (Entry& entry : ready)
+			Execute(entry);
+	}
+}
+
+size_t DeferredDestroyQueue::PendingCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return entries.size();
+}
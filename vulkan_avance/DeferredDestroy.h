@@ -0,0 +1,75 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// File de destruction differee
+// Un objet Vulkan ne peut etre detruit que lorsque plus aucun command buffer en vol ne le reference.
+// Au lieu d'un vkDeviceWaitIdle, la destruction est enregistree avec le numero de la frame courante et
+// n'a lieu qu'une fois la fence de cette frame attendue (BeginFrame, framesInFlight frames plus tard).
+// Buffer::Destroy, RenderSurface::Destroy et Texture::Destroy passent par ici, ainsi que les pipelines,
+// layouts et descriptor pools remplaces en cours d'execution.
+// Thread-safe (un mutex) : les destructions peuvent venir de threads de chargement
+struct DeferredDestroyQueue
+{
+	enum Kind : uint32_t
+	{
+		DESTROY_BUFFER,
+		DESTROY_IMAGE,
+		DESTROY_IMAGE_VIEW,
+		DESTROY_SAMPLER,
+		DESTROY_PIPELINE,
+		DESTROY_PIPELINE_LAYOUT,
+		DESTROY_DESCRIPTOR_POOL,
+		DESTROY_DESCRIPTOR_SET_LAYOUT,
+		DESTROY_FRAMEBUFFER,
+		DESTROY_ALLOCATION,		// memoire seule (ressource deja detruite ou partagee)
+		DESTROY_CALLBACK
+	};
+
+	struct Entry
+	{
+		uint64_t frame;			// frame pendant laquelle la destruction a ete demandee
+		Kind kind;
+		uint64_t handle;		// handle non-dispatchable
+		Allocation allocation;	// rendue a l'allocateur apres la destruction du handle
+		std::function<void()> callback;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	DeviceMemoryAllocator* allocator = nullptr;
+	std::vector<Entry> entries;		// dans l'ordre des frames
+	std::mutex mutex;
+	uint64_t frame = 0;				// frame courante
+	uint32_t destroyedCount = 0;
+
+	void Create(VkDevice logicalDevice, DeviceMemoryAllocator& memoryAllocator);
+
+	// a appeler une fois la fence de la frame attendue : detruit tout ce qui a ete demande
+	// au moins framesInFlight frames plus tot (plus aucun command buffer ne peut y faire reference)
+	// la liste des entrees a detruire est temporaire : allouee dans l'arena de frame (thread principal)
+	void BeginFrame(uint64_t frameNumber, uint32_t framesInFlight, struct MemoryArena& frameArena);
+	// detruit tout immediatement, le GPU doit etre idle (Terminate)
+	void Flush();
+
+	// allocation : rendue a l'allocateur avec le handle, remise a zero chez l'appelant
+	void DestroyBuffer(VkBuffer buffer, Allocation& allocation);
+	void DestroyImage(VkImage image, Allocation& allocation);
+	void DestroyImageView(VkImageView view);
+	void DestroySampler(VkSampler sampler);
+	void DestroyPipeline(VkPipeline pipeline);
+	void DestroyPipelineLayout(VkPipelineLayout layout);
+	void DestroyDescriptorPool(VkDescriptorPool pool);
+	void DestroyDescriptorSetLayout(VkDescriptorSetLayout layout);
+	void DestroyFramebuffer(VkFramebuffer framebuffer);
+	void FreeAllocation(Allocation& allocation);
+	// pour tout le reste (objets composites, ressources hors Vulkan liees au GPU...)
+	void Enqueue(std::function<void()> callback);
+
+	size_t PendingCount();
+
+private:
+	void Push(Kind kind, uint64_t handle, Allocation* allocation);
+	void Execute(Entry& entry);
+};
@@ -28,7 +28,12 @@ struct VulkanDeviceContext
 	uint32_t swapchainImageCount = SWAPCHAIN_IMAGES;
 
 	VkPhysicalDeviceProperties props;
+	// nombre max de textures dans la table bindless (descriptor indexing, update-after-bind)
+	uint32_t maxBindlessTextures = 0;
 	std::vector<VkMemoryPropertyFlags> memoryFlags;
+	bool memoryBudgetSupported = false;	// VK_EXT_memory_budget
+	bool lazilyAllocatedMemory = false;	// un memory type LAZILY_ALLOCATED existe (GPU tile-based, integres)
+	bool textureCompressionBC = false;	// formats BCn (textures KTX2 de tools/texconv)
 
 	bool setObjectName(void* object, VkObjectType objType, const char* name) {
 		VkDebugUtilsObjectNameInfoEXT nameInfo = { VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT, 0, objType, (uint64_t)object, name };
@@ -50,18 +55,29 @@ struct VulkanDeviceContext
 		return shaderModule;
 	}
 
+	// type compatible ayant le moins de flags en plus de ceux demandes (un buffer DEVICE_LOCAL ne prend pas la BAR),
+	// UINT32_MAX si aucun (le type 0 n'est pas un choix par defaut valable)
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) 
 	{
+		uint32_t best = UINT32_MAX;
+		uint32_t bestExtra = 0;
 		int i = 0;
 		for (auto propertyFlags : memoryFlags) {
 			if ((typeFilter & (1 << i)) && (propertyFlags & properties) == properties) {
-				return i;
+				uint32_t extra = 0;
+				for (VkMemoryPropertyFlags bits = propertyFlags & ~properties; bits; bits &= bits - 1)
+					extra++;
+				if (best == UINT32_MAX || extra < bestExtra) {
+					best = i;
+					bestExtra = extra;
+				}
 			}
 			i++;
 		}
 
-		std::cout << "failed to find suitable memory type!" << std::endl;
-		return 0;
+		if (best == UINT32_MAX)
+			std::cout << "error: failed to find suitable memory type!" << std::endl;
+		return best;
 	}
 };
 
@@ -0,0 +1,47 @@
+#include "DynamicResolution.h"
+
+#include <cmath>
+
+static const float SMOOTHING = 0.2f;	// poids d'une nouvelle mesure
+static const float REACTIVITY = 0.25f;	// part du chemin vers l'echelle cible parcourue par frame
+static const float DEADBAND = 0.02f;	// ecart d'echelle ignore
+static const uint32_t GRANULARITY = 8;	// pixels
+
+void DynamicResolution::Create(uint32_t w, uint32_t h, float budget, float initialScale)
+{
+	fullWidth = w;
+	fullHeight = h;
+	budgetMs = budget;
+	scale = initialScale < minScale ? minScale : (initialScale > maxScale ? maxScale : initialScale);
+	smoothedGpuMs = 0.f;
+	ComputeExtent();
+}
+
+bool DynamicResolution::Update(float gpuMs)
+{
+	if (budgetMs <= 0.f || gpuMs <= 0.f)
+		return false;
+
+	smoothedGpuMs = smoothedGpuMs > 0.f ? smoothedGpuMs + (gpuMs - smoothedGpuMs) * SMOOTHING : gpuMs;
+
+	float target = scale * sqrtf(budgetMs / smoothedGpuMs);
+	target = target < minScale ? minScale : (target > maxScale ? maxScale : target);
+	if (fabsf(target - scale) < DEADBAND)
+		return false;
+
+	scale += (target - scale) * REACTIVITY;
+
+	uint32_t previousWidth = width, previousHeight = height;
+	ComputeExtent();
+	return width != previousWidth || height != previousHeight;
+}
+
+void DynamicResolution::ComputeExtent()
+{
+	width = ((uint32_t)(fullWidth * scale + GRANULARITY / 2) / GRANULARITY) * GRANULARITY;
+	height = ((uint32_t)(fullHeight * scale + GRANULARITY / 2) / GRANULARITY) * GRANULARITY;
+	if (width < GRANULARITY) width = GRANULARITY;
+	if (height < GRANULARITY) height = GRANULARITY;
+	if (width > fullWidth) width = fullWidth;
+	if (height > fullHeight) height = fullHeight;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// Controleur de resolution dynamique
+// Le cout GPU de la passe principale est a peu pres proportionnel au nombre de pixels (scale^2) :
+// on vise scale * sqrt(budget / temps mesure), en lissant la mesure et en ne faisant qu'une partie du chemin
+// a chaque frame pour eviter les oscillations. L'extent est arrondi a un multiple de 8 pixels
+// et une zone morte evite de changer de taille (et de reenregistrer les command buffers) pour quelques %
+struct DynamicResolution
+{
+	float budgetMs = 12.f;		// <= 0 : controleur desactive, l'echelle reste fixe
+	float minScale = 0.5f;
+	float maxScale = 1.f;
+	float scale = 1.f;
+	float smoothedGpuMs = 0.f;
+
+	uint32_t fullWidth = 0, fullHeight = 0;
+	uint32_t width = 0, height = 0;		// taille de rendu courante
+
+	void Create(uint32_t w, uint32_t h, float budget, float initialScale);
+	// integre une nouvelle mesure du temps GPU de la frame, retourne true si la taille de rendu change
+	bool Update(float gpuMs);
+
+private:
+	void ComputeExtent();
+};
@@ -0,0 +1,70 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "RenderContext.h"
+
+bool FrameAllocator::Create(VulkanRenderContext& rendercontext, VkDeviceSize sizePerFrame, uint32_t frameCount, VkBufferUsageFlags usage)
+{
+	VulkanDeviceContext& context = *rendercontext.context;
+
+	VkDeviceSize minAlignment = context.props.limits.minUniformBufferOffsetAlignment;
+	if ((usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) && context.props.limits.minStorageBufferOffsetAlignment > minAlignment)
+		minAlignment = context.props.limits.minStorageBufferOffsetAlignment;
+	if (minAlignment > 0)
+		alignment = minAlignment;
+
+	frameSize = (sizePerFrame + alignment - 1) & ~(alignment - 1);
+	frameBase = 0;
+	head = 0;
+
+	memset(&buffer, 0, sizeof(Buffer));
+	buffer.size = frameSize * frameCount;
+	buffer.usage = usage;
+	buffer.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = buffer.size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	DEBUG_CHECK_VK(vkCreateBuffer(context.device, &bufferInfo, nullptr, &buffer.buffer));
+
+	// COHERENT : les ecritures CPU sont visibles du GPU au vkQueueSubmit() suivant, pas de vkFlushMappedMemoryRanges()
+	// STREAM : dans la fenetre BAR si elle existe, le GPU lit les constantes sans traverser le bus
+	if (!rendercontext.memoryAllocator.AllocateBuffer(buffer.buffer, MEMORY_USAGE_STREAM, MEMORY_CATEGORY_CONSTANTS, buffer.allocation)) {
+		std::cout << "error: failed to allocate frame allocator memory!" << std::endl;
+		return false;
+	}
+
+	// mapping persistant (celui du bloc memoire)
+	buffer.data = buffer.allocation.mapped;
+	mapped = (uint8_t*)buffer.data;
+
+	return true;
+}
+
+void FrameAllocator::Destroy(VulkanRenderContext& rendercontext)
+{
+	buffer.Destroy(rendercontext);
+	mapped = nullptr;
+}
+
+uint32_t FrameAllocator::Allocate(VkDeviceSize size, void** ptr)
+{
+	VkDeviceSize alignedSize = (size + alignment - 1) & ~(alignment - 1);
+	if (head + alignedSize > frameSize) {
+		// la region de la frame est pleine : augmenter sizePerFrame dans Prepare()
+		// pas de retour au debut de la region : le GPU lirait des constantes ecrasees dans la meme frame
+		std::cout << "error: frame allocator overflow (" << head + alignedSize << " > " << frameSize << ")" << std::endl;
+#ifdef _DEBUG
+		__debugbreak();
+#endif
+		*ptr = nullptr;
+		return INVALID_OFFSET;
+	}
+
+	VkDeviceSize offset = frameBase + head;
+	head += alignedSize;
+
+	*ptr = mapped + offset;
+	return (uint32_t)offset;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Allocateur lineaire ("bump") pour les constantes qui changent chaque frame
+// (view/projection, parametres de simulation, donnees par draw...)
+// Un seul buffer persistant HOST_VISIBLE|HOST_COHERENT decoupe en une region par frame en cours de traitement :
+// la frame N ecrit dans sa region pendant que le GPU lit encore celle de la frame N-1, plus de course.
+// Pas de flush necessaire (COHERENT), les allocations sont bindees avec VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+// l'offset retourne par Allocate() est directement l'offset dynamique a passer a vkCmdBindDescriptorSets()
+struct FrameAllocator
+{
+	Buffer buffer;
+	uint8_t* mapped = nullptr;
+	VkDeviceSize frameSize = 0;		// taille d'une region, multiple de l'alignement
+	VkDeviceSize alignment = 256;	// minUniformBufferOffsetAlignment (256 = pire cas autorise par la spec)
+	VkDeviceSize frameBase = 0;		// debut de la region de la frame courante
+	VkDeviceSize head = 0;			// prochaine position libre dans la region
+
+	static constexpr uint32_t INVALID_OFFSET = ~0u;
+
+	bool Create(struct VulkanRenderContext& rendercontext, VkDeviceSize sizePerFrame, uint32_t frameCount, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	void Destroy(struct VulkanRenderContext& rendercontext);
+
+	// a appeler une fois la fence de la frame attendue, le GPU n'utilise plus cette region
+	void Reset(uint32_t frameIndex)
+	{
+		frameBase = frameIndex * frameSize;
+		head = 0;
+	}
+
+	// retourne l'offset (depuis le debut du buffer) de la zone allouee, *ptr pointe sur la memoire mappee
+	// region pleine : INVALID_OFFSET et *ptr = nullptr, les allocations deja faites dans la frame restent intactes
+	uint32_t Allocate(VkDeviceSize size, void** ptr);
+
+	template<typename T>
+	uint32_t Push(const T& value)
+	{
+		void* ptr;
+		uint32_t offset = Allocate(sizeof(T), &ptr);
+		if (ptr)
+			memcpy(ptr, &value, sizeof(T));
+		return offset;
+	}
+};
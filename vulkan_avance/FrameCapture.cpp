@@ -0,0 +1,182 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "RenderContext.h"
+#include "FrameCapture.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+bool FrameCapture::Create(VulkanRenderContext& rendercontext, const char* filePrefix, bool writePng, uint32_t imageWidth, uint32_t imageHeight
+	, VkFormat format, uint32_t ringSize, uint32_t encoderThreads)
+{
+	VulkanDeviceContext& context = *rendercontext.context;
+
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		swizzle = false;
+		break;
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		swizzle = true;
+		break;
+	default:
+		std::cout << "error: frame capture does not support image format " << format << std::endl;
+		return false;
+	}
+
+	prefix = filePrefix;
+	png = writePng;
+	width = imageWidth;
+	height = imageHeight;
+	slotCount = std::min(std::max(ringSize, 1u), (uint32_t)MAX_SLOTS);
+	capturedCount = 0;
+	droppedCount = 0;
+	// la compression par defaut (8) est trop lente pour suivre le rendu, le gain de taille est faible
+	stbi_write_png_compression_level = 1;
+
+	VkDeviceSize size = (VkDeviceSize)width * height * 4;
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		Slot& slot = slots[i];
+
+		VkBufferCreateInfo bufferInfo = {};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		DEBUG_CHECK_VK(vkCreateBuffer(context.device, &bufferInfo, nullptr, &slot.buffer));
+
+		// relecture CPU : HOST_CACHED de preference (lecture d'une memoire non cachee tres lente)
+		if (!rendercontext.memoryAllocator.AllocateBuffer(slot.buffer, MEMORY_USAGE_READBACK, MEMORY_CATEGORY_STAGING, slot.allocation)) {
+			std::cout << "error: frame capture readback buffer allocation failed" << std::endl;
+			return false;
+		}
+		slot.data = slot.allocation.mapped;
+
+		slot.state = SLOT_FREE;
+	}
+
+	// threads dedies : un encodage PNG dure plusieurs frames, il ne doit pas occuper les workers d'enregistrement
+	encoders.Create(std::max(encoderThreads, 1u));
+
+	std::cout << "frame capture: " << width << "x" << height << " " << (png ? "png" : "raw") << ", " << slotCount << " readback buffers, "
+		<< encoders.ThreadCount() << " encoder thread(s) -> " << prefix << "_*" << std::endl;
+	return true;
+}
+
+bool FrameCapture::Record(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameNumber, uint32_t pendingFrame)
+{
+	Slot* target = nullptr;
+	for (uint32_t i = 0; i < slotCount; i++) {
+		if (slots[i].state.load(std::memory_order_acquire) == SLOT_FREE) {
+			target = &slots[i];
+			break;
+		}
+	}
+	// encodeurs en retard : on perd la frame plutot que de bloquer le rendu
+	if (!target) {
+		droppedCount++;
+		return false;
+	}
+
+	target->frameNumber = frameNumber;
+	target->pendingFrame = pendingFrame;
+	target->state.store(SLOT_RECORDED, std::memory_order_relaxed);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target->buffer, 1, &region);
+
+	// la fence ne rend visibles que les acces du device : barriere explicite vers les lectures host
+	VkMemoryBarrier2 hostBarrier = {};
+	hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+	hostBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+	VkDependencyInfo dependencyInfo = {};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.memoryBarrierCount = 1;
+	dependencyInfo.pMemoryBarriers = &hostBarrier;
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+
+	return true;
+}
+
+void FrameCapture::Collect(DeviceMemoryAllocator& allocator, uint32_t pendingFrame)
+{
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		Slot& slot = slots[i];
+		if (slot.state.load(std::memory_order_relaxed) != SLOT_RECORDED || slot.pendingFrame != pendingFrame)
+			continue;
+
+		// memoire HOST_CACHED sans COHERENT
+		allocator.Invalidate(slot.allocation);
+
+		slot.state.store(SLOT_ENCODING, std::memory_order_relaxed);
+		encoders.Submit([this, &slot](uint32_t) { Encode(slot); });
+	}
+}
+
+void FrameCapture::Encode(Slot& slot)
+{
+	uint8_t* pixels = (uint8_t*)slot.data;
+	if (swizzle) {
+		for (size_t i = 0, count = (size_t)width * height; i < count; i++)
+			std::swap(pixels[i * 4 + 0], pixels[i * 4 + 2]);
+	}
+
+	char filepath[512];
+	bool written;
+	if (png) {
+		snprintf(filepath, sizeof(filepath), "%s_%06u.png", prefix.c_str(), slot.frameNumber);
+		written = stbi_write_png(filepath, width, height, 4, pixels, width * 4) != 0;
+	}
+	else {
+		// RGBA8 sans header, la taille est dans le nom du fichier
+		snprintf(filepath, sizeof(filepath), "%s_%06u_%ux%u.rgba", prefix.c_str(), slot.frameNumber, width, height);
+		FILE* file = fopen(filepath, "wb");
+		written = file && fwrite(pixels, (size_t)width * height * 4, 1, file) == 1;
+		if (file)
+			fclose(file);
+	}
+
+	if (written)
+		capturedCount++;
+	else
+		std::cout << "error: cannot write capture " << filepath << std::endl;
+
+	slot.state.store(SLOT_FREE, std::memory_order_release);
+}
+
+void FrameCapture::Flush(DeviceMemoryAllocator& allocator)
+{
+	for (uint32_t f = 0; f < (uint32_t)VulkanRenderContext::PENDING_FRAMES; f++)
+		Collect(allocator, f);
+	encoders.Wait();
+}
+
+void FrameCapture::Destroy(VulkanRenderContext& rendercontext)
+{
+	VulkanDeviceContext& context = *rendercontext.context;
+
+	encoders.Destroy();
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		Slot& slot = slots[i];
+		vkDestroyBuffer(context.device, slot.buffer, nullptr);
+		rendercontext.memoryAllocator.Free(slot.allocation);
+		slot.buffer = VK_NULL_HANDLE;
+		slot.data = nullptr;
+		slot.state = SLOT_FREE;
+	}
+	slotCount = 0;
+}
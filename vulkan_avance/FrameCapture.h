@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "JobSystem.h"
+
+// Capture asynchrone des frames sur disque
+// L'image finale (swapchain ou cible headless) est copiee par le GPU dans un anneau de buffers HOST_VISIBLE
+// (vkCmdCopyImageToBuffer, en fin de frame). Une fois la fence de la frame attendue (Collect, dans Begin),
+// le buffer est confie a des threads d'encodage dedies (PNG via stb_image_write, ou brut) puis rendu a l'anneau.
+// La boucle de rendu n'attend jamais : si aucun buffer n'est libre la frame n'est pas capturee (droppedCount)
+struct FrameCapture
+{
+	static constexpr uint32_t MAX_SLOTS = 8;
+
+	enum SlotState : uint32_t
+	{
+		SLOT_FREE,		// disponible pour une copie
+		SLOT_RECORDED,	// copie enregistree, en attente de la fence de pendingFrame
+		SLOT_ENCODING	// lu par un thread d'encodage
+	};
+
+	struct Slot
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation allocation = {};
+		void* data = nullptr;			// mapping persistant (celui du bloc)
+		std::atomic<uint32_t> state{ SLOT_FREE };
+		uint32_t frameNumber = 0;		// numero de la frame capturee (nom du fichier)
+		uint32_t pendingFrame = 0;		// index de la frame en cours (fence) qui protege la copie
+	};
+
+	std::string prefix;				// chemin + debut du nom de fichier, ex. "captures/frame"
+	bool png = true;				// false = pixels RGBA8 bruts (.rgba), beaucoup plus rapide a ecrire
+	bool swizzle = false;			// image en BGRA (swapchain) : remise en RGBA par l'encodeur
+	uint32_t width = 0, height = 0;
+	uint32_t slotCount = 0;
+	Slot slots[MAX_SLOTS];
+
+	JobSystem encoders;
+	std::atomic<uint32_t> capturedCount{ 0 };
+	std::atomic<uint32_t> droppedCount{ 0 };
+
+	// format : 4 octets par pixel (R8G8B8A8 ou B8G8R8A8, UNORM ou SRGB)
+	bool Create(struct VulkanRenderContext& rendercontext, const char* filePrefix, bool writePng, uint32_t imageWidth, uint32_t imageHeight
+		, VkFormat format, uint32_t ringSize = MAX_SLOTS, uint32_t encoderThreads = 2);
+	// a appeler apres l'attente de la fence de pendingFrame : confie les copies terminees aux encodeurs
+	void Collect(DeviceMemoryAllocator& allocator, uint32_t pendingFrame);
+	// enregistre la copie de image (layout TRANSFER_SRC_OPTIMAL) vers un buffer libre, false si l'anneau est plein
+	bool Record(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameNumber, uint32_t pendingFrame);
+	// attend la fin des encodages en cours (le GPU doit etre idle et Collect() appele pour toutes les frames)
+	void Flush(DeviceMemoryAllocator& allocator);
+	void Destroy(struct VulkanRenderContext& rendercontext);
+
+private:
+	void Encode(Slot& slot);
+};
@@ -26,6 +26,10 @@
 
 #include "GraphicsApplication.h"
 
+// decodage des images dans l'arena du thread quand un ArenaScope y est ouvert (Texture::Load)
+#define STBI_MALLOC(size) ArenaMalloc(size)
+#define STBI_REALLOC(ptr, size) ArenaRealloc(ptr, size)
+#define STBI_FREE(ptr) ArenaFree(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
@@ -70,6 +74,11 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 {
 	m_imageIndex = 0;
 	name = appName;
+	rendercontext.context = &context;
+
+	// les tableaux temporaires des enumerations sont pris dans l'arena du thread et rendus en sortie
+	MemoryArena& arena = ThreadArena();
+	ArenaScope arenaScope(arena);
 
 	// Vulkan
 
@@ -88,23 +97,33 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.apiVersion = VK_MAKE_VERSION(1, minorVersion, 0);
 
-	const char *extensionNames[] = { VK_KHR_SURFACE_EXTENSION_NAME
+	// en headless aucune extension de surface (pas de display, ex. serveur de CI)
+	ArenaVector<const char*> extensionNames(arena);
+	if (!headless) {
+		extensionNames.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #if defined(_WIN32)
-		, VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+		extensionNames.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#else
+		// hors Windows l'extension de surface de la plateforme (xcb, wayland...) est fournie par glfw
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		for (uint32_t i = 0; i < glfwExtensionCount; i++) {
+			if (strcmp(glfwExtensions[i], VK_KHR_SURFACE_EXTENSION_NAME) != 0)
+				extensionNames.push_back(glfwExtensions[i]);
+		}
 #endif
-		, VK_EXT_DEBUG_REPORT_EXTENSION_NAME };
+	}
 	VkInstanceCreateInfo instanceInfo = {};
 	instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instanceInfo.pApplicationInfo = &appInfo;
-	instanceInfo.enabledExtensionCount = sizeof(extensionNames) / sizeof(char*);
-	instanceInfo.ppEnabledExtensionNames = extensionNames;
 #ifdef VULKAN_ENABLE_VALIDATION
+	extensionNames.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 	const char* layerNames[] = { "VK_LAYER_KHRONOS_validation" };
 	instanceInfo.enabledLayerCount = 1;
 	instanceInfo.ppEnabledLayerNames = layerNames;
-#else
-	instanceInfo.enabledExtensionCount--;
 #endif
+	instanceInfo.enabledExtensionCount = (uint32_t)extensionNames.size();
+	instanceInfo.ppEnabledExtensionNames = extensionNames.data();
 	DEBUG_CHECK_VK(vkCreateInstance(&instanceInfo, nullptr, &context.instance));
 	// TODO: fallback si pas de validation possible (MoltenVK, toujours le cas ?)
 
@@ -131,30 +150,64 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 	glfwCreateWindowSurface(g_Context.instance, g_Context.window, nullptr, &g_Context.surface);
 #else
 #if defined(_WIN32)
-	VkWin32SurfaceCreateInfoKHR surfaceInfo = {};
-	surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-	surfaceInfo.hinstance = GetModuleHandle(NULL);
-	surfaceInfo.hwnd = glfwGetWin32Window(window);
-	DEBUG_CHECK_VK(vkCreateWin32SurfaceKHR(context.instance, &surfaceInfo, nullptr, &context.surface));
+	if (!headless) {
+		VkWin32SurfaceCreateInfoKHR surfaceInfo = {};
+		surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+		surfaceInfo.hinstance = GetModuleHandle(NULL);
+		surfaceInfo.hwnd = glfwGetWin32Window(window);
+		DEBUG_CHECK_VK(vkCreateWin32SurfaceKHR(context.instance, &surfaceInfo, nullptr, &context.surface));
+	}
+#else
+	if (!headless) {
+		DEBUG_CHECK_VK(glfwCreateWindowSurface(context.instance, window, nullptr, &context.surface));
+	}
 #endif
 #endif
 
 	// device
 
-	uint32_t num_devices = context.MAX_DEVICE_COUNT;
-	std::vector<VkPhysicalDevice> physical_devices(num_devices);
-	DEBUG_CHECK_VK(vkEnumeratePhysicalDevices(context.instance, &num_devices, &physical_devices[0]));
-
-	// on prend le premier ... TODO
-	context.physicalDevice = physical_devices[1];
+	uint32_t num_devices = 0;
+	vkEnumeratePhysicalDevices(context.instance, &num_devices, nullptr);
+	if (num_devices == 0) {
+		std::cout << "error: no Vulkan device found!" << std::endl;
+		return false;
+	}
+	ArenaVector<VkPhysicalDevice> physical_devices(num_devices, arena);
+	vkEnumeratePhysicalDevices(context.instance, &num_devices, physical_devices.data());
+
+	// on prefere un GPU dedie, puis integre, puis virtuel, puis un ICD logiciel (lavapipe, swiftshader)
+	// qui reste utile pour les executions headless sur une machine sans GPU
+	auto deviceScore = [](VkPhysicalDeviceType type) {
+		switch (type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+		default: return 0;
+		}
+	};
+	int bestScore = -1;
+	for (VkPhysicalDevice physicalDevice : physical_devices)
+	{
+		VkPhysicalDeviceProperties deviceProps;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProps);
+		int score = deviceScore(deviceProps.deviceType);
+		if (score > bestScore) {
+			bestScore = score;
+			context.physicalDevice = physicalDevice;
+		}
+	}
 
 	// TODO : VK_EXT_sampler_filter_minmax
 
 	uint32_t extensionCount = 0;
 	vkEnumerateDeviceExtensionProperties(context.physicalDevice, 0, &extensionCount, 0);
-	std::vector<VkExtensionProperties> extensions(extensionCount);
+	ArenaVector<VkExtensionProperties> extensions(extensionCount, arena);
 	vkEnumerateDeviceExtensionProperties(context.physicalDevice, 0, &extensionCount, extensions.data());
 	// todo: check available extensions
+	for (const VkExtensionProperties& extension : extensions)
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+			context.memoryBudgetSupported = true;
 
 	// todo: VK_FORMAT_FEATURE_TRANSFER_SRC/DST_BIT_KHR
 	VkPhysicalDeviceVulkan12Features vulkan12Features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
@@ -167,10 +220,57 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 	//imagelessFeatures.pNext = &timelineSemaphoreFeatures;
 	VkPhysicalDeviceInlineUniformBlockFeatures inlineUBOFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INLINE_UNIFORM_BLOCK_FEATURES };
 	inlineUBOFeatures.pNext = &dynamicRenderingFeatures;// &imagelessFeatures;
+	// barrieres du render graph (vkCmdPipelineBarrier2)
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR };
+	synchronization2Features.pNext = &inlineUBOFeatures;
 	VkPhysicalDeviceFeatures2 deviceFeatures2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };	
-	deviceFeatures2.pNext = &inlineUBOFeatures;
+	deviceFeatures2.pNext = &synchronization2Features;
 	vkGetPhysicalDeviceFeatures2(context.physicalDevice, &deviceFeatures2);
 
+	// descriptor indexing : table de textures "bindless" (tableau de taille variable, partiellement rempli,
+	// mis a jour apres le bind et pendant que les frames en vol l'utilisent), pas de chemin de repli sans
+	if (!vulkan12Features.runtimeDescriptorArray || !vulkan12Features.descriptorBindingPartiallyBound
+		|| !vulkan12Features.descriptorBindingVariableDescriptorCount
+		|| !vulkan12Features.descriptorBindingSampledImageUpdateAfterBind
+		|| !vulkan12Features.descriptorBindingUpdateUnusedWhilePending
+		|| !vulkan12Features.shaderSampledImageArrayNonUniformIndexing) {
+		std::cout << "error: descriptor indexing not supported, bindless textures unavailable!" << std::endl;
+		return false;
+	}
+	// barrieres (render graph, transferts)
+	if (!synchronization2Features.synchronization2) {
+		std::cout << "error: synchronization2 not supported!" << std::endl;
+		return false;
+	}
+	// recyclage de l'anneau de staging (StagingRing)
+	if (!vulkan12Features.timelineSemaphore) {
+		std::cout << "error: timeline semaphores not supported!" << std::endl;
+		return false;
+	}
+	if (!vulkan12Features.imagelessFramebuffer) {
+		std::cout << "error: imageless framebuffers not supported!" << std::endl;
+		return false;
+	}
+	// textures compressees (.ktx2), sinon on revient aux images sources
+	context.textureCompressionBC = deviceFeatures2.features.textureCompressionBC == VK_TRUE;
+
+	// seules les features utilisees sont activees (la chaine interrogee ci-dessus contient tout ce qui est supporte)
+	VkPhysicalDeviceVulkan12Features enabledVulkan12Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	enabledVulkan12Features.runtimeDescriptorArray = VK_TRUE;
+	enabledVulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	enabledVulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+	enabledVulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	enabledVulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	enabledVulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	enabledVulkan12Features.timelineSemaphore = VK_TRUE;
+	enabledVulkan12Features.imagelessFramebuffer = VK_TRUE;
+	VkPhysicalDeviceSynchronization2FeaturesKHR enabledSynchronization2Features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR };
+	enabledSynchronization2Features.pNext = &enabledVulkan12Features;
+	enabledSynchronization2Features.synchronization2 = VK_TRUE;
+	VkPhysicalDeviceFeatures2 enabledFeatures2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	enabledFeatures2.pNext = &enabledSynchronization2Features;
+	enabledFeatures2.features.textureCompressionBC = deviceFeatures2.features.textureCompressionBC;
+
 	// on a besoin de :
 	//vulkan12Features.drawIndirectCount;
 	//deviceFeatures2.features.multiDrawIndirect;
@@ -179,6 +279,10 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 	VkFormatProperties formatProperties;
 	vkGetPhysicalDeviceFormatProperties(context.physicalDevice, VK_FORMAT_B8G8R8A8_SRGB, &formatProperties);
 
+	// limites du device (alignements des offsets dynamiques etc...)
+	vkGetPhysicalDeviceProperties(context.physicalDevice, &context.props);
+	std::cout << "device: " << context.props.deviceName << std::endl;
+
 	if (vkGetPhysicalDeviceProperties2) 
 	{
 		VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR };
@@ -189,6 +293,15 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 
 		VkPhysicalDeviceProperties2 deviceProperties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, &subgroupProperties };
 		vkGetPhysicalDeviceProperties2(context.physicalDevice, &deviceProperties2);
+
+		// un combined image sampler compte a la fois comme sampler et comme sampled image
+		context.maxBindlessTextures = indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages;
+		if (indexingProperties.maxDescriptorSetUpdateAfterBindSamplers < context.maxBindlessTextures)
+			context.maxBindlessTextures = indexingProperties.maxDescriptorSetUpdateAfterBindSamplers;
+		if (indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages < context.maxBindlessTextures)
+			context.maxBindlessTextures = indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages;
+		if (indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers < context.maxBindlessTextures)
+			context.maxBindlessTextures = indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers;
 		// Example of checking if supported in fragment shader
 		if ((subgroupProperties.supportedStages & VK_SHADER_STAGE_FRAGMENT_BIT) != 0) {
 			// fragment shaders supported
@@ -207,63 +320,118 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 	VkPhysicalDeviceMemoryProperties memoryProperties;
 	vkGetPhysicalDeviceMemoryProperties(context.physicalDevice, &memoryProperties);
 	context.memoryFlags.reserve(memoryProperties.memoryTypeCount);
-	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
 		context.memoryFlags.push_back(memoryProperties.memoryTypes[i].propertyFlags);
+		if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+			context.lazilyAllocatedMemory = true;
+	}
+	// attachments dont le contenu n'est jamais stocke : memoire allouee a la demande (souvent jamais, en tile memory)
+	rendercontext.transientAttachmentUsage = context.lazilyAllocatedMemory ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0;
 
 	rendercontext.graphicsQueueIndex = UINT32_MAX;
-	uint32_t queue_families_count = context.MAX_FAMILY_COUNT;
-	std::vector<VkQueueFamilyProperties> queue_family_properties(queue_families_count);
-	// normalement il faut appeler la fonction une premiere fois pour recuperer le nombre exact de queues supportees.
-	//voir les messages de validation
-	vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queue_families_count, &queue_family_properties[0]);
+	uint32_t queue_families_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queue_families_count, nullptr);
+	ArenaVector<VkQueueFamilyProperties> queue_family_properties(queue_families_count, arena);
+	vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queue_families_count, queue_family_properties.data());
 	for (uint32_t i = 0; i < queue_families_count; ++i) {
 		if ((queue_family_properties[i].queueCount > 0) &&
 			(queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
 			(queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
-			VkBool32 canPresentSurface;
-			vkGetPhysicalDeviceSurfaceSupportKHR(context.physicalDevice, i, context.surface, &canPresentSurface);
+			// en headless rien n'est presente
+			VkBool32 canPresentSurface = VK_TRUE;
+			if (!headless)
+				vkGetPhysicalDeviceSurfaceSupportKHR(context.physicalDevice, i, context.surface, &canPresentSurface);
 			if (canPresentSurface)
 				rendercontext.graphicsQueueIndex = i;
 			break;
 		}
 	}
+	if (rendercontext.graphicsQueueIndex == UINT32_MAX) {
+		std::cout << "error: no graphics+compute queue family!" << std::endl;
+		return false;
+	}
+
+	rendercontext.timestampValidBits = queue_family_properties[rendercontext.graphicsQueueIndex].timestampValidBits;
+
+	// queue de transfert dediee (souvent un moteur DMA) pour les chargements, a defaut la graphics queue
+	rendercontext.transferQueueIndex = rendercontext.graphicsQueueIndex;
+	for (uint32_t i = 0; i < queue_families_count; ++i) {
+		VkQueueFlags flags = queue_family_properties[i].queueFlags;
+		if (queue_family_properties[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT)
+			&& !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			rendercontext.transferQueueIndex = i;
+			break;
+		}
+	}
 
 	// on suppose que la presentation se fait par la graphics queue (verifier cela avec vkGetPhysicalDeviceSurfaceSupportKHR())
 	rendercontext.presentQueueIndex = rendercontext.graphicsQueueIndex;
 
 	const float queue_priorities[] = { 1.0f };
-	VkDeviceQueueCreateInfo queueCreateInfo = {};
-	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueCreateInfo.queueFamilyIndex = rendercontext.graphicsQueueIndex;
-	queueCreateInfo.queueCount = 1;
-	queueCreateInfo.pQueuePriorities = queue_priorities;
-
-	const char* device_extensions[] = { 
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME, 
+	VkDeviceQueueCreateInfo queueCreateInfo[2] = {};
+	queueCreateInfo[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueCreateInfo[0].queueFamilyIndex = rendercontext.graphicsQueueIndex;
+	queueCreateInfo[0].queueCount = 1;
+	queueCreateInfo[0].pQueuePriorities = queue_priorities;
+	queueCreateInfo[1] = queueCreateInfo[0];
+	queueCreateInfo[1].queueFamilyIndex = rendercontext.transferQueueIndex;
+	const uint32_t queueCreateCount = rendercontext.transferQueueIndex != rendercontext.graphicsQueueIndex ? 2 : 1;
+
+	ArenaVector<const char*> device_extensions({ 
 		VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
 		VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, 
 		VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, 
-		"VK_KHR_dynamic_rendering" 
-	};
+		VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME
+	}, arena);
+	if (!headless)
+		device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	// usage et budget des heaps (DeviceMemoryAllocator::GetBudget)
+	if (context.memoryBudgetSupported)
+		device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 	VkDeviceCreateInfo deviceInfo = {};
 	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceInfo.queueCreateInfoCount = 1;
-	deviceInfo.pQueueCreateInfos = &queueCreateInfo;
-	deviceInfo.enabledExtensionCount = _countof(device_extensions);
-	deviceInfo.ppEnabledExtensionNames = device_extensions;
-	deviceInfo.pNext = &deviceFeatures2;//deviceInfo.pEnabledFeatures
+	deviceInfo.queueCreateInfoCount = queueCreateCount;
+	deviceInfo.pQueueCreateInfos = queueCreateInfo;
+	deviceInfo.enabledExtensionCount = (uint32_t)device_extensions.size();
+	deviceInfo.ppEnabledExtensionNames = device_extensions.data();
+	deviceInfo.pNext = &enabledFeatures2;//deviceInfo.pEnabledFeatures
 	DEBUG_CHECK_VK(vkCreateDevice(context.physicalDevice, &deviceInfo, nullptr, &context.device));
 
 	//volkLoadDevice(context.device);
 
+	rendercontext.memoryAllocator.Create(context);
+	rendercontext.deferredDestroy.Create(context.device, rendercontext.memoryAllocator);
+
 	vkGetDeviceQueue(context.device, rendercontext.graphicsQueueIndex, 0, &rendercontext.graphicsQueue);
 	rendercontext.presentQueue = rendercontext.graphicsQueue;
+	vkGetDeviceQueue(context.device, rendercontext.transferQueueIndex, 0, &rendercontext.transferQueue);
+	if (rendercontext.transferQueueIndex != rendercontext.graphicsQueueIndex)
+		std::cout << "transfer queue: family " << rendercontext.transferQueueIndex << std::endl;
+
+	// headless : les "images de la swapchain" sont des render surfaces hors ecran
+	// relisibles (TRANSFER_SRC) pour les captures et tests de non-regression
+	if (headless)
+	{
+		context.surfaceFormat = { VK_FORMAT_R8G8B8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+		context.swapchainExtent = headlessExtent;
+		context.swapchainImageCount = context.SWAPCHAIN_IMAGES;
+		for (uint32_t i = 0; i < context.swapchainImageCount; i++) {
+			if (!offscreenTargets[i].CreateSurface(rendercontext, context.swapchainExtent.width, context.swapchainExtent.height, PIXFMT_SRGBA8, 1
+				, IMAGE_USAGE_RENDERTARGET | IMAGE_USAGE_TEXTURE | IMAGE_USAGE_BITMAP | IMAGE_USAGE_TRANSFER))
+				return false;
+			context.swapchainImages[i].image = offscreenTargets[i].image;
+		}
+
+		m_frame = 0;
+
+		return Prepare();
+	}
 
 	// swap chain
 	
 	uint32_t formatCount = 32;
 	vkGetPhysicalDeviceSurfaceFormatsKHR(context.physicalDevice, context.surface, &formatCount, 0);
-	std::vector<VkSurfaceFormatKHR> surfaceFormats(formatCount);
+	ArenaVector<VkSurfaceFormatKHR> surfaceFormats(formatCount, arena);
 	vkGetPhysicalDeviceSurfaceFormatsKHR(context.physicalDevice, context.surface, &formatCount, surfaceFormats.data());
 	context.surfaceFormat = surfaceFormats[0];
 	for (uint32_t i = 0; i < formatCount; i++) {
@@ -280,7 +448,7 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 
 	uint32_t presentModeCount = 8;
 	vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice, context.surface, &presentModeCount, 0);
-	std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+	ArenaVector<VkPresentModeKHR> presentModes(presentModeCount, arena);
 	vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice, context.surface, &presentModeCount, presentModes.data());
 	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;   // FIFO est toujours garanti.
 	context.swapchainImageCount = context.SWAPCHAIN_IMAGES;
@@ -290,9 +458,19 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 	context.swapchainExtent = surfaceCapabilities.currentExtent;
 	VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // garanti
 	if (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-		imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; // necessaire ici pour vkCmdClearImageColor
-													   //	if (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
-													   //		imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT; // necessaire ici pour screenshots, read back
+		imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; // necessaire pour la copie (blit) du color buffer
+	else
+		std::cout << "error: swapchain images cannot be a transfer destination, upscale blit impossible" << std::endl;
+	if (capturePrefix)
+	{
+		// necessaire pour la relecture (captures), pas garanti par toutes les surfaces
+		if (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+			imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		else {
+			std::cout << "error: swapchain images cannot be a transfer source, frame capture disabled" << std::endl;
+			capturePrefix = nullptr;
+		}
+	}
 
 	VkSwapchainCreateInfoKHR swapchainInfo = {};
 	swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -312,7 +490,7 @@ bool VulkanGraphicsApplication::Initialize(const char* appName)
 
 	DEBUG_CHECK_VK(vkGetSwapchainImagesKHR(context.device, context.swapchain, &context.swapchainImageCount, nullptr));
 	assert(swapchainInfo.minImageCount == context.swapchainImageCount);
-	std::vector<VkImage> images(context.swapchainImageCount);
+	ArenaVector<VkImage> images(context.swapchainImageCount, arena);
 	DEBUG_CHECK_VK(vkGetSwapchainImagesKHR(context.device, context.swapchain, &context.swapchainImageCount, images.data()));
 	for (uint32_t i = 0; i < context.swapchainImageCount; i++) {
 		context.swapchainImages[i].image = images[i];
@@ -332,13 +510,29 @@ bool VulkanGraphicsApplication::Shutdown()
 
 	vkDeviceWaitIdle(context.device);
 
+	// GPU idle : toutes les copies en attente sont terminees, on laisse les encodeurs finir
+	if (capturePrefix) {
+		capture.Flush(rendercontext.memoryAllocator);
+		std::cout << "frame capture: " << capture.capturedCount << " frames written, " << capture.droppedCount << " dropped (encoders too slow)" << std::endl;
+	}
+
+	// les pipelines optionnels peuvent encore etre en cours de compilation
+	pipelines.WaitAll();
+	// tous les pipelines ont ete crees, le cache est complet
+	pipelineCache.Save(context);
+
 	Terminate();
+	// GPU idle : les destructions differees (dont celles de Terminate) sont executees
+	rendercontext.deferredDestroy.Flush();
+	rendercontext.memoryAllocator.Destroy();
 	
-	vkDestroySwapchainKHR(context.device, context.swapchain, nullptr);
+	if (!headless)
+		vkDestroySwapchainKHR(context.device, context.swapchain, nullptr);
 
 	vkDestroyDevice(context.device, nullptr);
 
-	vkDestroySurfaceKHR(context.instance, context.surface, nullptr);
+	if (!headless)
+		vkDestroySurfaceKHR(context.instance, context.surface, nullptr);
 
 #ifdef VULKAN_ENABLE_VALIDATION
 	vkDestroyDebugReportCallbackEXT(context.instance, context.debugCallback, nullptr);
@@ -366,20 +560,16 @@ bool VulkanGraphicsApplication::Run()
 
 
 
-uint32_t Texture::CheckExist(const char* path)
+TextureHandle Texture::CheckExist(const char* path)
 {
-	// "ranged-for" du C++. Equivalent d'un "foreach" en C#
-	/*for (Texture& tex : textures) {
-		if (tex.name == path)
-			return tex.id;
-	}*/
-	return 0;
+	std::lock_guard<std::mutex> lock(mutex);
+	return FindPath(path);
 }
 
 void Texture::SetupManager()
 {
 	// cration d'une texture par defaut, 1x1 blanche
-	if (textures.size() == 0) {
+	if (liveCount == 0) {
 		const uint8_t data[] = { 255,255,255,255 };
 		LoadTexture(data, 1, 1, PixelFormat::PIXFMT_SRGBA8);
 		//uint32_t textureID = CreateTextureRGBA(1, 1, data);
@@ -389,12 +579,29 @@ void Texture::SetupManager()
 
 void Texture::PurgeTextures()
 {
-	for (auto& texture : textures)
+	// les decodages en cours ecrivent dans decoded : on attend leur fin, leurs images ne seront pas transferees
+	std::unique_lock<std::mutex> lock(mutex);
+	decodedCondition.wait(lock, []() { return decodesInFlight == 0; });
+	for (DecodedImage& image : decoded)
+		image.Release();
+	decoded.clear();
+	deferredDecodes.clear();
+	// copies enregistrees mais pas encore publiees : la texture n'est dans aucun slot
+	for (UploadingTexture& upload : uploading)
+		upload.texture.Destroy(*rendercontext);
+	uploading.clear();
+	pendingUploads = 0;
+
+	for (TextureSlot& slot : slots)
 	{
-		texture.Destroy(*rendercontext);
+		if (slot.refCount > 0)
+			slot.texture.Destroy(*rendercontext);
 	}
 	// change le nombre d'element (size)  zero, mais conserve la meme capacite
-	textures.clear();
+	slots.clear();
 	// force capacite = size
-	textures.shrink_to_fit();
+	slots.shrink_to_fit();
+	pathToHandle.clear();
+	firstFree = TEXTURE_HANDLE_INDEX_MASK;
+	liveCount = 0;
 }
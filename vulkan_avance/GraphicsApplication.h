@@ -3,6 +3,13 @@
 #include "vk_common.h"
 #include "DeviceContext.h"
 #include "RenderContext.h"
+#include "JobSystem.h"
+#include "RenderGraph.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "LatencyTracker.h"
 
 struct GLFWwindow;
 
@@ -11,15 +18,53 @@ struct VulkanGraphicsApplication
 	const char* name;
 	VulkanDeviceContext context;
 	VulkanRenderContext rendercontext;
-	GLFWwindow* window;
-
-	// rendu hors ecran
-	RenderSurface colorBuffer;
-	RenderSurface depthBuffer;
-
-	VkPipeline mainPipelineOpaque;
-
-	VkPipeline mainPipelineEnvMap;
+	GLFWwindow* window = nullptr;
+
+	// mode sans fenetre (CI, serveurs de rendu) : ni surface ni swapchain, rendu dans des render surfaces
+	// hors ecran qui remplacent les images de la swapchain, cadence par les fences des frames
+	bool headless = false;
+	VkExtent2D headlessExtent = { 1920, 1080 };
+	RenderSurface offscreenTargets[VulkanDeviceContext::SWAPCHAIN_IMAGES];
+
+	// passes de la frame et leurs ressources, les barrieres sont deduites par le graphe
+	RenderGraph frameGraph;
+	RGResource rgPrevInstances, rgInstances;
+	RGResource rgPrevVelocities, rgVelocities;
+	RGResource rgSwapchain;
+	RGResource rgColor;		// rendu hors ecran, transient (taille max = swapchain)
+	RGResource rgDepth;		// transient, possede par le graphe
+
+	// la passe principale dessine dans le coin [0, m_renderExtent] du color buffer, recopie ensuite dans la swapchain
+	DynamicResolution resolution;
+	float gpuBudgetMs = 12.f;
+	float renderScale = 1.f;
+	VkExtent2D m_renderExtent;
+
+	// partage par toutes les creations de pipelines, relu/ecrit sur disque
+	PipelineCache pipelineCache;
+
+	// compiles en parallele au demarrage, acces via pipelines.Get(id)
+	PipelineLibrary pipelines;
+	uint32_t opaquePipelineId;
+	uint32_t envMapPipelineId;			// optionnel
+	uint32_t simulationPipelineId;
+	uint32_t m_readyPipelineCount = 0;
+
+	// capture de chaque frame sur disque (fichiers capturePrefix_NNNNNN.png), nullptr = desactivee
+	// les copies sont relues et encodees en arriere-plan, la boucle de rendu ne les attend jamais
+	FrameCapture capture;
+	const char* capturePrefix = nullptr;
+	bool capturePng = true;
+
+	// constantes camera de la frame : reservees dans Display(), ecrites par LatchCamera() juste avant le submit
+	void* m_latchedMatrices = nullptr;
+	LatencyTracker latency;
+
+	// rapport memoire (heaps, budget, categories) toutes les N frames, 0 = seulement au demarrage
+	uint32_t memoryReportInterval = 0;
+	// allocations sur le tas pendant la derniere frame complete (cf. MemoryArena.h)
+	uint64_t m_heapAllocationMark = 0;
+	uint64_t m_frameHeapAllocations = 0;
 
 	// on partage la meme signaure (les memes inputs) entre ces deux pipelines
 	VkPipelineLayout mainPipelineLayout;
@@ -29,6 +74,18 @@ struct VulkanGraphicsApplication
 	uint32_t m_imageIndex;
 	uint32_t m_frame;
 
+	// workers pour l'enregistrement des command buffers (et autres taches paralleles)
+	JobSystem jobs;
+	uint32_t recordThreadCount = 0;	// 0 = un par coeur, 1 = tout sur le thread principal
+
+	// command buffers enregistres une fois par [frame][image] puis resoumis tels quels
+	// sceneDirty force le reenregistrement (nouveau mesh, resize, nombre d'instances...)
+	bool cacheCommandBuffers = false;
+	bool sceneDirty = true;
+	VkCommandBuffer m_submitCommandBuffer = VK_NULL_HANDLE;
+	bool m_recordReusable = false;
+	bool m_skipScene = false;		// constantes de la frame non allouees (frameAllocator plein) : ni simulation ni dessin
+
 	bool Initialize(const char *);
 	bool Prepare();
 	bool Run();
@@ -36,6 +93,23 @@ struct VulkanGraphicsApplication
 	bool Begin();
 	bool End();
 	bool Display();
+	// enregistre la frame complete (compute + passe principale) pour l'image m_imageIndex
+	void RecordFrame(VkCommandBuffer commandBuffer, bool reusable);
+	// declare les passes de la frame et compile le graphe
+	bool BuildFrameGraph();
+	void RecordSimulationPass(VkCommandBuffer commandBuffer);
+	void RecordForwardPass(VkCommandBuffer commandBuffer);
+	void RecordUpscalePass(VkCommandBuffer commandBuffer);
+	void RecordCapturePass(VkCommandBuffer commandBuffer);
+	// lit les dernieres entrees, met a jour la camera et ecrit view/projection dans l'UBO de la frame
+	void LatchCamera();
+	// lit le temps GPU de la frame courante (fence attendue) et ajuste la taille de rendu
+	void UpdateRenderScale();
+	// enregistre les draws des instances [firstInstance, firstInstance+instanceCount)
+	// par paquets de instancesPerDraw instances (0 = un seul draw), + l'envmap si drawEnvMap
+	void RecordScenePass(VkCommandBuffer commandBuffer, uint32_t firstInstance, uint32_t instanceCount, uint32_t instancesPerDraw, bool drawEnvMap);
+	// mesure le temps d'enregistrement CPU de 1 a maxThreads threads
+	void BenchmarkRecording(uint32_t maxThreads);
 	void Terminate();
 	bool Shutdown();
 
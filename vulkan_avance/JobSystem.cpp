@@ -0,0 +1,116 @@
+#include "JobSystem.h"
+
+static thread_local uint32_t currentThreadIndex = UINT32_MAX;
+
+bool JobSystem::Create(uint32_t threadCount)
+{
+	if (threadCount == 0) {
+		uint32_t cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	quit = false;
+	pendingJobs = 0;
+	workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+
+	return true;
+}
+
+void JobSystem::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+	// les taches non demarrees sont abandonnees
+	queue.clear();
+	pendingJobs = 0;
+}
+
+void JobSystem::Submit(Job job)
+{
+	if (workers.empty()) {
+		job(0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(job));
+		pendingJobs++;
+	}
+	wakeCondition.notify_one();
+}
+
+void JobSystem::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idleCondition.wait(lock, [this] { return pendingJobs == 0; });
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t threadIndex)>& func)
+{
+	if (count == 0)
+		return;
+	if (workers.empty() || count == 1) {
+		for (uint32_t i = 0; i < count; i++)
+			func(i, 0);
+		return;
+	}
+
+	// compteur local : on n'attend que nos propres taches, pas celles soumises par ailleurs
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	uint32_t remaining = count;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Submit([&, i](uint32_t threadIndex) {
+			func(i, threadIndex);
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--remaining == 0)
+				doneCondition.notify_one();
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(doneMutex);
+	doneCondition.wait(lock, [&] { return remaining == 0; });
+}
+
+uint32_t JobSystem::CurrentThreadIndex()
+{
+	return currentThreadIndex;
+}
+
+void JobSystem::WorkerLoop(uint32_t threadIndex)
+{
+	currentThreadIndex = threadIndex;
+
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this] { return quit || !queue.empty(); });
+			if (quit)
+				return;
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		job(threadIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pendingJobs == 0)
+				idleCondition.notify_all();
+		}
+	}
+}
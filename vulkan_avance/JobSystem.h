@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Pool de threads minimaliste : une file de taches FIFO partagee par N workers
+// - Submit()/Wait() pour des taches independantes
+// - ParallelFor() pour decouper un travail en N morceaux et attendre uniquement ceux-ci
+// Chaque tache recoit l'index du worker qui l'execute (0..ThreadCount()-1)
+// ce qui permet d'utiliser des ressources par thread (command pools, arenas...) sans verrou
+struct JobSystem
+{
+	using Job = std::function<void(uint32_t threadIndex)>;
+
+	std::vector<std::thread> workers;
+	std::deque<Job> queue;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;	// signale aux workers qu'une tache est disponible
+	std::condition_variable idleCondition;	// signale a Wait() que toutes les taches sont terminees
+	uint32_t pendingJobs = 0;				// taches en file + en cours d'execution
+	bool quit = false;
+
+	// threadCount = 0 : un worker par coeur, moins le thread principal
+	bool Create(uint32_t threadCount = 0);
+	void Destroy();
+
+	uint32_t ThreadCount() const { return (uint32_t)workers.size(); }
+
+	void Submit(Job job);
+	// attend la fin de toutes les taches soumises
+	void Wait();
+
+	// appelle func(index, threadIndex) pour index dans [0, count) et attend la fin de ces appels
+	// sans workers (ThreadCount() == 0) tout est execute sur le thread appelant
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t threadIndex)>& func);
+
+	// index du worker courant, UINT32_MAX hors d'un worker (thread principal par ex.)
+	static uint32_t CurrentThreadIndex();
+
+private:
+	void WorkerLoop(uint32_t threadIndex);
+};
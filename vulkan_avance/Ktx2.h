@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+// Conteneur KTX2 (sous-ensemble) des textures pretes pour le GPU
+// Ecrit hors ligne par tools/texconv, lu par Texture::Load : une seule image 2D (ni cubemap, ni array, ni 3D),
+// pas de supercompression, chaine de mips complete en blocs BCn (ou RGBA8).
+// Disposition du fichier : entete, index des niveaux (niveau 0 en premier), DFD, puis les donnees
+// des niveaux, du plus petit au plus grand, chacune alignee sur la taille d'un bloc.
+// Partage avec l'outil : pas de dependance a Vulkan, les formats sont les valeurs numeriques de VkFormat
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// valeurs de VkFormat
+enum Ktx2Format : uint32_t
+{
+	KTX2_FORMAT_R8G8B8A8_UNORM = 37,
+	KTX2_FORMAT_R8G8B8A8_SRGB = 43,
+	KTX2_FORMAT_BC1_RGB_UNORM = 131,
+	KTX2_FORMAT_BC1_RGB_SRGB = 132,
+	KTX2_FORMAT_BC3_UNORM = 137,
+	KTX2_FORMAT_BC3_SRGB = 138,
+	KTX2_FORMAT_BC4_UNORM = 139,
+	KTX2_FORMAT_BC5_UNORM = 141
+};
+
+struct Ktx2Header
+{
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;				// 1 pour les formats compresses
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;			// 0 : image 2D
+	uint32_t layerCount;			// 0 : pas un array
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be 80 bytes");
+
+// suit l'entete, un element par niveau de mip
+struct Ktx2Level
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// taille d'un bloc en octets (bloc 4x4 pour BCn, 1 pixel sinon), 0 si le format n'est pas supporte
+inline uint32_t Ktx2BlockBytes(uint32_t vkFormat)
+{
+	switch (vkFormat)
+	{
+	case KTX2_FORMAT_R8G8B8A8_UNORM:
+	case KTX2_FORMAT_R8G8B8A8_SRGB: return 4;
+	case KTX2_FORMAT_BC1_RGB_UNORM:
+	case KTX2_FORMAT_BC1_RGB_SRGB:
+	case KTX2_FORMAT_BC4_UNORM: return 8;
+	case KTX2_FORMAT_BC3_UNORM:
+	case KTX2_FORMAT_BC3_SRGB:
+	case KTX2_FORMAT_BC5_UNORM: return 16;
+	default: return 0;
+	}
+}
+
+inline uint32_t Ktx2BlockDim(uint32_t vkFormat)
+{
+	return vkFormat >= KTX2_FORMAT_BC1_RGB_UNORM ? 4 : 1;
+}
+
+// taille en octets du niveau de dimensions w x h
+inline uint64_t Ktx2LevelSize(uint32_t vkFormat, uint32_t w, uint32_t h)
+{
+	const uint32_t dim = Ktx2BlockDim(vkFormat);
+	return (uint64_t)((w + dim - 1) / dim) * ((h + dim - 1) / dim) * Ktx2BlockBytes(vkFormat);
+}
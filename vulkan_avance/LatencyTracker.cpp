@@ -0,0 +1,68 @@
+#include "LatencyTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static float ElapsedMs(LatencyTracker::Clock::time_point from, LatencyTracker::Clock::time_point to)
+{
+	return std::chrono::duration<float, std::milli>(to - from).count();
+}
+
+void LatencyTracker::OnInput()
+{
+	// on garde le plus ancien evenement : c'est lui qui attend le plus longtemps
+	if (!pending) {
+		pending = true;
+		firstInput = Clock::now();
+	}
+}
+
+void LatencyTracker::OnLatch()
+{
+	latched = pending;
+	pending = false;
+	if (!latched)
+		return;
+
+	latchedInput = firstInput;
+	latchSamples.push_back(ElapsedMs(latchedInput, Clock::now()));
+}
+
+void LatencyTracker::OnPresent()
+{
+	if (!latched)
+		return;
+	latched = false;
+
+	presentSamples.push_back(ElapsedMs(latchedInput, Clock::now()));
+	if (reportInterval && presentSamples.size() >= reportInterval)
+		Report();
+}
+
+float LatencyTracker::Percentile(std::vector<float>& samples, float percentile)
+{
+	if (samples.empty())
+		return 0.f;
+	std::sort(samples.begin(), samples.end());
+	size_t rank = (size_t)std::ceil(percentile / 100.f * samples.size());
+	rank = std::min(std::max(rank, (size_t)1), samples.size());
+	return samples[rank - 1];
+}
+
+void LatencyTracker::Report()
+{
+	if (presentSamples.empty() && latchSamples.empty())
+		return;
+
+	auto print = [](const char* label, std::vector<float>& samples) {
+		std::cout << "  " << label << ": p50 " << Percentile(samples, 50.f) << " ms, p90 " << Percentile(samples, 90.f)
+			<< " ms, p99 " << Percentile(samples, 99.f) << " ms, max " << Percentile(samples, 100.f) << " ms" << std::endl;
+	};
+	std::cout << "input latency (" << presentSamples.size() << " frames with input):" << std::endl;
+	print("input -> latch  ", latchSamples);
+	print("input -> present", presentSamples);
+
+	latchSamples.clear();
+	presentSamples.clear();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+// Mesure de la latence entree -> present
+// OnInput() horodate le premier evenement (souris, molette...) non encore pris en compte,
+// OnLatch() l'associe a la frame dont les constantes camera viennent d'etre ecrites,
+// OnPresent() cloture la mesure de cette frame. Seules les frames ayant consomme une entree produisent un echantillon
+// Deux latences sont suivies : entree -> latch (age des constantes camera au submit) et entree -> present.
+// Le temps GPU restant et le scanout ne sont pas inclus (il faudrait des timestamps calibres ou VK_KHR_present_wait)
+// Tout est appele depuis le thread principal (les callbacks GLFW sont emis par glfwPollEvents)
+struct LatencyTracker
+{
+	using Clock = std::chrono::steady_clock;
+
+	uint32_t reportInterval = 300;	// nombre d'echantillons entre deux rapports (0 = seulement Report() explicite)
+
+	bool pending = false;			// une entree attend la prochaine frame
+	Clock::time_point firstInput;
+	bool latched = false;			// la frame en cours de soumission a consomme une entree
+	Clock::time_point latchedInput;
+
+	std::vector<float> latchSamples;	// ms
+	std::vector<float> presentSamples;	// ms
+
+	void OnInput();
+	void OnLatch();
+	void OnPresent();
+	// affiche p50/p90/p99/max des echantillons accumules puis les efface
+	void Report();
+
+	// percentile (0..100) par rang le plus proche, samples est trie sur place
+	static float Percentile(std::vector<float>& samples, float percentile);
+};
@@ -0,0 +1,650 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+
+#include <algorithm>
+
+const char* MemoryCategoryName(MemoryCategory category)
+{
+	static const char* names[MEMORY_CATEGORY_COUNT] = { "other", "mesh", "texture", "render target", "staging", "simulation", "constants" };
+	return category < MEMORY_CATEGORY_COUNT ? names[category] : "?";
+}
+
+const char* MemoryUsageName(MemoryUsage usage)
+{
+	static const char* names[MEMORY_USAGE_COUNT] = { "unknown", "gpu only", "static", "upload", "stream", "readback" };
+	return usage < MEMORY_USAGE_COUNT ? names[usage] : "?";
+}
+
+bool DeviceMemoryAllocator::Create(VulkanDeviceContext& context)
+{
+	device = context.device;
+	physicalDevice = context.physicalDevice;
+	budgetExtension = context.memoryBudgetSupported;
+	vkGetPhysicalDeviceMemoryProperties(context.physicalDevice, &memoryProperties);
+	nonCoherentAtomSize = context.props.limits.nonCoherentAtomSize > 0 ? context.props.limits.nonCoherentAtomSize : 1;
+	maxAllocationCount = context.props.limits.maxMemoryAllocationCount;
+
+	blocks.clear();
+	deviceMemoryCount = 0;
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++) {
+		dedicatedBytes[i] = 0;
+		dedicatedCount[i] = 0;
+		for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+			categoryUsage[i][c] = {};
+	}
+	peakDeviceLocalBytes = 0;
+	evictionCount = 0;
+
+	// memoire video = le plus grand heap DEVICE_LOCAL ; "BAR" = sa partie visible du CPU (types DEVICE_LOCAL|HOST_VISIBLE)
+	// sans resizable BAR cette fenetre est un heap separe de 256 Mo au plus, avec elle c'est le heap video lui-meme
+	deviceLocalHeap = 0;
+	unifiedMemory = true;
+	for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++) {
+		const VkMemoryHeap& h = memoryProperties.memoryHeaps[heap];
+		if (!(h.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+			unifiedMemory = false;
+		else if (!(memoryProperties.memoryHeaps[deviceLocalHeap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) || h.size > memoryProperties.memoryHeaps[deviceLocalHeap].size)
+			deviceLocalHeap = heap;
+	}
+	barSize = 0;
+	bool barOnVideoHeap = false;
+	for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+		const VkMemoryType& t = memoryProperties.memoryTypes[type];
+		const VkMemoryPropertyFlags bar = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		if ((t.propertyFlags & bar) != bar)
+			continue;
+		barSize = std::max(barSize, memoryProperties.memoryHeaps[t.heapIndex].size);
+		barOnVideoHeap |= t.heapIndex == deviceLocalHeap;
+	}
+	resizableBar = !unifiedMemory && barSize > 0 && (barOnVideoHeap || barSize > (256ull << 20));
+
+	std::cout << "device memory: " << (memoryProperties.memoryHeaps[deviceLocalHeap].size >> 20) << " MB device local (heap " << deviceLocalHeap << "), "
+		<< (unifiedMemory ? "unified memory" : resizableBar ? "resizable BAR" : barSize ? "legacy BAR" : "no BAR")
+		<< (barSize && !unifiedMemory ? " " + std::to_string(barSize >> 20) + " MB" : "")
+		<< ", static uploads " << (DirectUpload() ? "written directly" : "staged") << std::endl;
+	return true;
+}
+
+void DeviceMemoryAllocator::UsageFlags(MemoryUsage usage, VkMemoryPropertyFlags& required, VkMemoryPropertyFlags& preferred)
+{
+	switch (usage)
+	{
+	case MEMORY_USAGE_UPLOAD:
+	case MEMORY_USAGE_STREAM:
+		// pas de flush a gerer par l'appelant
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		preferred = 0;
+		break;
+	case MEMORY_USAGE_READBACK:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		break;
+	default:
+		// GPU_ONLY, STATIC : DEVICE_LOCAL est prefere (classement) mais pas exige, la RAM systeme reste un recours
+		required = 0;
+		preferred = 0;
+		break;
+	}
+}
+
+uint32_t DeviceMemoryAllocator::RankMemoryTypes(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage
+	, VkDeviceSize size, uint32_t types[VK_MAX_MEMORY_TYPES])
+{
+	HeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+	GetBudget(budgets);
+
+	// jamais choisis s'ils ne sont pas demandes : protected et device coherent exigent une feature,
+	// lazily allocated n'a de sens que pour les attachments transients
+	const VkMemoryPropertyFlags special = VK_MEMORY_PROPERTY_PROTECTED_BIT | VK_MEMORY_PROPERTY_DEVICE_COHERENT_BIT_AMD | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+	const VkMemoryPropertyFlags deviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	const VkMemoryPropertyFlags hostCached = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	uint64_t scores[VK_MAX_MEMORY_TYPES];
+	uint32_t count = 0;
+	for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
+	{
+		VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[type].propertyFlags;
+		if (!(typeBits & (1u << type)) || (flags & required) != required || (flags & special & ~(required | preferred)))
+			continue;
+
+		// du plus au moins important : flags preferes, place dans le budget, intention d'usage, taille du heap
+		uint32_t heap = memoryProperties.memoryTypes[type].heapIndex;
+		bool has[2] = {};
+		uint64_t score = 0;
+		if ((flags & preferred) == preferred)
+			score |= 1ull << 62;
+		if (budgets[heap].usage + size <= budgets[heap].budget)
+			score |= 1ull << 61;
+		switch (usage)
+		{
+		case MEMORY_USAGE_GPU_ONLY:
+			// la fenetre BAR est gardee pour ce qui est ecrit par le CPU
+			has[0] = (flags & deviceLocal) != 0;
+			has[1] = !(flags & hostVisible) || unifiedMemory;
+			break;
+		case MEMORY_USAGE_STATIC:
+			has[0] = (flags & deviceLocal) != 0;
+			has[1] = DirectUpload() ? (flags & hostVisible) != 0 : !(flags & hostVisible);
+			break;
+		case MEMORY_USAGE_UPLOAD:
+			// write-combined en RAM systeme : ne consomme ni la BAR ni la memoire video
+			has[0] = !(flags & deviceLocal) || unifiedMemory;
+			has[1] = !(flags & hostCached);
+			break;
+		case MEMORY_USAGE_STREAM:
+			// lecture GPU sans passer par le bus : la BAR, meme petite, pour les donnees de la frame
+			has[0] = (flags & deviceLocal) != 0;
+			has[1] = !(flags & hostCached);
+			break;
+		case MEMORY_USAGE_READBACK:
+			has[0] = (flags & hostCached) != 0;
+			has[1] = !(flags & deviceLocal) || unifiedMemory;
+			break;
+		default:
+			break;
+		}
+		score |= (uint64_t)has[0] << 60 | (uint64_t)has[1] << 59;
+		// a egalite, le plus grand heap (ordre des memory types conserve sans intention d'usage)
+		if (usage != MEMORY_USAGE_UNKNOWN)
+			score |= memoryProperties.memoryHeaps[heap].size >> 20;
+
+		// tri par insertion, stable
+		uint32_t i = count++;
+		while (i > 0 && scores[i - 1] < score) {
+			scores[i] = scores[i - 1];
+			types[i] = types[i - 1];
+			i--;
+		}
+		scores[i] = score;
+		types[i] = type;
+	}
+	return count;
+}
+
+void DeviceMemoryAllocator::Destroy()
+{
+	uint32_t leaked = 0;
+	for (Block& block : blocks)
+	{
+		if (block.memory == VK_NULL_HANDLE)
+			continue;
+		leaked += block.tlsf.allocationCount;
+		if (block.mapped)
+			vkUnmapMemory(device, block.memory);
+		vkFreeMemory(device, block.memory, nullptr);
+	}
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++)
+		leaked += dedicatedCount[i];
+	if (leaked)
+		std::cout << "warning: " << leaked << " device memory allocations not freed" << std::endl;
+
+	blocks.clear();
+	deviceMemoryCount = 0;
+}
+
+VkDeviceSize DeviceMemoryAllocator::BlockSize(uint32_t memoryType) const
+{
+	// petits heaps (BAR de 256 Mo par ex.) : des blocs plus petits pour ne pas les monopoliser
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	VkDeviceSize size = DEFAULT_BLOCK_SIZE;
+	while (size > (1ull << 20) && size > heapSize / 8)
+		size >>= 1;
+	return size;
+}
+
+bool DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred
+	, AllocationKind kind, MemoryCategory category, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated)
+{
+	return AllocateRanked(requirements, required, preferred, MEMORY_USAGE_UNKNOWN, kind, category, allocation, dedicated);
+}
+
+bool DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, AllocationKind kind, MemoryCategory category
+	, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated)
+{
+	VkMemoryPropertyFlags required, preferred;
+	UsageFlags(usage, required, preferred);
+	return AllocateRanked(requirements, required, preferred, usage, kind, category, allocation, dedicated);
+}
+
+bool DeviceMemoryAllocator::AllocateRanked(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred
+	, MemoryUsage usage, AllocationKind kind, MemoryCategory category, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated)
+{
+	allocation = {};
+
+	uint32_t candidates[VK_MAX_MEMORY_TYPES];
+	uint32_t candidateCount = RankMemoryTypes(requirements.memoryTypeBits, required, preferred, usage, requirements.size, candidates);
+	if (candidateCount == 0) {
+		std::cout << "error: no memory type matches the resource requirements" << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// un type peut etre epuise (heap plein) : on essaie le suivant
+	for (uint32_t c = 0; c < candidateCount; c++)
+	{
+		uint32_t type = candidates[c];
+		bool useDedicated = dedicated != nullptr || requirements.size > BlockSize(type) / 2;
+		if (useDedicated ? AllocateDedicated(requirements, type, allocation, dedicated) : AllocateFromBlocks(requirements, type, kind, allocation)) {
+			allocation.category = category;
+			Account(allocation, true);
+			return true;
+		}
+	}
+
+	std::cout << "error: out of device memory (" << (requirements.size >> 10) << " KB requested)" << std::endl;
+	return false;
+}
+
+bool DeviceMemoryAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated)
+{
+	if (deviceMemoryCount >= maxAllocationCount)
+		return false;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = dedicated;
+	allocInfo.allocationSize = requirements.size;
+	allocInfo.memoryTypeIndex = memoryType;
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		return false;
+
+	void* mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		DEBUG_CHECK_VK(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+
+	uint32_t heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+	dedicatedBytes[heap] += requirements.size;
+	dedicatedCount[heap]++;
+	deviceMemoryCount++;
+
+	allocation = { memory, 0, requirements.size, mapped, memoryType, UINT32_MAX, TlsfAllocator::INVALID };
+	return true;
+}
+
+bool DeviceMemoryAllocator::AllocateFromBlocks(const VkMemoryRequirements& requirements, uint32_t memoryType, AllocationKind kind, Allocation& allocation)
+{
+	uint64_t offset;
+	for (uint32_t b = 0; b < blocks.size(); b++)
+	{
+		Block& block = blocks[b];
+		if (block.memory == VK_NULL_HANDLE || block.memoryType != memoryType || block.kind != kind)
+			continue;
+		uint32_t node = block.tlsf.Allocate(requirements.size, requirements.alignment, offset);
+		if (node == TlsfAllocator::INVALID)
+			continue;
+		allocation = { block.memory, offset, requirements.size, block.mapped ? (uint8_t*)block.mapped + offset : nullptr, memoryType, b, node };
+		return true;
+	}
+
+	// nouveau bloc
+	if (deviceMemoryCount >= maxAllocationCount)
+		return false;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = BlockSize(memoryType);
+	allocInfo.memoryTypeIndex = memoryType;
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		return false;
+	deviceMemoryCount++;
+
+	uint32_t b = 0;
+	while (b < blocks.size() && blocks[b].memory != VK_NULL_HANDLE)
+		b++;
+	if (b == blocks.size())
+		blocks.emplace_back();
+
+	Block& block = blocks[b];
+	block.memory = memory;
+	block.size = allocInfo.allocationSize;
+	block.mapped = nullptr;
+	block.memoryType = memoryType;
+	block.kind = kind;
+	block.tlsf.Create(block.size);
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		DEBUG_CHECK_VK(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &block.mapped));
+
+	uint32_t node = block.tlsf.Allocate(requirements.size, requirements.alignment, offset);
+	allocation = { block.memory, offset, requirements.size, block.mapped ? (uint8_t*)block.mapped + offset : nullptr, memoryType, b, node };
+	return node != TlsfAllocator::INVALID;
+}
+
+bool DeviceMemoryAllocator::AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryCategory category, Allocation& allocation)
+{
+	return AllocateBufferRanked(buffer, required, preferred, MEMORY_USAGE_UNKNOWN, category, allocation);
+}
+
+bool DeviceMemoryAllocator::AllocateBuffer(VkBuffer buffer, MemoryUsage usage, MemoryCategory category, Allocation& allocation)
+{
+	VkMemoryPropertyFlags required, preferred;
+	UsageFlags(usage, required, preferred);
+	return AllocateBufferRanked(buffer, required, preferred, usage, category, allocation);
+}
+
+bool DeviceMemoryAllocator::AllocateBufferRanked(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage
+	, MemoryCategory category, Allocation& allocation)
+{
+	VkMemoryDedicatedRequirements dedicatedRequirements = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 requirements = { VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+	requirements.pNext = &dedicatedRequirements;
+	VkBufferMemoryRequirementsInfo2 requirementsInfo = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2 };
+	requirementsInfo.buffer = buffer;
+	vkGetBufferMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO };
+	dedicatedInfo.buffer = buffer;
+	bool dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+
+	if (!AllocateRanked(requirements.memoryRequirements, required, preferred, usage, ALLOCATION_LINEAR, category, allocation, dedicated ? &dedicatedInfo : nullptr))
+		return false;
+	if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		std::cout << "error: failed to bind buffer memory!" << std::endl;
+		Free(allocation);
+		return false;
+	}
+	return true;
+}
+
+bool DeviceMemoryAllocator::AllocateImage(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryCategory category, Allocation& allocation)
+{
+	return AllocateImageRanked(image, required, preferred, MEMORY_USAGE_UNKNOWN, category, allocation);
+}
+
+bool DeviceMemoryAllocator::AllocateImage(VkImage image, MemoryUsage usage, MemoryCategory category, Allocation& allocation)
+{
+	VkMemoryPropertyFlags required, preferred;
+	UsageFlags(usage, required, preferred);
+	return AllocateImageRanked(image, required, preferred, usage, category, allocation);
+}
+
+bool DeviceMemoryAllocator::AllocateImageRanked(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage
+	, MemoryCategory category, Allocation& allocation)
+{
+	VkMemoryDedicatedRequirements dedicatedRequirements = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 requirements = { VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+	requirements.pNext = &dedicatedRequirements;
+	VkImageMemoryRequirementsInfo2 requirementsInfo = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2 };
+	requirementsInfo.image = image;
+	vkGetImageMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO };
+	dedicatedInfo.image = image;
+	bool dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+
+	// toutes les images du projet sont en tiling OPTIMAL
+	if (!AllocateRanked(requirements.memoryRequirements, required, preferred, usage, ALLOCATION_OPTIMAL, category, allocation, dedicated ? &dedicatedInfo : nullptr))
+		return false;
+	if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		std::cout << "error: failed to bind image memory!" << std::endl;
+		Free(allocation);
+		return false;
+	}
+	return true;
+}
+
+void DeviceMemoryAllocator::Free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Account(allocation, false);
+	uint32_t heap = memoryProperties.memoryTypes[allocation.memoryType].heapIndex;
+	if (allocation.block == UINT32_MAX)
+	{
+		if (allocation.mapped)
+			vkUnmapMemory(device, allocation.memory);
+		vkFreeMemory(device, allocation.memory, nullptr);
+		dedicatedBytes[heap] -= allocation.size;
+		dedicatedCount[heap]--;
+		deviceMemoryCount--;
+		allocation = {};
+		return;
+	}
+
+	Block& block = blocks[allocation.block];
+	block.tlsf.Free(allocation.node);
+
+	// un bloc vide est rendu au driver s'il en reste un autre du meme type (evite les allers-retours)
+	if (block.tlsf.IsEmpty())
+	{
+		bool another = false;
+		for (uint32_t b = 0; b < blocks.size() && !another; b++)
+			another = b != allocation.block && blocks[b].memory != VK_NULL_HANDLE && blocks[b].memoryType == block.memoryType && blocks[b].kind == block.kind;
+		if (another)
+		{
+			if (block.mapped)
+				vkUnmapMemory(device, block.memory);
+			vkFreeMemory(device, block.memory, nullptr);
+			block.memory = VK_NULL_HANDLE;
+			block.mapped = nullptr;
+			deviceMemoryCount--;
+		}
+	}
+
+	allocation = {};
+}
+
+void DeviceMemoryAllocator::Account(const Allocation& allocation, bool add)
+{
+	uint32_t heap = memoryProperties.memoryTypes[allocation.memoryType].heapIndex;
+	CategoryUsage& usage = categoryUsage[heap][allocation.category];
+	if (!add) {
+		usage.bytes -= allocation.size;
+		usage.count--;
+		return;
+	}
+
+	usage.bytes += allocation.size;
+	usage.count++;
+	if (usage.bytes > usage.peakBytes)
+		usage.peakBytes = usage.bytes;
+
+	if (!(memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+		return;
+	VkDeviceSize total = 0;
+	for (uint32_t h = 0; h < memoryProperties.memoryHeapCount; h++)
+		if (memoryProperties.memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+				total += categoryUsage[h][c].bytes;
+	// premier franchissement seulement, l'eviction se fait dans CheckBudget()
+	if (softBudget && total > softBudget && peakDeviceLocalBytes <= softBudget)
+		std::cout << "warning: device local memory over the soft budget (" << (total >> 20) << " / " << (softBudget >> 20) << " MB)" << std::endl;
+	if (total > peakDeviceLocalBytes)
+		peakDeviceLocalBytes = total;
+}
+
+bool DeviceMemoryAllocator::IsCoherent(const Allocation& allocation) const
+{
+	return (memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+bool DeviceMemoryAllocator::IsDeviceLocal(const Allocation& allocation) const
+{
+	return (memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+}
+
+VkMappedMemoryRange DeviceMemoryAllocator::MappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+	if (size == VK_WHOLE_SIZE)
+		size = allocation.size - offset;
+
+	// l'intervalle doit etre aligne sur nonCoherentAtomSize, sans depasser la fin du VkDeviceMemory
+	VkDeviceSize memorySize = allocation.block == UINT32_MAX ? allocation.size : blocks[allocation.block].size;
+	VkDeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+	VkDeviceSize end = (allocation.offset + offset + size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = begin;
+	range.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+	return range;
+}
+
+void DeviceMemoryAllocator::Flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (allocation.mapped == nullptr || IsCoherent(allocation))
+		return;
+	VkMappedMemoryRange range = MappedRange(allocation, offset, size);
+	vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+void DeviceMemoryAllocator::Invalidate(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (allocation.mapped == nullptr || IsCoherent(allocation))
+		return;
+	VkMappedMemoryRange range = MappedRange(allocation, offset, size);
+	vkInvalidateMappedMemoryRanges(device, 1, &range);
+}
+
+void DeviceMemoryAllocator::GetHeapStats(HeapStats stats[VK_MAX_MEMORY_HEAPS])
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (uint32_t heap = 0; heap < VK_MAX_MEMORY_HEAPS; heap++) {
+		stats[heap] = {};
+		stats[heap].dedicatedBytes = dedicatedBytes[heap];
+		stats[heap].dedicatedCount = dedicatedCount[heap];
+	}
+	for (const Block& block : blocks)
+	{
+		if (block.memory == VK_NULL_HANDLE)
+			continue;
+		HeapStats& heap = stats[memoryProperties.memoryTypes[block.memoryType].heapIndex];
+		heap.blockBytes += block.size;
+		heap.usedBytes += block.tlsf.usedSize;
+		heap.blockCount++;
+		heap.allocationCount += block.tlsf.allocationCount;
+		heap.freeRangeCount += block.tlsf.freeBlockCount;
+		VkDeviceSize largest = block.tlsf.LargestFreeBlock();
+		if (largest > heap.largestFreeRange)
+			heap.largestFreeRange = largest;
+	}
+}
+
+void DeviceMemoryAllocator::PrintStats()
+{
+	HeapStats stats[VK_MAX_MEMORY_HEAPS];
+	GetHeapStats(stats);
+
+	std::cout << "device memory: " << deviceMemoryCount << " VkDeviceMemory (max " << maxAllocationCount << ")" << std::endl;
+	for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+	{
+		const HeapStats& s = stats[heap];
+		if (s.blockCount == 0 && s.dedicatedCount == 0)
+			continue;
+		// fragmentation : part de l'espace libre inutilisable pour une allocation de la taille du plus grand trou
+		VkDeviceSize freeBytes = s.blockBytes - s.usedBytes;
+		float fragmentation = freeBytes > 0 ? 1.f - (float)s.largestFreeRange / (float)freeBytes : 0.f;
+		std::cout << "  heap " << heap << ((memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "")
+			<< ": " << (s.usedBytes >> 10) << " KB used in " << s.blockCount << " blocks of " << (s.blockBytes >> 10) << " KB ("
+			<< s.allocationCount << " allocations, " << s.freeRangeCount << " free ranges, fragmentation " << (int)(fragmentation * 100.f) << "%), "
+			<< (s.dedicatedBytes >> 10) << " KB in " << s.dedicatedCount << " dedicated" << std::endl;
+	}
+
+	HeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+	GetBudget(budgets);
+	std::lock_guard<std::mutex> lock(mutex);
+	for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+	{
+		if (budgets[heap].allocated == 0)
+			continue;
+		std::cout << "  heap " << heap << " budget" << (budgetExtension ? "" : " (no VK_EXT_memory_budget)") << ": "
+			<< (budgets[heap].usage >> 20) << " / " << (budgets[heap].budget >> 20) << " MB" << std::endl;
+		for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+		{
+			const CategoryUsage& usage = categoryUsage[heap][c];
+			if (usage.peakBytes == 0)
+				continue;
+			std::cout << "    " << MemoryCategoryName((MemoryCategory)c) << ": " << (usage.bytes >> 10) << " KB in " << usage.count
+				<< " allocations (peak " << (usage.peakBytes >> 10) << " KB)" << std::endl;
+		}
+	}
+	if (softBudget)
+		std::cout << "  soft budget: peak " << (peakDeviceLocalBytes >> 20) << " / " << (softBudget >> 20) << " MB device local, "
+			<< evictionCount << " evictions" << std::endl;
+}
+
+void DeviceMemoryAllocator::GetBudget(HeapBudget budgets[VK_MAX_MEMORY_HEAPS])
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+	if (budgetExtension) {
+		VkPhysicalDeviceMemoryProperties2 properties2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+		properties2.pNext = &budgetProperties;
+		vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties2);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (uint32_t heap = 0; heap < VK_MAX_MEMORY_HEAPS; heap++)
+		budgets[heap] = { 0, 0, dedicatedBytes[heap] };
+	for (const Block& block : blocks)
+		if (block.memory != VK_NULL_HANDLE)
+			budgets[memoryProperties.memoryTypes[block.memoryType].heapIndex].allocated += block.size;
+
+	for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+	{
+		HeapBudget& budget = budgets[heap];
+		if (budgetExtension) {
+			budget.usage = budgetProperties.heapUsage[heap];
+			budget.budget = budgetProperties.heapBudget[heap];
+		}
+		else {
+			// sans l'extension : nos allocations, et le heap entier comme budget (les autres process sont ignores)
+			budget.usage = budget.allocated;
+			budget.budget = memoryProperties.memoryHeaps[heap].size;
+		}
+	}
+}
+
+DeviceMemoryAllocator::CategoryUsage DeviceMemoryAllocator::GetCategoryUsage(uint32_t heap, MemoryCategory category)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return categoryUsage[heap][category];
+}
+
+VkDeviceSize DeviceMemoryAllocator::DeviceLocalBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	VkDeviceSize total = 0;
+	for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+		if (memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+				total += categoryUsage[heap][c].bytes;
+	return total;
+}
+
+VkDeviceSize DeviceMemoryAllocator::CheckBudget()
+{
+	// depassement : budget souple de l'application, ou budget du driver sur un heap DEVICE_LOCAL
+	VkDeviceSize excess = 0;
+	VkDeviceSize deviceLocal = DeviceLocalBytes();
+	if (softBudget && deviceLocal > softBudget)
+		excess = deviceLocal - softBudget;
+	if (budgetExtension)
+	{
+		HeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+		GetBudget(budgets);
+		for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+			if ((memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && budgets[heap].usage > budgets[heap].budget)
+				excess = std::max(excess, budgets[heap].usage - budgets[heap].budget);
+	}
+	if (excess == 0)
+		return 0;
+
+	// les callbacks liberent des ressources (Free() prend le mutex) : appeles hors du verrou
+	for (size_t i = 0; i < evictionCallbacks.size() && excess > 0; i++)
+	{
+		VkDeviceSize freed = evictionCallbacks[i](excess);
+		excess = freed >= excess ? 0 : excess - freed;
+	}
+	evictionCount++;
+	return excess;
+}
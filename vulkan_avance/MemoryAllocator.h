@@ -0,0 +1,197 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <functional>
+
+#include "Tlsf.h"
+
+// Sous-allocation de la memoire du device
+// Au lieu d'un vkAllocateMemory par ressource (appel lent, limite par maxMemoryAllocationCount, souvent 4096),
+// on alloue de gros blocs par memory type et on y decoupe les ressources avec un TlsfAllocator.
+// - buffers/images lineaires et images OPTIMAL ne partagent jamais un bloc : bufferImageGranularity est respecte
+//   sans avoir a examiner les voisins de chaque allocation
+// - les blocs HOST_VISIBLE sont mappes une fois pour toutes, Allocation::mapped pointe directement sur la ressource
+// - les ressources que le driver prefere isoler (VkMemoryDedicatedRequirements) et les tres grosses ressources
+//   ont leur propre VkDeviceMemory (allocation "dediee")
+// Thread-safe (un mutex), les creations de ressources peuvent venir de plusieurs threads
+//
+// Comptabilite : chaque allocation porte une categorie, l'usage courant et le pic sont suivis par heap et
+// par categorie. VK_EXT_memory_budget (si disponible) donne l'usage et le budget du heap pour tout le process
+// (et ce que les autres process laissent). Un budget "souple" (softBudget) borne la memoire DEVICE_LOCAL
+// de l'application : il n'est jamais refuse d'allocation, mais CheckBudget() (une fois par frame, quand le GPU
+// a rendu les ressources de la frame) appelle les callbacks d'eviction tant que le depassement n'est pas resorbe
+//
+// Choix du memory type : les types compatibles sont classes (RankMemoryTypes) d'apres les flags demandes,
+// l'intention d'usage (MemoryUsage), la place restante dans le budget du heap puis la taille du heap,
+// et essayes dans cet ordre. Les types PROTECTED, DEVICE_COHERENT_AMD et LAZILY_ALLOCATED ne sont jamais choisis
+// s'ils ne sont pas demandes. Create() detecte le "resizable BAR" (tout le heap video est visible du CPU)
+// et la memoire unifiee (GPU integre) : les donnees statiques y sont alors ecrites directement, sans staging
+
+enum AllocationKind
+{
+	ALLOCATION_LINEAR,		// buffers, images VK_IMAGE_TILING_LINEAR
+	ALLOCATION_OPTIMAL,		// images VK_IMAGE_TILING_OPTIMAL
+	ALLOCATION_KIND_COUNT
+};
+
+// intention d'usage d'une ressource, pour le classement des memory types
+enum MemoryUsage
+{
+	MEMORY_USAGE_UNKNOWN,		// seulement les flags required/preferred (dans l'ordre des memory types)
+	MEMORY_USAGE_GPU_ONLY,		// jamais accedee par le CPU (remplie par copie) : le plus grand heap DEVICE_LOCAL
+	MEMORY_USAGE_STATIC,		// ecrite une fois par le CPU puis lue par le GPU : DEVICE_LOCAL, mappee si l'ecriture directe
+								// est rentable (DirectUpload()), sinon non mappee et remplie par le staging
+	MEMORY_USAGE_UPLOAD,		// staging : ecrite sequentiellement par le CPU, lue une fois par une copie (RAM systeme)
+	MEMORY_USAGE_STREAM,		// reecrite par le CPU a chaque frame et lue directement par le GPU : DEVICE_LOCAL|HOST_VISIBLE (BAR) si possible
+	MEMORY_USAGE_READBACK,		// ecrite par le GPU, relue par le CPU : HOST_CACHED
+	MEMORY_USAGE_COUNT
+};
+
+const char* MemoryUsageName(MemoryUsage usage);
+
+enum MemoryCategory
+{
+	MEMORY_CATEGORY_OTHER,
+	MEMORY_CATEGORY_MESH,			// vertex/index buffers
+	MEMORY_CATEGORY_TEXTURE,
+	MEMORY_CATEGORY_RENDER_TARGET,	// attachments, slots du render graph
+	MEMORY_CATEGORY_STAGING,		// transferts cpu<->gpu (upload, relecture)
+	MEMORY_CATEGORY_SIMULATION,		// SSBOs des boids
+	MEMORY_CATEGORY_CONSTANTS,		// UBOs, constantes par frame
+	MEMORY_CATEGORY_COUNT
+};
+
+const char* MemoryCategoryName(MemoryCategory category);
+
+struct Allocation
+{
+	VkDeviceMemory memory;
+	VkDeviceSize offset;	// offset de la ressource dans memory (a passer a vkBind*Memory)
+	VkDeviceSize size;
+	void* mapped;			// nullptr si la memoire n'est pas HOST_VISIBLE
+	uint32_t memoryType;
+	uint32_t block;			// index du bloc, UINT32_MAX = allocation dediee
+	uint32_t node;			// handle TLSF dans le bloc
+	MemoryCategory category;
+};
+
+struct DeviceMemoryAllocator
+{
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+
+	struct Block
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		void* mapped;
+		uint32_t memoryType;
+		AllocationKind kind;
+		TlsfAllocator tlsf;
+	};
+
+	struct CategoryUsage
+	{
+		VkDeviceSize bytes;
+		VkDeviceSize peakBytes;
+		uint32_t count;
+	};
+
+	struct HeapBudget
+	{
+		VkDeviceSize usage;			// usage du heap par le process (VK_EXT_memory_budget), sinon nos allocations
+		VkDeviceSize budget;		// memoire utilisable par le process (VK_EXT_memory_budget), sinon la taille du heap
+		VkDeviceSize allocated;		// nos VkDeviceMemory (blocs + dedies)
+	};
+
+	// appele avec le depassement en octets, retourne le nombre d'octets liberes
+	typedef std::function<VkDeviceSize(VkDeviceSize excess)> EvictionCallback;
+
+	struct HeapStats
+	{
+		VkDeviceSize blockBytes;		// memoire des blocs (vkAllocateMemory)
+		VkDeviceSize usedBytes;			// sous-allocations vivantes dans les blocs
+		VkDeviceSize dedicatedBytes;	// allocations dediees
+		uint32_t blockCount;
+		uint32_t dedicatedCount;
+		uint32_t allocationCount;		// sous-allocations
+		uint32_t freeRangeCount;		// blocs libres TLSF (fragmentation)
+		VkDeviceSize largestFreeRange;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	bool budgetExtension = false;		// VK_EXT_memory_budget active
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	uint32_t maxAllocationCount = 4096;
+	uint32_t deviceLocalHeap = 0;		// le plus grand heap DEVICE_LOCAL (memoire video)
+	VkDeviceSize barSize = 0;			// plus grand heap d'un type DEVICE_LOCAL|HOST_VISIBLE, 0 = aucun
+	bool resizableBar = false;			// la memoire video est visible du CPU en (quasi) totalite
+	bool unifiedMemory = false;			// GPU integre : tous les heaps sont DEVICE_LOCAL
+
+	std::vector<Block> blocks;			// memory == VK_NULL_HANDLE : emplacement libre
+	uint32_t deviceMemoryCount = 0;		// nombre de VkDeviceMemory vivants (blocs + dedies)
+	VkDeviceSize dedicatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+	uint32_t dedicatedCount[VK_MAX_MEMORY_HEAPS] = {};
+	std::mutex mutex;
+
+	CategoryUsage categoryUsage[VK_MAX_MEMORY_HEAPS][MEMORY_CATEGORY_COUNT] = {};
+	VkDeviceSize peakDeviceLocalBytes = 0;
+	VkDeviceSize softBudget = 0;		// octets DEVICE_LOCAL (toutes categories), 0 = pas de budget
+	std::vector<EvictionCallback> evictionCallbacks;
+	uint32_t evictionCount = 0;
+
+	bool Create(struct VulkanDeviceContext& context);
+	void Destroy();
+
+	// required : flags obligatoires, preferred : flags souhaites (premier memory type les ayant tous, sinon required seul)
+	bool Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred
+		, AllocationKind kind, MemoryCategory category, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated = nullptr);
+	// interroge les besoins (dont dedicated) de la ressource, alloue et binde
+	bool AllocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryCategory category, Allocation& allocation);
+	bool AllocateImage(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryCategory category, Allocation& allocation);
+	// memes fonctions, le memory type est choisi d'apres l'intention d'usage
+	bool Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, AllocationKind kind, MemoryCategory category, Allocation& allocation
+		, const VkMemoryDedicatedAllocateInfo* dedicated = nullptr);
+	bool AllocateBuffer(VkBuffer buffer, MemoryUsage usage, MemoryCategory category, Allocation& allocation);
+	bool AllocateImage(VkImage image, MemoryUsage usage, MemoryCategory category, Allocation& allocation);
+	// sans effet sur une Allocation vide (memory == VK_NULL_HANDLE), remise a zero ensuite
+	void Free(Allocation& allocation);
+
+	// sans effet si la memoire est HOST_COHERENT, bornes alignees sur nonCoherentAtomSize
+	void Flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+	void Invalidate(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	bool IsCoherent(const Allocation& allocation) const;
+	bool IsDeviceLocal(const Allocation& allocation) const;
+	// les donnees statiques peuvent etre ecrites directement en memoire video (pas de copie depuis le staging)
+	bool DirectUpload() const { return resizableBar || unifiedMemory; }
+	// memory types compatibles, du meilleur au moins bon, retourne leur nombre
+	uint32_t RankMemoryTypes(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage
+		, VkDeviceSize size, uint32_t types[VK_MAX_MEMORY_TYPES]);
+	void GetHeapStats(HeapStats stats[VK_MAX_MEMORY_HEAPS]);
+	void GetBudget(HeapBudget budgets[VK_MAX_MEMORY_HEAPS]);
+	CategoryUsage GetCategoryUsage(uint32_t heap, MemoryCategory category);
+	// octets DEVICE_LOCAL alloues par l'application, toutes categories
+	VkDeviceSize DeviceLocalBytes();
+	void PrintStats();
+
+	void SetSoftBudget(VkDeviceSize bytes) { softBudget = bytes; }
+	void AddEvictionCallback(const EvictionCallback& callback) { evictionCallbacks.push_back(callback); }
+	// depassement du budget souple ou du budget du driver : appelle les callbacks d'eviction
+	// a appeler depuis la boucle de rendu, hors de tout Allocate/Free, retourne le depassement restant
+	VkDeviceSize CheckBudget();
+
+private:
+	static void UsageFlags(MemoryUsage usage, VkMemoryPropertyFlags& required, VkMemoryPropertyFlags& preferred);
+	bool AllocateRanked(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage
+		, AllocationKind kind, MemoryCategory category, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated);
+	bool AllocateBufferRanked(VkBuffer buffer, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage, MemoryCategory category, Allocation& allocation);
+	bool AllocateImageRanked(VkImage image, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryUsage usage, MemoryCategory category, Allocation& allocation);
+	bool AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, Allocation& allocation, const VkMemoryDedicatedAllocateInfo* dedicated);
+	bool AllocateFromBlocks(const VkMemoryRequirements& requirements, uint32_t memoryType, AllocationKind kind, Allocation& allocation);
+	VkDeviceSize BlockSize(uint32_t memoryType) const;
+	void Account(const Allocation& allocation, bool add);
+	VkMappedMemoryRange MappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+};
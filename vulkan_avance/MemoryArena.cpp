@@ -0,0 +1,281 @@
+#include "MemoryArena.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+// entete d'un chunk arrondi a une ligne de cache, les donnees commencent juste apres
+static constexpr size_t CHUNK_HEADER = 64;
+
+static uint8_t* ChunkData(MemoryArena::Chunk* chunk) { return (uint8_t*)chunk + CHUNK_HEADER; }
+
+#if defined(MEMORY_TRACK_HEAP_ALLOCATIONS)
+static std::atomic<uint64_t> heapAllocations{ 0 };
+static void CountHeapAllocation() { heapAllocations.fetch_add(1, std::memory_order_relaxed); }
+
+// remplacement des operator new/delete globaux (les versions nothrow et alignees par defaut s'appuient dessus ou restent celles du runtime)
+void* operator new(size_t size)
+{
+	CountHeapAllocation();
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+uint64_t HeapAllocationCount() { return heapAllocations.load(std::memory_order_relaxed); }
+#else
+static void CountHeapAllocation() {}
+uint64_t HeapAllocationCount() { return 0; }
+#endif
+
+void MemoryArena::Create(size_t initialSize, const char* arenaName)
+{
+	name = arenaName;
+	chunkSize = initialSize > 0 ? initialSize : 64 * 1024;
+	if (initialSize > 0)
+		first = current = NewChunk(initialSize);
+}
+
+void MemoryArena::Destroy()
+{
+	Chunk* chunk = first;
+	while (chunk) {
+		Chunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	first = current = nullptr;
+	reservedBytes = 0;
+	usedBytes = 0;
+	allocationCount = 0;
+}
+
+MemoryArena::Chunk* MemoryArena::NewChunk(size_t minSize)
+{
+	size_t capacity = minSize > chunkSize ? minSize : chunkSize;
+	Chunk* chunk = (Chunk*)malloc(CHUNK_HEADER + capacity);
+	if (chunk == nullptr) {
+		std::cout << "error: arena " << name << " out of memory (" << capacity << " bytes)" << std::endl;
+		return nullptr;
+	}
+	CountHeapAllocation();
+	chunk->next = nullptr;
+	chunk->capacity = capacity;
+	chunk->used = 0;
+	reservedBytes += capacity;
+	chunkAllocations++;
+	return chunk;
+}
+
+void* MemoryArena::Allocate(size_t size, size_t alignment)
+{
+	for (;;)
+	{
+		if (current)
+		{
+			uintptr_t base = (uintptr_t)ChunkData(current);
+			uintptr_t start = (base + current->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			if (start + size <= base + current->capacity) {
+				usedBytes += start + size - (base + current->used);
+				current->used = start + size - base;
+				allocationCount++;
+				if (usedBytes > peakBytes)
+					peakBytes = usedBytes;
+				return (void*)start;
+			}
+			// chunk suivant deja reserve (apres un Rewind ou un Reset) s'il est assez grand
+			if (current->next && current->next->capacity >= size + alignment) {
+				current = current->next;
+				current->used = 0;
+				continue;
+			}
+		}
+
+		Chunk* chunk = NewChunk(size + alignment);
+		if (chunk == nullptr)
+			return nullptr;
+		if (current) {
+			chunk->next = current->next;
+			current->next = chunk;
+		}
+		else {
+			chunk->next = first;
+			first = chunk;
+		}
+		current = chunk;
+	}
+}
+
+void MemoryArena::Free(void* ptr, size_t size)
+{
+	if (ptr == nullptr || current == nullptr)
+		return;
+	uint8_t* end = ChunkData(current) + current->used;
+	if ((uint8_t*)ptr + size == end) {
+		current->used -= size;
+		usedBytes -= size;
+		allocationCount--;
+	}
+}
+
+bool MemoryArena::TryGrow(void* ptr, size_t oldSize, size_t newSize)
+{
+	if (current == nullptr)
+		return false;
+	uint8_t* data = ChunkData(current);
+	if ((uint8_t*)ptr + oldSize != data + current->used || (uint8_t*)ptr + newSize > data + current->capacity)
+		return false;
+	current->used = (uint8_t*)ptr + newSize - data;
+	usedBytes = usedBytes + newSize - oldSize;
+	if (usedBytes > peakBytes)
+		peakBytes = usedBytes;
+	return true;
+}
+
+void MemoryArena::Rewind(const Marker& marker)
+{
+	current = marker.chunk ? marker.chunk : first;
+	if (current)
+		current->used = marker.chunk ? marker.used : 0;
+	usedBytes = marker.usedBytes;
+	allocationCount = marker.allocationCount;
+}
+
+void MemoryArena::Reset()
+{
+	if (first == nullptr)
+		return;
+
+	// le cycle a deborde sur plusieurs chunks : un seul chunk de la taille totale pour les cycles suivants
+	if (current != first) {
+		size_t total = reservedBytes;
+		Destroy();
+		first = current = NewChunk(total);
+	}
+	current = first;
+	if (current)
+		current->used = 0;
+	usedBytes = 0;
+	allocationCount = 0;
+}
+
+void MemoryArena::Trim(size_t keepBytes)
+{
+	if (current == nullptr)
+		return;
+	while (current->next && reservedBytes > keepBytes) {
+		Chunk* next = current->next;
+		current->next = next->next;
+		reservedBytes -= next->capacity;
+		free(next);
+	}
+}
+
+void MemoryArena::PrintStats() const
+{
+	std::cout << "arena " << name << ": " << (usedBytes >> 10) << " KB in " << allocationCount << " allocations (peak " << (peakBytes >> 10)
+		<< " KB), " << (reservedBytes >> 10) << " KB reserved in " << chunkAllocations << " system allocations" << std::endl;
+}
+
+// ---
+
+// arena de chaque thread, detruite avec lui
+struct ThreadArenaHolder
+{
+	static constexpr size_t CHUNK_SIZE = 1 << 20;
+	// au dela, les chunks sont rendus a la fin du dernier ArenaScope (une grosse image decodee ne reste pas reservee)
+	static constexpr size_t RETAIN_BYTES = 64ull << 20;
+
+	MemoryArena arena;
+
+	ThreadArenaHolder()
+	{
+		arena.Create(CHUNK_SIZE, "thread");
+		arena.retainBytes = RETAIN_BYTES;
+	}
+	~ThreadArenaHolder() { arena.Destroy(); }
+};
+
+static thread_local MemoryArena* threadArena = nullptr;
+
+MemoryArena& ThreadArena()
+{
+	thread_local ThreadArenaHolder holder;
+	threadArena = &holder.arena;
+	return holder.arena;
+}
+
+// ---
+
+// entete des allocations stb : arena d'origine (nullptr = tas) et taille demandee, pour ArenaRealloc
+struct alignas(16) ArenaHeader
+{
+	MemoryArena* arena;
+	size_t size;
+};
+
+void* ArenaMalloc(size_t size)
+{
+	MemoryArena* arena = (threadArena && threadArena->scopeDepth > 0) ? threadArena : nullptr;
+	ArenaHeader* header;
+	if (arena) {
+		header = (ArenaHeader*)arena->Allocate(sizeof(ArenaHeader) + size, alignof(ArenaHeader));
+	}
+	else {
+		header = (ArenaHeader*)malloc(sizeof(ArenaHeader) + size);
+		CountHeapAllocation();
+	}
+	if (header == nullptr)
+		return nullptr;
+	header->arena = arena;
+	header->size = size;
+	return header + 1;
+}
+
+void* ArenaRealloc(void* ptr, size_t newSize)
+{
+	if (ptr == nullptr)
+		return ArenaMalloc(newSize);
+
+	ArenaHeader* header = (ArenaHeader*)ptr - 1;
+	MemoryArena* arena = header->arena;
+	if (arena == nullptr) {
+		header = (ArenaHeader*)realloc(header, sizeof(ArenaHeader) + newSize);
+		CountHeapAllocation();
+		if (header == nullptr)
+			return nullptr;
+		header->size = newSize;
+		return header + 1;
+	}
+
+	// cas typique du decodeur zlib : le buffer de sortie est la derniere allocation, il grandit sur place
+	if (arena->TryGrow(ptr, header->size, newSize)) {
+		header->size = newSize;
+		return ptr;
+	}
+	ArenaHeader* newHeader = (ArenaHeader*)arena->Allocate(sizeof(ArenaHeader) + newSize, alignof(ArenaHeader));
+	if (newHeader == nullptr)
+		return nullptr;
+	newHeader->arena = arena;
+	newHeader->size = newSize;
+	memcpy(newHeader + 1, ptr, header->size < newSize ? header->size : newSize);
+	return newHeader + 1;
+}
+
+void ArenaFree(void* ptr)
+{
+	if (ptr == nullptr)
+		return;
+	ArenaHeader* header = (ArenaHeader*)ptr - 1;
+	if (header->arena)
+		header->arena->Free(header, sizeof(ArenaHeader) + header->size);
+	else
+		free(header);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// compte les appels a operator new / malloc de stb (HeapAllocationCount()), pour verifier qu'une frame
+// en regime permanent n'alloue rien sur le tas. Le cout est un increment atomique par allocation
+#define MEMORY_TRACK_HEAP_ALLOCATIONS
+
+// Arena ("bump allocator") pour les temporaires CPU
+// La memoire est decoupee lineairement dans de gros chunks obtenus du systeme, rien n'est libere individuellement :
+// tout est rendu d'un coup par Reset() (arena de frame) ou par la fin d'un ArenaScope (chargements).
+// Les chunks sont conserves d'un cycle a l'autre : si un cycle a deborde sur plusieurs chunks, Reset() les remplace
+// par un seul chunk assez grand, les cycles suivants ne touchent plus au tas.
+// Pas thread-safe : une arena par thread (ThreadArena()) ou par usage (frameArena du thread principal)
+struct MemoryArena
+{
+	struct Chunk
+	{
+		Chunk* next;
+		size_t capacity;
+		size_t used;
+	};
+
+	// etat de l'arena a un instant donne, Rewind() libere tout ce qui a ete alloue depuis
+	struct Marker
+	{
+		Chunk* chunk;
+		size_t used;
+		size_t usedBytes;
+		uint32_t allocationCount;
+	};
+
+	Chunk* first = nullptr;
+	Chunk* current = nullptr;		// les chunks suivants sont deja reserves mais inutilises
+	size_t chunkSize = 0;			// taille minimale d'un nouveau chunk
+	size_t retainBytes = 0;			// fin du dernier ArenaScope : les chunks inutilises au dela sont rendus (0 = on garde tout)
+	uint32_t scopeDepth = 0;
+	const char* name = "";
+
+	// statistiques, depuis le dernier Reset()
+	size_t usedBytes = 0;			// padding d'alignement compris
+	size_t peakBytes = 0;
+	uint32_t allocationCount = 0;
+	// depuis Create()
+	size_t reservedBytes = 0;
+	uint32_t chunkAllocations = 0;	// allocations systeme
+
+	// initialSize > 0 : le premier chunk est reserve tout de suite
+	void Create(size_t initialSize, const char* arenaName = "");
+	void Destroy();
+
+	// alignment : puissance de 2
+	void* Allocate(size_t size, size_t alignment = 16);
+	// rend la memoire si ptr est la derniere allocation, sinon sans effet
+	void Free(void* ptr, size_t size);
+	// agrandit la derniere allocation sur place, false si ptr n'est pas la derniere allocation ou si le chunk est plein
+	bool TryGrow(void* ptr, size_t oldSize, size_t newSize);
+
+	template<typename T>
+	T* Push(size_t count = 1) { return (T*)Allocate(sizeof(T) * count, alignof(T)); }
+
+	Marker GetMarker() const { return { current, current ? current->used : 0, usedBytes, allocationCount }; }
+	void Rewind(const Marker& marker);
+	// libere toutes les allocations (fusionne les chunks si le cycle a deborde)
+	void Reset();
+	// rend au systeme les chunks inutilises tant que plus de keepBytes sont reserves
+	void Trim(size_t keepBytes);
+
+	void PrintStats() const;
+
+private:
+	Chunk* NewChunk(size_t minSize);
+};
+
+// portee d'allocation temporaire : tout ce qui a ete alloue dans l'arena pendant la portee est rendu a sa fin
+struct ArenaScope
+{
+	MemoryArena& arena;
+	MemoryArena::Marker marker;
+
+	explicit ArenaScope(MemoryArena& scopeArena) : arena(scopeArena), marker(scopeArena.GetMarker()) { arena.scopeDepth++; }
+	~ArenaScope()
+	{
+		arena.Rewind(marker);
+		if (--arena.scopeDepth == 0 && arena.retainBytes)
+			arena.Trim(arena.retainBytes);
+	}
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+// arena du thread appelant (taches de chargement), creee au premier appel et detruite avec le thread
+MemoryArena& ThreadArena();
+
+// adaptateur pour les conteneurs standard : deallocate() ne rend la memoire que pour la derniere allocation,
+// le reste est libere avec l'arena (reserve() evite les copies successives d'un vector qui grandit)
+template<typename T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+
+	MemoryArena* arena;
+
+	ArenaAllocator(MemoryArena& allocatorArena) : arena(&allocatorArena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t count) { return (T*)arena->Allocate(count * sizeof(T), alignof(T)); }
+	void deallocate(T* ptr, size_t count) { arena->Free(ptr, count * sizeof(T)); }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// nombre d'allocations sur le tas depuis le lancement (0 sans MEMORY_TRACK_HEAP_ALLOCATIONS)
+uint64_t HeapAllocationCount();
+
+// allocations de stb_image (STBI_MALLOC/STBI_REALLOC/STBI_FREE) : dans l'arena du thread si un ArenaScope
+// y est ouvert, sur le tas sinon (une image peut alors survivre a la portee courante)
+void* ArenaMalloc(size_t size);
+void* ArenaRealloc(void* ptr, size_t newSize);
+void ArenaFree(void* ptr);
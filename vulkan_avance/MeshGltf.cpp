@@ -57,8 +57,8 @@ struct GLTFBuffer {
 	uint32_t length;
 };
 
-template<typename T>
-static void ParseGLTFAttribute(const simdjson::dom::element& gltf, const std::vector<GLTFBuffer>& buffers, int32_t id, std::vector<T>& data)
+template<typename Container>
+static void ParseGLTFAttribute(const simdjson::dom::element& gltf, const ArenaVector<GLTFBuffer>& buffers, int32_t id, Container& data)
 {
 	const auto& view = gltf["bufferViews"].at(id);
 	const auto& accessor = gltf["accessors"].at(id);
@@ -82,7 +82,7 @@ static void ParseGLTFAttribute(const simdjson::dom::element& gltf, const std::ve
 	}
 }
 
-static uint32_t ParseGLTFTexture(const std::string& relativePath, simdjson::dom::element gltf, simdjson::dom::element element, bool sRGB = true, uint32_t default_id = 1)
+static uint32_t ParseGLTFTexture(const std::string& relativePath, simdjson::dom::element gltf, simdjson::dom::element element, bool sRGB = true, uint32_t default_id = 1, bool normalMap = false)
 {
 	uint32_t id = default_id;
 	if (element.is_object()) {
@@ -90,7 +90,10 @@ static uint32_t ParseGLTFTexture(const std::string& relativePath, simdjson::dom:
 		int64_t imageId = gltf["textures"].at(textureId)["source"];
 		std::string_view uri = gltf["images"].at(imageId)["uri"];
 		std::string imagePath = relativePath + uri.begin();
-		id = Texture::LoadTexture(imagePath.c_str(), sRGB);
+		// decodage asynchrone, le handle est utilisable dans le materiau tout de suite
+		TextureHandle handle = Texture::RequestTexture(imagePath.c_str(), sRGB, normalMap);
+		if (handle != INVALID_TEXTURE_HANDLE)
+			id = handle;
 	}
 	return id;
 }
@@ -106,6 +109,10 @@ bool Mesh::ParseGLTF(std::vector<Vertex>& vertices, std::vector<uint32_t>& indic
 	simdjson::dom::parser parser;
 	simdjson::dom::element gltf = parser.load(relativeGLFTPath);
 
+	// buffers binaires et attributs bruts : temporaires, rendus d'un bloc en sortie (y compris sur erreur)
+	MemoryArena& arena = ThreadArena();
+	ArenaScope arenaScope(arena);
+
 	if (gltf.is_null())
 		return false;
 
@@ -148,14 +155,15 @@ bool Mesh::ParseGLTF(std::vector<Vertex>& vertices, std::vector<uint32_t>& indic
 			}
 		}
 
-		std::vector<GLTFBuffer> buffers;
+		ArenaVector<GLTFBuffer> buffers(arena);
+		buffers.reserve(gltf["buffers"].get_array().size());
 
 		for (const auto &buffer : gltf["buffers"]) 
 		{
 			GLTFBuffer geometryBuffer;
 			size_t byteLength = buffer["byteLength"];
 			std::string_view uri = buffer["uri"];
-			geometryBuffer.data = new uint8_t[byteLength];
+			geometryBuffer.data = arena.Push<uint8_t>(byteLength);
 			std::string_view sub = uri.substr(uri.size() - 4, std::string_view::npos);
 			if (uri.substr(uri.size() - 4, std::string_view::npos) != ".bin") {
 				// todo
@@ -164,6 +172,10 @@ bool Mesh::ParseGLTF(std::vector<Vertex>& vertices, std::vector<uint32_t>& indic
 			else {
 				std::string binPath = relativePath + uri.begin();
 				FILE* bindata = fopen(binPath.c_str(), "rb");
+				if (bindata == nullptr) {
+					std::cout << "error: failed to open " << binPath << std::endl;
+					return false;
+				}
 				fread(geometryBuffer.data, byteLength, 1, bindata);
 				fclose(bindata);
 			}
@@ -176,22 +188,24 @@ bool Mesh::ParseGLTF(std::vector<Vertex>& vertices, std::vector<uint32_t>& indic
 
 		struct GltfSubMesh 
 		{
-			std::vector<float> positions;
-			std::vector<float> normals;
-			std::vector<float> uvs;
-			std::vector<float> tangents;
-			std::vector<uint16_t> indices16;
+			ArenaVector<float> positions;
+			ArenaVector<float> normals;
+			ArenaVector<float> uvs;
+			ArenaVector<float> tangents;
+			ArenaVector<uint16_t> indices16;
 			uint32_t materialId;
+
+			GltfSubMesh(MemoryArena& arena) : positions(arena), normals(arena), uvs(arena), tangents(arena), indices16(arena), materialId(0) {}
 		};
 
-		std::vector<GltfSubMesh> submeshes;
+		ArenaVector<GltfSubMesh> submeshes(arena);
 
 		const auto &mesh = gltf["meshes"].at(nodeMeshId);
 		{
 			for (const auto primitive : mesh["primitives"])
 			{
 				//print_json(primitive);
-				GltfSubMesh gltfSubMesh;
+				GltfSubMesh gltfSubMesh(arena);
 
 				if (primitive["indices"].is_int64()) {
 					int64_t indicesId = primitive["indices"];
@@ -306,7 +320,7 @@ bool Mesh::ParseGLTF(std::vector<Vertex>& vertices, std::vector<uint32_t>& indic
 					}
 				}
 
-				material.normalTexture = ParseGLTFTexture(relativePath, gltf, mat["normalTexture"], false, Material::defaultMaterial.normalTexture);
+				material.normalTexture = ParseGLTFTexture(relativePath, gltf, mat["normalTexture"], false, Material::defaultMaterial.normalTexture, true);
 				material.ambientTexture = ParseGLTFTexture(relativePath, gltf, mat["occlusionTexture"], false, Material::defaultMaterial.ambientTexture);
 				material.emissiveTexture = ParseGLTFTexture(relativePath, gltf, mat["emissiveTexture"], true, Material::defaultMaterial.emissiveTexture);
 
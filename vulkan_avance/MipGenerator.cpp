@@ -0,0 +1,335 @@
+#include "MipGenerator.h"
+#include "MemoryArena.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_USE_SSE 1
+#else
+#define MIP_USE_SSE 0
+#endif
+
+// texel RGBA en flottants : un registre SSE, les 4 canaux sont filtres ensemble
+#if MIP_USE_SSE
+typedef __m128 Float4;
+static inline Float4 Zero4() { return _mm_setzero_ps(); }
+static inline Float4 Load4(const float* p) { return _mm_loadu_ps(p); }
+static inline void Store4(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+static inline Float4 MulAdd4(Float4 acc, Float4 v, float w) { return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(w))); }
+static inline Float4 Clamp4(Float4 v, float lo, float hi) { return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(lo)), _mm_set1_ps(hi)); }
+// v dans [0,1] -> 4 octets (arrondi au plus proche)
+static inline void StoreUnorm8(uint8_t* out, Float4 v)
+{
+	__m128i i = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.f)));
+	i = _mm_packs_epi32(i, i);
+	i = _mm_packus_epi16(i, i);
+	uint32_t packed = (uint32_t)_mm_cvtsi128_si32(i);
+	memcpy(out, &packed, 4);
+}
+#else
+struct Float4 { float v[4]; };
+static inline Float4 Zero4() { return { { 0.f, 0.f, 0.f, 0.f } }; }
+static inline Float4 Load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+static inline void Store4(float* p, Float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline Float4 MulAdd4(Float4 acc, Float4 v, float w)
+{
+	for (int c = 0; c < 4; c++)
+		acc.v[c] += v.v[c] * w;
+	return acc;
+}
+static inline Float4 Clamp4(Float4 v, float lo, float hi)
+{
+	for (int c = 0; c < 4; c++)
+		v.v[c] = std::min(hi, std::max(lo, v.v[c]));
+	return v;
+}
+static inline void StoreUnorm8(uint8_t* out, Float4 v)
+{
+	for (int c = 0; c < 4; c++)
+		out[c] = (uint8_t)(v.v[c] * 255.f + 0.5f);
+}
+#endif
+
+// ---
+
+// conversions sRGB <-> lineaire par tables (la table inverse est assez fine pour rester sous le demi pas de quantification)
+struct SrgbTables
+{
+	static constexpr uint32_t LINEAR_STEPS = 4096;
+
+	float toLinear[256];
+	uint8_t fromLinear[LINEAR_STEPS];
+
+	SrgbTables()
+	{
+		for (uint32_t i = 0; i < 256; i++) {
+			float c = i / 255.f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (uint32_t i = 0; i < LINEAR_STEPS; i++) {
+			float c = i / (float)(LINEAR_STEPS - 1);
+			float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+			fromLinear[i] = (uint8_t)(srgb * 255.f + 0.5f);
+		}
+	}
+};
+
+static const SrgbTables& Tables()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+// ---
+
+// poids d'un axe : taps poids par texel destination a partir du texel source first (borne a l'acces)
+struct Filter1D
+{
+	uint32_t taps;
+	int32_t* first;
+	float* weights;
+};
+
+static constexpr float KAISER_RADIUS = 3.f;		// en texels destination
+static constexpr float KAISER_ALPHA = 4.f;
+static constexpr float PI = 3.14159265f;
+
+static float BesselI0(float x)
+{
+	float sum = 1.f, term = 1.f;
+	for (int k = 1; k < 16; k++) {
+		float t = x / (2.f * k);
+		term *= t * t;
+		sum += term;
+	}
+	return sum;
+}
+
+// t : distance en texels destination
+static float Kaiser(float t)
+{
+	if (fabsf(t) >= KAISER_RADIUS)
+		return 0.f;
+	float sinc = t == 0.f ? 1.f : sinf(PI * t) / (PI * t);
+	float r = t / KAISER_RADIUS;
+	return sinc * BesselI0(KAISER_ALPHA * sqrtf(1.f - r * r)) / BesselI0(KAISER_ALPHA);
+}
+
+static Filter1D BuildFilter(MemoryArena& arena, uint32_t srcSize, uint32_t dstSize, MipFilter filter)
+{
+	// une dimension deja a 1 ne bouge plus (scale = 1 : le filtre est l'identite)
+	const float scale = (float)srcSize / dstSize;
+	const float support = (filter == MIP_FILTER_BOX ? 0.5f : KAISER_RADIUS) * scale;	// demi-largeur en texels source
+
+	Filter1D result;
+	result.taps = (uint32_t)ceilf(support * 2.f) + 1;
+	result.first = arena.Push<int32_t>(dstSize);
+	result.weights = arena.Push<float>((size_t)dstSize * result.taps);
+	for (uint32_t x = 0; x < dstSize; x++)
+	{
+		const float center = (x + 0.5f) * scale;
+		const int32_t first = (int32_t)floorf(center - support);
+		float* weights = result.weights + (size_t)x * result.taps;
+		float sum = 0.f;
+		for (uint32_t k = 0; k < result.taps; k++)
+		{
+			const float texel = (float)(first + (int32_t)k);
+			float weight;
+			if (filter == MIP_FILTER_BOX)
+				// couverture du texel source par l'empreinte [center - support, center + support]
+				weight = std::max(0.f, std::min(texel + 1.f, center + support) - std::max(texel, center - support));
+			else
+				weight = Kaiser((texel + 0.5f - center) / scale);
+			weights[k] = weight;
+			sum += weight;
+		}
+		for (uint32_t k = 0; k < result.taps; k++)
+			weights[k] /= sum;
+		result.first[x] = first;
+	}
+	return result;
+}
+
+// ---
+
+// ligne y du niveau 0 en flottants (lineaire, normales dans [-1,1])
+static const float* ConvertRow(const void* src, uint32_t width, uint32_t y, MipSource source, float* row)
+{
+	if (source == MIP_SOURCE_FLOAT32)
+		return (const float*)src + (size_t)y * width * 4;
+
+	const uint8_t* texels = (const uint8_t*)src + (size_t)y * width * 4;
+	const float* toLinear = Tables().toLinear;
+	for (uint32_t x = 0; x < width * 4; x += 4)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			const uint8_t value = texels[x + c];
+			switch (source)
+			{
+			case MIP_SOURCE_SRGB8: row[x + c] = toLinear[value]; break;
+			case MIP_SOURCE_NORMAL8: row[x + c] = value * (2.f / 255.f) - 1.f; break;
+			default: row[x + c] = value * (1.f / 255.f); break;
+			}
+		}
+		row[x + 3] = texels[x + 3] * (1.f / 255.f);
+	}
+	return row;
+}
+
+// borne (ou renormalise) le texel filtre, qui sert aussi de source au niveau suivant
+static Float4 Resolve(Float4 texel, MipSource source)
+{
+	switch (source)
+	{
+	case MIP_SOURCE_FLOAT32:
+		return Clamp4(texel, 0.f, FLT_MAX);
+	case MIP_SOURCE_NORMAL8: {
+		float v[4];
+		Store4(v, texel);
+		float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length < 1e-6f) {
+			v[0] = 0.f; v[1] = 0.f; v[2] = 1.f;
+		}
+		else {
+			v[0] /= length; v[1] /= length; v[2] /= length;
+		}
+		v[3] = std::min(1.f, std::max(0.f, v[3]));
+		return Load4(v);
+	}
+	default:
+		return Clamp4(texel, 0.f, 1.f);
+	}
+}
+
+static void WriteTexel(uint8_t* out, Float4 texel, MipSource source)
+{
+	switch (source)
+	{
+	case MIP_SOURCE_FLOAT32:
+		Store4((float*)out, texel);
+		break;
+	case MIP_SOURCE_NORMAL8: {
+		// xyz [-1,1] -> [0,1], alpha inchange
+		static const float bias[4] = { 0.5f, 0.5f, 0.5f, 0.f };
+		static const float scale[4] = { 0.5f, 0.5f, 0.5f, 1.f };
+		float v[4];
+		Store4(v, texel);
+		for (int c = 0; c < 4; c++)
+			v[c] = v[c] * scale[c] + bias[c];
+		StoreUnorm8(out, Load4(v));
+		break;
+	}
+	case MIP_SOURCE_SRGB8: {
+		float v[4];
+		Store4(v, texel);
+		const uint8_t* fromLinear = Tables().fromLinear;
+		for (int c = 0; c < 3; c++)
+			out[c] = fromLinear[(uint32_t)(v[c] * (SrgbTables::LINEAR_STEPS - 1) + 0.5f)];
+		out[3] = (uint8_t)(v[3] * 255.f + 0.5f);
+		break;
+	}
+	default:
+		StoreUnorm8(out, texel);
+		break;
+	}
+}
+
+// ---
+
+uint32_t MipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+		levels++;
+	return levels;
+}
+
+size_t MipChainSize(uint32_t width, uint32_t height, uint32_t levelCount, uint32_t texelBytes)
+{
+	size_t size = 0;
+	for (uint32_t level = 0; level < levelCount; level++)
+		size += (size_t)std::max(1u, width >> level) * std::max(1u, height >> level) * texelBytes;
+	return size;
+}
+
+void GenerateMipChain(const void* src, uint32_t width, uint32_t height, MipSource source, MipFilter filter, void* dst, uint32_t levelCount)
+{
+	const uint32_t texelBytes = source == MIP_SOURCE_FLOAT32 ? 4 * sizeof(float) : 4;
+	uint8_t* out = (uint8_t*)dst;
+	memcpy(out, src, (size_t)width * height * texelBytes);
+	out += (size_t)width * height * texelBytes;
+	if (levelCount <= 1)
+		return;
+
+	MemoryArena& arena = ThreadArena();
+	ArenaScope scope(arena);
+
+	// le niveau 0 est converti ligne par ligne, les suivants sont conserves en flottants
+	float* row = arena.Push<float>((size_t)width * 4);
+	const float* previous = nullptr;
+	uint32_t srcWidth = width, srcHeight = height;
+	for (uint32_t level = 1; level < levelCount; level++)
+	{
+		const uint32_t dstWidth = std::max(1u, width >> level);
+		const uint32_t dstHeight = std::max(1u, height >> level);
+		float* current = arena.Push<float>((size_t)dstWidth * dstHeight * 4);
+		// filtres et passe horizontale sont rendus a la fin du niveau
+		MemoryArena::Marker marker = arena.GetMarker();
+		Filter1D filterX = BuildFilter(arena, srcWidth, dstWidth, filter);
+		Filter1D filterY = BuildFilter(arena, srcHeight, dstHeight, filter);
+		float* horizontal = arena.Push<float>((size_t)dstWidth * srcHeight * 4);
+
+		// passe horizontale : srcWidth x srcHeight -> dstWidth x srcHeight
+		for (uint32_t y = 0; y < srcHeight; y++)
+		{
+			const float* srcRow = previous ? previous + (size_t)y * srcWidth * 4 : ConvertRow(src, width, y, source, row);
+			float* dstRow = horizontal + (size_t)y * dstWidth * 4;
+			for (uint32_t x = 0; x < dstWidth; x++)
+			{
+				const float* weights = filterX.weights + (size_t)x * filterX.taps;
+				Float4 acc = Zero4();
+				for (uint32_t k = 0; k < filterX.taps; k++)
+				{
+					int32_t sx = std::min(std::max(filterX.first[x] + (int32_t)k, 0), (int32_t)srcWidth - 1);
+					acc = MulAdd4(acc, Load4(srcRow + (size_t)sx * 4), weights[k]);
+				}
+				Store4(dstRow + (size_t)x * 4, acc);
+			}
+		}
+
+		// passe verticale, ligne par ligne : dstWidth x srcHeight -> dstWidth x dstHeight
+		for (uint32_t y = 0; y < dstHeight; y++)
+		{
+			float* dstRow = current + (size_t)y * dstWidth * 4;
+			const float* weights = filterY.weights + (size_t)y * filterY.taps;
+			for (uint32_t x = 0; x < dstWidth; x++)
+				Store4(dstRow + (size_t)x * 4, Zero4());
+			for (uint32_t k = 0; k < filterY.taps; k++)
+			{
+				if (weights[k] == 0.f)
+					continue;
+				int32_t sy = std::min(std::max(filterY.first[y] + (int32_t)k, 0), (int32_t)srcHeight - 1);
+				const float* srcRow = horizontal + (size_t)sy * dstWidth * 4;
+				for (uint32_t x = 0; x < dstWidth; x++)
+					Store4(dstRow + (size_t)x * 4, MulAdd4(Load4(dstRow + (size_t)x * 4), Load4(srcRow + (size_t)x * 4), weights[k]));
+			}
+			for (uint32_t x = 0; x < dstWidth; x++)
+			{
+				Float4 texel = Resolve(Load4(dstRow + (size_t)x * 4), source);
+				Store4(dstRow + (size_t)x * 4, texel);
+				WriteTexel(out + ((size_t)y * dstWidth + x) * texelBytes, texel, source);
+			}
+		}
+
+		arena.Rewind(marker);
+		previous = current;
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+		out += (size_t)dstWidth * dstHeight * texelBytes;
+	}
+}
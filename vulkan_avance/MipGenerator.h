@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Generation CPU de la chaine de mips (remplace les vkCmdBlitImage du transfert)
+// - filtrage separable (horizontal puis vertical), chaque niveau est calcule depuis le precedent
+// - tailles quelconques (non puissances de 2) : l'empreinte d'un texel destination couvre une fraction de texel source
+// - sRGB decode en lineaire avant filtrage puis reencode, normal maps renormalisees a chaque niveau
+// - calculs en float4 (SSE), memoire de travail dans ThreadArena() : appelable depuis les taches de chargement
+enum MipFilter
+{
+	MIP_FILTER_BOX,		// moyenne ponderee par la couverture de l'empreinte
+	MIP_FILTER_KAISER	// sinc fenetre de Kaiser, plus net (lobes negatifs, resultat borne)
+};
+
+enum MipSource
+{
+	MIP_SOURCE_UNORM8,	// RGBA8 lineaire (masques, roughness/metalness...)
+	MIP_SOURCE_SRGB8,	// RGBA8 sRGB (couleurs), alpha lineaire
+	MIP_SOURCE_NORMAL8,	// RGBA8 normal map (xyz dans [0,1])
+	MIP_SOURCE_FLOAT32	// RGBA32F lineaire (HDR), borne a 0
+};
+
+// nombre de niveaux jusqu'a 1x1, la plus grande dimension compte
+uint32_t MipLevelCount(uint32_t width, uint32_t height);
+// taille de la chaine (niveaux a la suite, niveau 0 en premier) pour des texels de texelBytes octets
+size_t MipChainSize(uint32_t width, uint32_t height, uint32_t levelCount, uint32_t texelBytes);
+
+// ecrit levelCount niveaux dans dst (MipChainSize octets), le niveau 0 est une copie de src
+void GenerateMipChain(const void* src, uint32_t width, uint32_t height, MipSource source, MipFilter filter, void* dst, uint32_t levelCount);
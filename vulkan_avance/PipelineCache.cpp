@@ -0,0 +1,127 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "PipelineCache.h"
+
+#include <fstream>
+#include <vector>
+#include <cstdio>
+
+bool PipelineCache::IsCompatible(const VkPhysicalDeviceProperties& props, const uint8_t* data, size_t size)
+{
+	VkPipelineCacheHeaderVersionOne header;
+	if (size < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.headerSize < sizeof(header) || header.headerSize > size)
+		return false;
+	if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+		return false;
+	if (header.vendorID != props.vendorID || header.deviceID != props.deviceID)
+		return false;
+	// l'UUID change avec la version du driver
+	return memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::Create(VulkanDeviceContext& context, const char* filepath)
+{
+	path = filepath;
+	warm = false;
+	loadedSize = 0;
+
+	std::vector<uint8_t> data;
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (file.is_open())
+	{
+		std::streamoff fileSize = file.tellg();
+		if (fileSize > 0) {
+			data.resize((size_t)fileSize);
+			file.seekg(0);
+			file.read((char*)data.data(), fileSize);
+			if (!file)
+				data.clear();
+		}
+		file.close();
+
+		if (!IsCompatible(context.props, data.data(), data.size())) {
+			std::cout << "pipeline cache: " << path << " is invalid or from another device/driver, ignored" << std::endl;
+			data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+	VkResult result = vkCreatePipelineCache(context.device, &cacheInfo, nullptr, &cache);
+	if (result != VK_SUCCESS && !data.empty())
+	{
+		// le header est correct mais le driver refuse le contenu : on repart de zero
+		std::cout << "pipeline cache: " << path << " rejected by the driver, ignored" << std::endl;
+		data.clear();
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(context.device, &cacheInfo, nullptr, &cache);
+	}
+	if (result != VK_SUCCESS) {
+		std::cout << "error: failed to create pipeline cache!" << std::endl;
+		cache = VK_NULL_HANDLE;
+		return false;
+	}
+
+	warm = !data.empty();
+	loadedSize = data.size();
+	return true;
+}
+
+bool PipelineCache::Save(VulkanDeviceContext& context)
+{
+	if (cache == VK_NULL_HANDLE)
+		return false;
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(context.device, cache, &size, nullptr) != VK_SUCCESS || size == 0)
+		return false;
+	std::vector<uint8_t> data(size);
+	if (vkGetPipelineCacheData(context.device, cache, &size, data.data()) != VK_SUCCESS)
+		return false;
+	data.resize(size);
+
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cout << "error: failed to write pipeline cache " << tempPath << std::endl;
+			return false;
+		}
+		file.write((const char*)data.data(), size);
+		file.flush();
+		if (!file) {
+			std::cout << "error: failed to write pipeline cache " << tempPath << std::endl;
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	// remplacement atomique de l'ancien fichier
+#ifdef _WIN32
+	bool renamed = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool renamed = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed) {
+		std::cout << "error: failed to replace pipeline cache " << path << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::cout << "pipeline cache: " << (size >> 10) << " KB written to " << path << std::endl;
+	return true;
+}
+
+void PipelineCache::Destroy(VulkanDeviceContext& context)
+{
+	vkDestroyPipelineCache(context.device, cache, nullptr);
+	cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+// Cache de pipelines persistant sur disque
+// Le contenu d'un VkPipelineCache est opaque mais commence par un header standard (VkPipelineCacheHeaderVersionOne) :
+// un fichier produit par un autre GPU/driver est ignore (vendorID, deviceID, pipelineCacheUUID),
+// de meme qu'un fichier tronque ou corrompu, on repart alors d'un cache vide ("cold start")
+// L'ecriture passe par un fichier temporaire renomme ensuite : un crash pendant Save() ne corrompt pas le cache existant
+// Un VkPipelineCache est synchronise en interne, il peut etre partage par des creations de pipelines concurrentes
+struct PipelineCache
+{
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	std::string path;
+	bool warm = false;				// donnees initiales chargees depuis le disque
+	size_t loadedSize = 0;
+
+	bool Create(struct VulkanDeviceContext& context, const char* filepath);
+	// ecrit le cache sur disque (a appeler avant Destroy, une fois les pipelines crees)
+	bool Save(struct VulkanDeviceContext& context);
+	void Destroy(struct VulkanDeviceContext& context);
+
+	// verifie que les donnees proviennent du meme GPU et du meme driver
+	static bool IsCompatible(const VkPhysicalDeviceProperties& props, const uint8_t* data, size_t size);
+};
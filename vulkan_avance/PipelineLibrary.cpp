@@ -0,0 +1,224 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "JobSystem.h"
+#include "PipelineLibrary.h"
+
+#include <fstream>
+
+// version sans exception de readFile() : appelee depuis les workers
+static bool LoadShaderModule(VulkanDeviceContext& context, const char* path, VkShaderModule& module)
+{
+	module = VK_NULL_HANDLE;
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "error: failed to open shader " << path << std::endl;
+		return false;
+	}
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<char> code(fileSize);
+	file.seekg(0);
+	file.read(code.data(), fileSize);
+	file.close();
+
+	VkShaderModuleCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	if (vkCreateShaderModule(context.device, &createInfo, nullptr, &module) != VK_SUCCESS) {
+		std::cout << "error: failed to create shader module " << path << std::endl;
+		module = VK_NULL_HANDLE;
+		return false;
+	}
+	return true;
+}
+
+uint32_t PipelineLibrary::Add(const PipelineDesc& desc)
+{
+	entries.emplace_back(desc);
+	return (uint32_t)entries.size() - 1;
+}
+
+void PipelineLibrary::CompileAsync(VulkanDeviceContext& context, JobSystem& jobs, VkPipelineCache cache)
+{
+	startTime = std::chrono::high_resolution_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingCount = (uint32_t)entries.size();
+		pendingRequired = 0;
+		for (const Entry& entry : entries)
+			pendingRequired += entry.desc.required ? 1 : 0;
+	}
+
+	// la file des workers est FIFO : les pipelines requis demarrent en premier
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (Entry& entry : entries)
+		{
+			if (entry.desc.required != (pass == 0))
+				continue;
+			Entry* e = &entry;
+			VulkanDeviceContext* c = &context;
+			jobs.Submit([this, c, e, cache](uint32_t) { Compile(*c, *e, cache); });
+		}
+	}
+}
+
+void PipelineLibrary::Compile(VulkanDeviceContext& context, Entry& entry, VkPipelineCache cache)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const PipelineDesc& desc = entry.desc;
+	VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+
+	if (desc.computeShader)
+	{
+		VkShaderModule compShaderModule;
+		if (LoadShaderModule(context, desc.computeShader, compShaderModule))
+		{
+			VkComputePipelineCreateInfo computePipelineInfo = {};
+			computePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			computePipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			computePipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			computePipelineInfo.stage.module = compShaderModule;
+			computePipelineInfo.stage.pName = "main";
+			computePipelineInfo.layout = desc.layout;
+			result = vkCreateComputePipelines(context.device, cache, 1, &computePipelineInfo, nullptr, &entry.pipeline);
+		}
+		vkDestroyShaderModule(context.device, compShaderModule, nullptr);
+	}
+	else
+	{
+		VkShaderModule vertShaderModule, fragShaderModule;
+		bool loaded = LoadShaderModule(context, desc.vertexShader, vertShaderModule);
+		loaded &= LoadShaderModule(context, desc.fragmentShader, fragShaderModule);
+		if (loaded)
+		{
+			VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+			shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+			shaderStages[0].module = vertShaderModule;
+			shaderStages[0].pName = "main";
+			shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+			shaderStages[1].module = fragShaderModule;
+			shaderStages[1].pName = "main";
+
+			VkVertexInputBindingDescription vertexInputBindings = { 0, desc.vertexStride, VK_VERTEX_INPUT_RATE_VERTEX };
+			VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+			vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			if (desc.vertexStride > 0) {
+				vertexInputInfo.vertexBindingDescriptionCount = 1;
+				vertexInputInfo.pVertexBindingDescriptions = &vertexInputBindings;
+				vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t)desc.vertexAttributes.size();
+				vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+			}
+
+			VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+			inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+			inputAssemblyInfo.topology = desc.topology;
+			inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+			// la taille de rendu change avec la resolution dynamique : pas de viewport fige dans le pipeline
+			VkPipelineViewportStateCreateInfo viewportInfo = {};
+			viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+			viewportInfo.viewportCount = 1;
+			viewportInfo.scissorCount = 1;
+			VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+			VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+			dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+			dynamicStateInfo.dynamicStateCount = 2;
+			dynamicStateInfo.pDynamicStates = dynamicStates;
+
+			VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
+			rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+			rasterizationInfo.cullMode = desc.cullMode;
+			rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
+			rasterizationInfo.frontFace = desc.frontFace;
+			rasterizationInfo.lineWidth = 1.f;
+
+			VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
+			multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+			multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+			VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+			depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+			depthStencilInfo.depthTestEnable = desc.depthTest;
+			depthStencilInfo.depthWriteEnable = desc.depthWrite;
+			depthStencilInfo.depthCompareOp = desc.depthCompare;
+
+			VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+			colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+			colorBlendAttachment.blendEnable = false;
+			VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+			colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+			colorBlendInfo.attachmentCount = 1;
+			colorBlendInfo.pAttachments = &colorBlendAttachment;
+
+			VkGraphicsPipelineCreateInfo gfxPipelineInfo = {};
+			gfxPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			gfxPipelineInfo.stageCount = 2;
+			gfxPipelineInfo.pStages = shaderStages;
+			gfxPipelineInfo.pVertexInputState = &vertexInputInfo;
+			gfxPipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+			gfxPipelineInfo.pViewportState = &viewportInfo;
+			gfxPipelineInfo.pRasterizationState = &rasterizationInfo;
+			gfxPipelineInfo.pMultisampleState = &multisampleInfo;
+			gfxPipelineInfo.pDepthStencilState = &depthStencilInfo;
+			gfxPipelineInfo.pColorBlendState = &colorBlendInfo;
+			gfxPipelineInfo.pDynamicState = &dynamicStateInfo;
+			gfxPipelineInfo.layout = desc.layout;
+			gfxPipelineInfo.renderPass = desc.renderPass;
+			gfxPipelineInfo.subpass = desc.subpass;
+			gfxPipelineInfo.basePipelineIndex = -1;
+			gfxPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+			result = vkCreateGraphicsPipelines(context.device, cache, 1, &gfxPipelineInfo, nullptr, &entry.pipeline);
+		}
+		vkDestroyShaderModule(context.device, vertShaderModule, nullptr);
+		vkDestroyShaderModule(context.device, fragShaderModule, nullptr);
+	}
+
+	entry.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if (result != VK_SUCCESS) {
+		std::cout << "error: failed to create pipeline " << desc.name << std::endl;
+		entry.pipeline = VK_NULL_HANDLE;
+		entry.failed = true;
+	}
+	else {
+		entry.ready.store(true, std::memory_order_release);
+		readyCount.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (desc.required) {
+		pendingRequired--;
+		failedRequired += entry.failed ? 1 : 0;
+	}
+	if (--pendingCount == 0) {
+		double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		std::cout << "pipelines: " << entries.size() << " compiled in " << totalMs << " ms" << std::endl;
+	}
+	doneCondition.notify_all();
+}
+
+bool PipelineLibrary::WaitRequired()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return pendingRequired == 0; });
+	double requiredMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "pipelines: required set ready in " << requiredMs << " ms" << std::endl;
+	return failedRequired == 0;
+}
+
+void PipelineLibrary::WaitAll()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return pendingCount == 0; });
+}
+
+void PipelineLibrary::Destroy(VulkanDeviceContext& context)
+{
+	WaitAll();
+	for (Entry& entry : entries)
+		vkDestroyPipeline(context.device, entry.pipeline, nullptr);
+	entries.clear();
+	readyCount = 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Description declarative d'un pipeline (graphique, ou compute si computeShader est renseigne)
+// les shaders sont des chemins vers les .spv, charges par la tache de compilation elle-meme
+struct PipelineDesc
+{
+	const char* name = "";
+	const char* vertexShader = nullptr;
+	const char* fragmentShader = nullptr;
+	const char* computeShader = nullptr;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	// etats graphiques
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	// viewport et scissor sont des etats dynamiques (vkCmdSetViewport/vkCmdSetScissor)
+	uint32_t vertexStride = 0;		// 0 = pas de vertex buffer
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	bool depthTest = true;
+	bool depthWrite = true;
+	VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+	// requis pour afficher la premiere frame, sinon le draw correspondant est saute tant qu'il n'est pas pret
+	bool required = true;
+};
+
+// Compilation concurrente des pipelines sur le JobSystem
+// chaque tache lit ses .spv, cree ses shader modules puis le pipeline : lectures disque et compilations se recouvrent
+// Get() retourne VK_NULL_HANDLE tant que le pipeline n'est pas pret, l'appelant doit alors sauter le draw
+struct PipelineLibrary
+{
+	struct Entry
+	{
+		PipelineDesc desc;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		std::atomic<bool> ready{ false };
+		bool failed = false;
+		double milliseconds = 0.0;
+
+		Entry(const PipelineDesc& d) : desc(d) {}
+	};
+
+	std::deque<Entry> entries;		// deque : adresses stables pendant que les taches travaillent
+	std::atomic<uint32_t> readyCount{ 0 };
+
+	std::mutex mutex;
+	std::condition_variable doneCondition;
+	uint32_t pendingCount = 0;
+	uint32_t pendingRequired = 0;
+	uint32_t failedRequired = 0;
+	std::chrono::high_resolution_clock::time_point startTime;
+
+	// a appeler avant CompileAsync(), retourne l'identifiant du pipeline
+	uint32_t Add(const PipelineDesc& desc);
+	// soumet une tache par pipeline (les pipelines requis en premier)
+	void CompileAsync(struct VulkanDeviceContext& context, struct JobSystem& jobs, VkPipelineCache cache);
+	// attend les pipelines requis, false si l'un d'eux a echoue
+	bool WaitRequired();
+	// attend tous les pipelines (avant de sauver le cache ou de detruire)
+	void WaitAll();
+	void Destroy(struct VulkanDeviceContext& context);
+
+	VkPipeline Get(uint32_t id) const { return entries[id].ready.load(std::memory_order_acquire) ? entries[id].pipeline : VK_NULL_HANDLE; }
+	uint32_t ReadyCount() const { return readyCount.load(std::memory_order_acquire); }
+
+private:
+	void Compile(struct VulkanDeviceContext& context, Entry& entry, VkPipelineCache cache);
+};
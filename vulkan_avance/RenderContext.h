@@ -1,5 +1,16 @@
 #pragma once
 
+#include "FrameAllocator.h"
+#include "StagingRing.h"
+#include "DeferredDestroy.h"
+
+struct CachedFrameOffsets
+{
+	uint32_t globalOffset;
+	uint32_t simParamsOffset;
+	VkExtent2D renderExtent;
+};
+
 struct VulkanRenderContext
 {
 	static constexpr int PENDING_FRAMES = 2;	// nombre de frames en cours de traitement
@@ -9,21 +20,61 @@ struct VulkanRenderContext
 
 	uint32_t graphicsQueueIndex;
 	uint32_t presentQueueIndex;
+	uint32_t transferQueueIndex;	// == graphicsQueueIndex s'il n'y a pas de famille dediee au transfert
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue;
 
 	// eventuellement creer une classe VulkanFrame par ex si besoin d'encapsuler tout ca
 	VkCommandPool mainCommandPool[PENDING_FRAMES];
 	VkCommandBuffer mainCommandBuffers[PENDING_FRAMES];
 	VkFence mainFences[PENDING_FRAMES];
 
+	// enregistrement en parallele : un command pool par frame et par "slot" d'enregistrement
+	// un slot n'est utilise que par une seule tache a la fois, pas de synchronisation sur les pools
+	// les secondary command buffers sont executes dans l'ordre des slots par le command buffer principal
+	static constexpr int MAX_RECORD_SLOTS = 16;
+	uint32_t recordSlotCount = 0;	// 0 = enregistrement direct dans mainCommandBuffers
+	VkCommandPool recordCommandPools[PENDING_FRAMES][MAX_RECORD_SLOTS];
+	VkCommandBuffer recordCommandBuffers[PENDING_FRAMES][MAX_RECORD_SLOTS];
+
+	// command buffers pre-enregistres (mode cacheCommandBuffers), indexes par [frame][image swapchain]
+	// les offsets du frameAllocator y sont figes : on les garde pour detecter un changement
+	VkCommandPool cachedCommandPool[PENDING_FRAMES];
+	VkCommandBuffer cachedCommandBuffers[PENDING_FRAMES][VulkanDeviceContext::SWAPCHAIN_IMAGES];
+	CachedFrameOffsets cachedOffsets[PENDING_FRAMES][VulkanDeviceContext::SWAPCHAIN_IMAGES];
+	bool cachedCommandValid[PENDING_FRAMES][VulkanDeviceContext::SWAPCHAIN_IMAGES] = {};
+
 	uint32_t currentFrame = 0;
 
+	// 2 timestamps (debut/fin) par frame en cours, relus apres l'attente de la fence de la frame
+	VkQueryPool timestampPool = VK_NULL_HANDLE;
+	uint32_t timestampValidBits = 0;	// 0 = timestamps non supportes par la graphics queue
+
 	VkRenderPass renderPass = VK_NULL_HANDLE;
+	// a ajouter a l'usage des attachments jamais stockes (depth...) : TRANSIENT_ATTACHMENT si de la memoire
+	// LAZILY_ALLOCATED existe, 0 sinon (l'usage doit etre identique dans l'image et le framebuffer imageless)
+	VkImageUsageFlags transientAttachmentUsage = 0;
 	VkImageSubresourceRange mainSubRange;
 
-	// pour les transfert de donnees cpu->gpu
-	Buffer stagingBuffer;
+	// toutes les ressources (buffers, images) sont sous-allouees ici
+	DeviceMemoryAllocator memoryAllocator;
+	// destructions attendant que les frames en vol ne referencent plus les objets
+	DeferredDestroyQueue deferredDestroy;
+
+	// pour les transfert de donnees cpu->gpu (copies regroupees en lots, cf. StagingRing.h)
+	StagingRing staging;
+
+	// constantes par frame (UBO dynamiques), une region par frame en cours
+	FrameAllocator frameAllocator;
+	// temporaires CPU de la frame (thread principal), rendus en bloc au debut de la frame suivante
+	MemoryArena frameArena;
+
+	// table de textures "bindless" : un tableau de combined image samplers indexe par l'id du texture manager
+	// (binding textureTableBinding du set textureTable, alimente par Texture::UpdateTextureTable())
+	VkDescriptorSet textureTable = VK_NULL_HANDLE;
+	uint32_t textureTableBinding = 0;
+	uint32_t textureTableSize = 0;
 
 	VkCommandBuffer BeginOneTimeCommandBuffer()
 	{
@@ -44,6 +95,22 @@ struct VulkanRenderContext
 		return commandBuffer;
 	}
 
+	// secondary command buffer execute a l'interieur de renderPass (subpass 0)
+	void BeginSecondaryCommandBuffer(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer)
+	{
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = framebuffer;	// optionnel, mais permet au driver d'optimiser
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	}
+
 	void EndOneTimeCommandBuffer(VkCommandBuffer commandBuffer)
 	{
 		vkEndCommandBuffer(commandBuffer);
@@ -0,0 +1,464 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "RenderContext.h"
+#include "RenderGraph.h"
+
+// acces qui doivent etre rendus disponibles (src access d'une barriere)
+static const VkAccessFlags2 RG_WRITE_ACCESS = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+	| VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+	| VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+struct UsageDesc
+{
+	RGState state;
+	bool write;
+};
+
+// meme ordre que RGUsage
+static const UsageDesc usageDescs[RG_USAGE_COUNT] = {
+	{ { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL }, false },
+	{ { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, true },
+	{ { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL }, false },
+	{ { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }, false },
+	{ { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, true },
+	{ { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL }, true },
+	{ { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL }, false },
+	{ { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL }, true },
+	// la presentation est synchronisee par le semaphore du submit, seule la transition compte
+	{ { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }, false },
+};
+
+RGState RenderGraph::UsageState(RGUsage usage)
+{
+	return usageDescs[usage].state;
+}
+
+bool RenderGraph::IsWrite(RGUsage usage)
+{
+	return usageDescs[usage].write;
+}
+
+// ---
+
+static RenderGraph::Resource NewResource(const char* name, bool isImage)
+{
+	RenderGraph::Resource resource = {};
+	resource.name = name;
+	resource.isImage = isImage;
+	resource.firstPass = UINT32_MAX;
+	resource.lastPass = 0;
+	resource.memorySlot = UINT32_MAX;
+	return resource;
+}
+
+RGResource RenderGraph::ImportBuffer(const char* name, RGState initialState)
+{
+	Resource resource = NewResource(name, false);
+	resource.initialState = initialState;
+	resources.push_back(resource);
+	return (RGResource)resources.size() - 1;
+}
+
+RGResource RenderGraph::ImportImage(const char* name, VkImageAspectFlags aspect, RGState initialState, RGUsage finalUsage)
+{
+	Resource resource = NewResource(name, true);
+	resource.aspect = aspect;
+	resource.initialState = initialState;
+	resource.hasFinalUsage = true;
+	resource.finalUsage = finalUsage;
+	resources.push_back(resource);
+	return (RGResource)resources.size() - 1;
+}
+
+RGResource RenderGraph::CreateTransientImage(const char* name, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage)
+{
+	Resource resource = NewResource(name, true);
+	resource.transient = true;
+	resource.width = width;
+	resource.height = height;
+	resource.format = format;
+	resource.usage = usage;
+	bool depth = format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_X8_D24_UNORM_PACK32
+		|| format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	resource.aspect = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	resources.push_back(resource);
+	return (RGResource)resources.size() - 1;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name, std::function<void(VkCommandBuffer)> execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.execute = execute;
+	passes.push_back(pass);
+	return { this, (uint32_t)passes.size() - 1 };
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(RGResource resource, RGUsage usage)
+{
+	graph->AddAccess(index, resource, usage);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(RGResource resource, RGUsage usage)
+{
+	graph->AddAccess(index, resource, usage);
+	graph->passes[index].accesses.back().write = true;
+	return *this;
+}
+
+void RenderGraph::AddAccess(uint32_t pass, RGResource resource, RGUsage usage)
+{
+	RGState state = UsageState(usage);
+	std::vector<Access>& accesses = passes[pass].accesses;
+
+	// meme ressource lue et ecrite dans la pass : on cumule, on la place en fin de liste pour Write()
+	for (size_t i = 0; i < accesses.size(); i++)
+	{
+		if (accesses[i].resource != resource)
+			continue;
+		Access access = accesses[i];
+		if (resources[resource].isImage && access.state.layout != state.layout)
+			std::cout << "error: render graph pass " << passes[pass].name << " uses " << resources[resource].name << " with two layouts" << std::endl;
+		access.state.stages |= state.stages;
+		access.state.access |= state.access;
+		access.write |= IsWrite(usage);
+		accesses.erase(accesses.begin() + i);
+		accesses.push_back(access);
+		return;
+	}
+
+	accesses.push_back({ resource, state, IsWrite(usage) });
+}
+
+// ---
+
+bool RenderGraph::Compile(VulkanRenderContext& rendercontext)
+{
+	// durees de vie
+	for (uint32_t p = 0; p < passes.size(); p++)
+	{
+		for (const Access& access : passes[p].accesses)
+		{
+			Resource& resource = resources[access.resource];
+			if (p < resource.firstPass)
+				resource.firstPass = p;
+			if (p > resource.lastPass)
+				resource.lastPass = p;
+		}
+	}
+
+	if (!AllocateTransients(rendercontext))
+		return false;
+
+	ComputeBarriers();
+
+	uint32_t barrierCount = (uint32_t)finalBarriers.size();
+	for (const Pass& pass : passes)
+		barrierCount += (uint32_t)pass.barriers.size();
+	std::cout << "render graph: " << passes.size() << " passes, " << barrierCount << " barriers, "
+		<< memorySlots.size() << " transient memory blocks" << std::endl;
+
+	return true;
+}
+
+bool RenderGraph::AllocateTransients(VulkanRenderContext& rendercontext)
+{
+	VulkanDeviceContext& context = *rendercontext.context;
+
+	// transients par ordre de premiere utilisation
+	std::vector<RGResource> order;
+	for (RGResource r = 0; r < resources.size(); r++) {
+		if (resources[r].transient && resources[r].firstPass != UINT32_MAX)
+			order.push_back(r);
+	}
+	for (size_t i = 1; i < order.size(); i++) {
+		for (size_t j = i; j > 0 && resources[order[j]].firstPass < resources[order[j - 1]].firstPass; j--)
+			std::swap(order[j], order[j - 1]);
+	}
+
+	VkDeviceSize requestedSize = 0;
+	for (RGResource r : order)
+	{
+		Resource& resource = resources[r];
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { resource.width, resource.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = resource.format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = resource.usage;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateImage(context.device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+			std::cout << "error: failed to create transient image " << resource.name << std::endl;
+			return false;
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(context.device, resource.image, &memRequirements);
+		requestedSize += memRequirements.size;
+
+		// premier bloc dont tous les occupants ont fini avant cette image
+		uint32_t slotIndex = UINT32_MAX;
+		for (uint32_t s = 0; s < memorySlots.size(); s++)
+		{
+			MemorySlot& slot = memorySlots[s];
+			if (resources[slot.occupants.back()].lastPass < resource.firstPass && (slot.typeBits & memRequirements.memoryTypeBits)) {
+				slotIndex = s;
+				break;
+			}
+		}
+		if (slotIndex == UINT32_MAX) {
+			memorySlots.push_back({ {}, 0, 1, memRequirements.memoryTypeBits, {} });
+			slotIndex = (uint32_t)memorySlots.size() - 1;
+		}
+
+		MemorySlot& slot = memorySlots[slotIndex];
+		if (memRequirements.size > slot.size)
+			slot.size = memRequirements.size;
+		if (memRequirements.alignment > slot.alignment)
+			slot.alignment = memRequirements.alignment;
+		slot.typeBits &= memRequirements.memoryTypeBits;
+		slot.occupants.push_back(r);
+		resource.memorySlot = slotIndex;
+	}
+
+	VkDeviceSize allocatedSize = 0;
+	for (MemorySlot& slot : memorySlots)
+	{
+		// un bloc partage par plusieurs images ne peut pas etre une allocation dediee a l'une d'elles
+		// LAZILY_ALLOCATED seulement si tous les occupants sont TRANSIENT_ATTACHMENT (sinon absent de typeBits)
+		VkMemoryRequirements slotRequirements = { slot.size, slot.alignment, slot.typeBits };
+		if (!rendercontext.memoryAllocator.Allocate(slotRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+			, ALLOCATION_OPTIMAL, MEMORY_CATEGORY_RENDER_TARGET, slot.allocation)) {
+			std::cout << "error: failed to allocate transient memory!" << std::endl;
+			return false;
+		}
+		allocatedSize += slot.size;
+
+		// toutes les images d'un bloc demarrent au meme offset, leur contenu est indefini a chaque premiere utilisation
+		for (RGResource r : slot.occupants)
+		{
+			Resource& resource = resources[r];
+			DEBUG_CHECK_VK(vkBindImageMemory(context.device, resource.image, slot.allocation.memory, slot.allocation.offset));
+
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.format;
+			viewInfo.subresourceRange = { resource.aspect, 0, 1, 0, 1 };
+			DEBUG_CHECK_VK(vkCreateImageView(context.device, &viewInfo, nullptr, &resource.view));
+		}
+	}
+
+	if (!order.empty())
+		std::cout << "render graph: " << order.size() << " transient images, " << (allocatedSize >> 10) << " KB allocated for " << (requestedSize >> 10) << " KB requested" << std::endl;
+
+	return true;
+}
+
+// etat d'une ressource pendant la simulation du graphe
+struct RGTracker
+{
+	VkPipelineStageFlags2 writeStages;		// derniere ecriture (ou transition de layout)
+	VkAccessFlags2 writeAccess;
+	VkPipelineStageFlags2 readStages;		// lectures depuis la derniere ecriture (dependances WAR)
+	VkPipelineStageFlags2 visibleStages;	// stages/acces qui voient deja la derniere ecriture
+	VkAccessFlags2 visibleAccess;
+	VkImageLayout layout;
+};
+
+// applique un acces, retourne true et remplit barrier si une barriere est necessaire
+static bool ApplyAccess(RGTracker& t, const RGState& dst, bool write, bool isImage, RenderGraph::Barrier& barrier)
+{
+	bool layoutChange = isImage && dst.layout != t.layout;
+	barrier.dst = dst;
+	barrier.src.layout = t.layout;
+
+	if (write || layoutChange)
+	{
+		// ecriture ou transition : attendre les ecritures (RAW/WAW) et les lectures (WAR) precedentes
+		barrier.src.stages = t.writeStages | t.readStages;
+		barrier.src.access = t.writeAccess;
+		bool needed = layoutChange || barrier.src.stages != 0;
+
+		t.writeStages = dst.stages;
+		t.writeAccess = write ? (dst.access & RG_WRITE_ACCESS) : 0;
+		t.readStages = write ? 0 : dst.stages;
+		t.visibleStages = dst.stages;
+		t.visibleAccess = dst.access;
+		t.layout = dst.layout;
+		return needed;
+	}
+
+	// lecture : rien a faire si la derniere ecriture est deja visible pour ce stage/acces (RAR)
+	bool needed = false;
+	bool visible = (dst.stages & ~t.visibleStages) == 0 && (dst.access & ~t.visibleAccess) == 0;
+	if (!visible && t.writeStages != 0) {
+		barrier.src.stages = t.writeStages;
+		barrier.src.access = t.writeAccess;
+		t.visibleStages |= dst.stages;
+		t.visibleAccess |= dst.access;
+		needed = true;
+	}
+	t.readStages |= dst.stages;
+	return needed;
+}
+
+void RenderGraph::ComputeBarriers()
+{
+	// le premier occupant d'un bloc memoire doit attendre le dernier occupant de la frame precedente
+	// dont l'etat final n'est connu qu'apres une premiere simulation : on simule donc deux fois
+	std::vector<RGTracker> endStates(resources.size(), RGTracker{});
+
+	for (int run = 0; run < 2; run++)
+	{
+		std::vector<RGTracker> trackers(resources.size(), RGTracker{});
+		std::vector<bool> started(resources.size(), false);
+		for (RGResource r = 0; r < resources.size(); r++)
+		{
+			if (resources[r].transient)
+				continue;
+			const RGState& initial = resources[r].initialState;
+			trackers[r].writeStages = initial.stages;
+			trackers[r].writeAccess = initial.access & RG_WRITE_ACCESS;
+			trackers[r].readStages = initial.stages;
+			trackers[r].layout = initial.layout;
+			started[r] = true;
+		}
+
+		for (Pass& pass : passes)
+		{
+			pass.barriers.clear();
+			for (const Access& access : pass.accesses)
+			{
+				Resource& resource = resources[access.resource];
+				RGTracker& t = trackers[access.resource];
+
+				if (!started[access.resource])
+				{
+					// transient : contenu indefini mais la memoire vient de l'occupant precedent du bloc
+					const std::vector<RGResource>& occupants = memorySlots[resource.memorySlot].occupants;
+					size_t position = 0;
+					while (occupants[position] != access.resource)
+						position++;
+					const RGTracker& previous = position > 0 ? trackers[occupants[position - 1]] : endStates[occupants.back()];
+					t = RGTracker{};
+					t.writeStages = previous.writeStages | previous.readStages;
+					t.writeAccess = previous.writeAccess;
+					t.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+					started[access.resource] = true;
+				}
+
+				Barrier barrier;
+				barrier.resource = access.resource;
+				if (ApplyAccess(t, access.state, access.write, resource.isImage, barrier))
+					pass.barriers.push_back(barrier);
+			}
+		}
+
+		// etat attendu apres le graphe (present...)
+		finalBarriers.clear();
+		for (RGResource r = 0; r < resources.size(); r++)
+		{
+			if (!resources[r].hasFinalUsage)
+				continue;
+			Barrier barrier;
+			barrier.resource = r;
+			if (ApplyAccess(trackers[r], UsageState(resources[r].finalUsage), IsWrite(resources[r].finalUsage), resources[r].isImage, barrier))
+				finalBarriers.push_back(barrier);
+		}
+
+		endStates = trackers;
+	}
+}
+
+void RenderGraph::EmitBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers)
+{
+	if (barriers.empty())
+		return;
+
+	// une seule barriere memoire globale pour tous les buffers, une barriere par image (transition de layout)
+	VkMemoryBarrier2 memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+
+	static constexpr uint32_t MAX_IMAGE_BARRIERS = 16;
+	VkImageMemoryBarrier2 imageBarriers[MAX_IMAGE_BARRIERS];
+	uint32_t imageBarrierCount = 0;
+
+	for (const Barrier& barrier : barriers)
+	{
+		const Resource& resource = resources[barrier.resource];
+		if (!resource.isImage) {
+			memoryBarrier.srcStageMask |= barrier.src.stages;
+			memoryBarrier.srcAccessMask |= barrier.src.access;
+			memoryBarrier.dstStageMask |= barrier.dst.stages;
+			memoryBarrier.dstAccessMask |= barrier.dst.access;
+			continue;
+		}
+		if (imageBarrierCount == MAX_IMAGE_BARRIERS) {
+			std::cout << "error: too many image barriers in a render graph pass" << std::endl;
+			break;
+		}
+
+		VkImageMemoryBarrier2& imageBarrier = imageBarriers[imageBarrierCount++];
+		imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		imageBarrier.srcStageMask = barrier.src.stages;
+		imageBarrier.srcAccessMask = barrier.src.access;
+		imageBarrier.dstStageMask = barrier.dst.stages;
+		imageBarrier.dstAccessMask = barrier.dst.access;
+		imageBarrier.oldLayout = barrier.src.layout;
+		imageBarrier.newLayout = barrier.dst.layout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = resource.image;
+		imageBarrier.subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+	}
+
+	VkDependencyInfo dependencyInfo = {};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.memoryBarrierCount = (memoryBarrier.srcStageMask | memoryBarrier.dstStageMask) ? 1 : 0;
+	dependencyInfo.pMemoryBarriers = &memoryBarrier;
+	dependencyInfo.imageMemoryBarrierCount = imageBarrierCount;
+	dependencyInfo.pImageMemoryBarriers = imageBarriers;
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer)
+{
+	for (const Pass& pass : passes)
+	{
+		EmitBarriers(commandBuffer, pass.barriers);
+		pass.execute(commandBuffer);
+	}
+	EmitBarriers(commandBuffer, finalBarriers);
+}
+
+void RenderGraph::Destroy(VulkanRenderContext& rendercontext)
+{
+	// differe : le graphe peut etre reconstruit (redimensionnement) pendant que des frames sont en vol
+	// les images sont detruites avant la memoire qu'elles partagent (ordre de la file)
+	DeferredDestroyQueue& deferred = rendercontext.deferredDestroy;
+	for (Resource& resource : resources)
+	{
+		if (!resource.transient || resource.image == VK_NULL_HANDLE)
+			continue;
+		Allocation aliased = {};	// la memoire appartient au slot
+		deferred.DestroyImageView(resource.view);
+		deferred.DestroyImage(resource.image, aliased);
+	}
+	for (MemorySlot& slot : memorySlots)
+		deferred.FreeAllocation(slot.allocation);
+
+	resources.clear();
+	passes.clear();
+	memorySlots.clear();
+	finalBarriers.clear();
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <functional>
+
+// Render graph minimal
+// chaque pass declare ce qu'elle lit et ecrit, le graphe en deduit :
+// - les barrieres (synchronization2) et transitions de layout strictement necessaires, regroupees avant chaque pass
+// - l'aliasing memoire des images transientes dont les durees de vie ne se chevauchent pas
+// Le graphe est compile une seule fois (Prepare). Les ressources importees (buffers ping-pong, image de la swapchain)
+// sont des "handles" : l'objet Vulkan reel de la frame est donne par BindBuffer()/BindImage() avant Execute()
+// Les etats initiaux decrivent l'usage laisse par la frame precedente, le graphe est donc valable d'une frame a l'autre
+
+typedef uint32_t RGResource;
+static constexpr RGResource RG_NULL_RESOURCE = UINT32_MAX;
+
+// usages predefinis (stage, acces et layout correspondants dans RenderGraph.cpp)
+enum RGUsage
+{
+	RG_COMPUTE_READ,		// storage buffer/image lu par un compute shader
+	RG_COMPUTE_WRITE,		// storage buffer/image ecrit par un compute shader
+	RG_VERTEX_READ,			// storage buffer lu par le vertex shader
+	RG_FRAGMENT_SAMPLED,	// texture echantillonnee par le fragment shader
+	RG_COLOR_ATTACHMENT,
+	RG_DEPTH_ATTACHMENT,
+	RG_TRANSFER_SRC,
+	RG_TRANSFER_DST,
+	RG_PRESENT,
+	RG_USAGE_COUNT
+};
+
+struct RGState
+{
+	VkPipelineStageFlags2 stages;
+	VkAccessFlags2 access;
+	VkImageLayout layout;	// ignore pour les buffers
+};
+
+struct RenderGraph
+{
+	struct Resource
+	{
+		const char* name;
+		bool isImage;
+		bool transient;
+		// objets Vulkan reels (crees par le graphe si transient, sinon fournis chaque frame)
+		VkBuffer buffer;
+		VkImage image;
+		VkImageView view;
+		VkImageAspectFlags aspect;
+		// description d'une image transiente
+		uint32_t width, height;
+		VkFormat format;
+		VkImageUsageFlags usage;
+		// ressource importee : etat laisse par la frame precedente, et usage en fin de graphe (present...)
+		RGState initialState;
+		bool hasFinalUsage;
+		RGUsage finalUsage;
+		// duree de vie en index de pass et emplacement memoire (transients)
+		uint32_t firstPass, lastPass;
+		uint32_t memorySlot;
+	};
+
+	struct Access
+	{
+		RGResource resource;
+		RGState state;
+		bool write;
+	};
+
+	struct Barrier
+	{
+		RGResource resource;
+		RGState src;
+		RGState dst;
+	};
+
+	struct Pass
+	{
+		const char* name;
+		std::vector<Access> accesses;	// un seul acces par ressource (lectures/ecritures fusionnees)
+		std::function<void(VkCommandBuffer)> execute;
+		std::vector<Barrier> barriers;	// calculees par Compile(), emises juste avant execute
+	};
+
+	// bloc memoire partage par des images transientes disjointes dans le temps
+	struct MemorySlot
+	{
+		Allocation allocation;
+		VkDeviceSize size;
+		VkDeviceSize alignment;
+		uint32_t typeBits;
+		std::vector<RGResource> occupants;	// par ordre de premiere utilisation
+	};
+
+	// graph.AddPass("nom", fn).Read(a, RG_COMPUTE_READ).Write(b, RG_COMPUTE_WRITE);
+	struct PassBuilder
+	{
+		RenderGraph* graph;
+		uint32_t index;
+		PassBuilder& Read(RGResource resource, RGUsage usage);
+		PassBuilder& Write(RGResource resource, RGUsage usage);
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<MemorySlot> memorySlots;
+	std::vector<Barrier> finalBarriers;
+
+	RGResource ImportBuffer(const char* name, RGState initialState);
+	RGResource ImportImage(const char* name, VkImageAspectFlags aspect, RGState initialState, RGUsage finalUsage);
+	RGResource CreateTransientImage(const char* name, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage);
+	PassBuilder AddPass(const char* name, std::function<void(VkCommandBuffer)> execute);
+
+	void BindBuffer(RGResource resource, VkBuffer buffer) { resources[resource].buffer = buffer; }
+	void BindImage(RGResource resource, VkImage image, VkImageView view) { resources[resource].image = image; resources[resource].view = view; }
+	VkBuffer GetBuffer(RGResource resource) const { return resources[resource].buffer; }
+	VkImage GetImage(RGResource resource) const { return resources[resource].image; }
+	VkImageView GetView(RGResource resource) const { return resources[resource].view; }
+
+	static RGState UsageState(RGUsage usage);
+	static bool IsWrite(RGUsage usage);
+
+	// cree et aliase les transients puis calcule les barrieres de chaque pass
+	bool Compile(struct VulkanRenderContext& rendercontext);
+	void Execute(VkCommandBuffer commandBuffer);
+	void Destroy(struct VulkanRenderContext& rendercontext);
+
+private:
+	void AddAccess(uint32_t pass, RGResource resource, RGUsage usage);
+	bool AllocateTransients(struct VulkanRenderContext& rendercontext);
+	void ComputeBarriers();
+	void EmitBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers);
+};
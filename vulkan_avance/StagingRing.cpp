@@ -0,0 +1,319 @@
+#include "vk_common.h"
+#include "DeviceContext.h"
+#include "RenderContext.h"
+
+static VkSemaphore CreateTimeline(VkDevice device)
+{
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &timelineInfo;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	DEBUG_CHECK_VK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore));
+	return semaphore;
+}
+
+static void CreateCommandBuffer(VkDevice device, uint32_t family, VkCommandPool& pool, VkCommandBuffer& commandBuffer)
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = family;
+	DEBUG_CHECK_VK(vkCreateCommandPool(device, &poolInfo, nullptr, &pool));
+
+	VkCommandBufferAllocateInfo commandInfo = {};
+	commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandInfo.commandPool = pool;
+	commandInfo.commandBufferCount = 1;
+	DEBUG_CHECK_VK(vkAllocateCommandBuffers(device, &commandInfo, &commandBuffer));
+}
+
+static void BeginCommandBuffer(VkDevice device, VkCommandPool pool, VkCommandBuffer commandBuffer)
+{
+	vkResetCommandPool(device, pool, 0);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+}
+
+bool StagingRing::Create(VulkanRenderContext& rendercontext, VkDeviceSize size)
+{
+	VulkanDeviceContext& context = *rendercontext.context;
+
+	device = context.device;
+	transferQueue = rendercontext.transferQueue;
+	graphicsQueue = rendercontext.graphicsQueue;
+	transferFamily = rendercontext.transferQueueIndex;
+	graphicsFamily = rendercontext.graphicsQueueIndex;
+	if (context.props.limits.optimalBufferCopyOffsetAlignment > alignment)
+		alignment = context.props.limits.optimalBufferCopyOffsetAlignment;
+	capacity = size;
+	head = tail = 0;
+	submittedBatches = acquiredBatches = retiredBatches = 0;
+	batchOpen = false;
+	submitCount = waitCount = 0;
+	uploadedBytes = 0;
+
+	memset(&buffer, 0, sizeof(Buffer));
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	buffer.size = size;
+	buffer.usage = bufferInfo.usage;
+	DEBUG_CHECK_VK(vkCreateBuffer(context.device, &bufferInfo, nullptr, &buffer.buffer));
+	if (!rendercontext.memoryAllocator.AllocateBuffer(buffer.buffer, MEMORY_USAGE_UPLOAD, MEMORY_CATEGORY_STAGING, buffer.allocation)) {
+		std::cout << "error: failed to allocate the staging ring!" << std::endl;
+		return false;
+	}
+	buffer.data = buffer.allocation.mapped;
+
+	timeline = CreateTimeline(context.device);
+	if (OwnershipTransfer())
+		transferTimeline = CreateTimeline(context.device);
+
+	for (Batch& batch : batches)
+	{
+		CreateCommandBuffer(context.device, transferFamily, batch.pool, batch.commandBuffer);
+		batch.acquirePool = VK_NULL_HANDLE;
+		batch.acquireCommandBuffer = VK_NULL_HANDLE;
+		if (OwnershipTransfer())
+			CreateCommandBuffer(context.device, graphicsFamily, batch.acquirePool, batch.acquireCommandBuffer);
+		batch.value = 0;
+		batch.ringEnd = 0;
+	}
+
+	return true;
+}
+
+void StagingRing::Destroy(VulkanRenderContext& rendercontext)
+{
+	VulkanDeviceContext& context = *rendercontext.context;
+
+	Flush();
+	Wait(submittedBatches);
+	for (Batch& batch : batches) {
+		vkDestroyCommandPool(context.device, batch.pool, nullptr);
+		if (batch.acquirePool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(context.device, batch.acquirePool, nullptr);
+	}
+	vkDestroySemaphore(context.device, timeline, nullptr);
+	if (transferTimeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(context.device, transferTimeline, nullptr);
+	buffer.Destroy(rendercontext);
+	timeline = transferTimeline = VK_NULL_HANDLE;
+}
+
+uint64_t StagingRing::CounterValue(VkSemaphore semaphore)
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, semaphore, &value);
+	return value;
+}
+
+void StagingRing::WaitValue(VkSemaphore semaphore, uint64_t value)
+{
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+	vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+}
+
+bool StagingRing::IsComplete(uint64_t value)
+{
+	return value <= acquiredBatches && CounterValue(timeline) >= value;
+}
+
+void StagingRing::Retire()
+{
+	uint64_t completed = CounterValue(timeline);
+
+	while (retiredBatches < acquiredBatches)
+	{
+		Batch& batch = batches[retiredBatches % MAX_BATCHES];
+		if (batch.value > completed)
+			break;
+		tail = batch.ringEnd;
+		retiredBatches++;
+	}
+	// plus aucune region reservee : on repart du debut de l'anneau (moins de coupures au bouclage)
+	if (head == tail)
+		head = tail = 0;
+}
+
+void StagingRing::SubmitAcquire(Batch& batch)
+{
+	// la copie est terminee (attendue par le CPU ou constatee) : l'attente GPU sur transferTimeline
+	// ne bloque donc pas la graphics queue, elle sert a l'ordre formel du transfert de propriete
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkTimelineSemaphoreSubmitInfo timelineSubmit = {};
+	timelineSubmit.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmit.waitSemaphoreValueCount = 1;
+	timelineSubmit.pWaitSemaphoreValues = &batch.value;
+	timelineSubmit.signalSemaphoreValueCount = 1;
+	timelineSubmit.pSignalSemaphoreValues = &batch.value;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmit;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &transferTimeline;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+	DEBUG_CHECK_VK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+	acquiredBatches++;
+	submitCount++;
+}
+
+void StagingRing::Acquire(bool wait)
+{
+	if (!OwnershipTransfer())
+		return;
+
+	uint64_t completed = CounterValue(transferTimeline);
+	while (acquiredBatches < submittedBatches)
+	{
+		Batch& batch = batches[acquiredBatches % MAX_BATCHES];
+		if (batch.value > completed) {
+			if (!wait)
+				break;
+			WaitValue(transferTimeline, batch.value);
+			completed = batch.value;
+		}
+		SubmitAcquire(batch);
+	}
+}
+
+void StagingRing::Wait(uint64_t value)
+{
+	if (value == 0)
+		return;
+
+	// les acquire des lots precedents doivent etre soumis pour que timeline atteigne value
+	while (acquiredBatches < submittedBatches && acquiredBatches < value)
+	{
+		Batch& batch = batches[acquiredBatches % MAX_BATCHES];
+		WaitValue(transferTimeline, batch.value);
+		SubmitAcquire(batch);
+	}
+	WaitValue(timeline, value);
+	Retire();
+}
+
+void StagingRing::WaitOldestBatch()
+{
+	if (retiredBatches == submittedBatches)
+		return;
+	waitCount++;
+	Wait(batches[retiredBatches % MAX_BATCHES].value);
+}
+
+VkCommandBuffer StagingRing::CommandBuffer()
+{
+	Batch& batch = batches[submittedBatches % MAX_BATCHES];
+	if (batchOpen)
+		return batch.commandBuffer;
+
+	// le lot precedent utilisant ces command buffers doit etre termine
+	Retire();
+	if (submittedBatches - retiredBatches >= MAX_BATCHES)
+		WaitOldestBatch();
+
+	BeginCommandBuffer(device, batch.pool, batch.commandBuffer);
+	if (OwnershipTransfer())
+		BeginCommandBuffer(device, batch.acquirePool, batch.acquireCommandBuffer);
+	batchOpen = true;
+
+	return batch.commandBuffer;
+}
+
+VkCommandBuffer StagingRing::AcquireCommandBuffer()
+{
+	CommandBuffer();
+	Batch& batch = batches[submittedBatches % MAX_BATCHES];
+	return OwnershipTransfer() ? batch.acquireCommandBuffer : batch.commandBuffer;
+}
+
+VkCommandBuffer StagingRing::Allocate(VkDeviceSize size, VkDeviceSize& offset, void** ptr)
+{
+	// jamais tronquee : l'appelant copierait size octets au dela de la region, sur des donnees encore en vol
+	if (size > MaxChunk()) {
+		std::cout << "error: staging allocation of " << size << " bytes exceeds the ring chunk size" << std::endl;
+		offset = 0;
+		*ptr = nullptr;
+		return VK_NULL_HANDLE;
+	}
+
+	for (;;)
+	{
+		uint64_t start = (head + alignment - 1) / alignment * alignment;
+		// une region ne chevauche jamais la fin de l'anneau
+		if (start % capacity + size > capacity)
+			start = (start / capacity + 1) * capacity;
+		if (start + size - tail <= capacity) {
+			head = start + size;
+			offset = start % capacity;
+			break;
+		}
+
+		// plus de place : le lot ouvert doit etre soumis pour que ses regions soient un jour liberees
+		Retire();
+		if (start + size - tail <= capacity)
+			continue;
+		if (batchOpen && retiredBatches == submittedBatches)
+			Flush();
+		WaitOldestBatch();
+	}
+
+	*ptr = (uint8_t*)buffer.data + offset;
+	uploadedBytes += size;
+	return CommandBuffer();
+}
+
+void StagingRing::Flush()
+{
+	if (!batchOpen)
+		return;
+
+	Batch& batch = batches[submittedBatches % MAX_BATCHES];
+	vkEndCommandBuffer(batch.commandBuffer);
+	if (OwnershipTransfer())
+		vkEndCommandBuffer(batch.acquireCommandBuffer);
+
+	batch.value = submittedBatches + 1;
+	batch.ringEnd = head;
+
+	VkTimelineSemaphoreSubmitInfo timelineSubmit = {};
+	timelineSubmit.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmit.signalSemaphoreValueCount = 1;
+	timelineSubmit.pSignalSemaphoreValues = &batch.value;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineSubmit;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = OwnershipTransfer() ? &transferTimeline : &timeline;
+	// ecritures CPU dans l'anneau (COHERENT) visibles par le GPU des ce submit
+	DEBUG_CHECK_VK(vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+	batchOpen = false;
+	submittedBatches++;
+	submitCount++;
+	// sans queue dediee les ressources sont utilisables des la fin du lot
+	if (!OwnershipTransfer())
+		acquiredBatches = submittedBatches;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// Anneau de staging pour les transferts CPU -> GPU
+// Les donnees sont copiees dans un buffer HOST_VISIBLE|COHERENT persistant gere comme un anneau,
+// les copies sont enregistrees dans un command buffer de transfert partage ("lot") qui n'est soumis
+// qu'au Flush() ou quand l'anneau est plein. Chaque lot signale une valeur d'un timeline semaphore :
+// une region de l'anneau est recyclee des que la valeur de son lot est atteinte.
+// Aucun vkQueueWaitIdle : le CPU n'attend le GPU que si l'anneau (ou les MAX_BATCHES lots) est plein.
+//
+// Queue de transfert dediee (OwnershipTransfer()) : le lot est execute sur la transfer queue, en parallele
+// du rendu. Les ressources y sont "liberees" (release barrier vers la famille graphics) puis "acquises" par
+// un second command buffer du lot, sur la graphics queue, qui contient aussi ce que la transfer queue ne sait
+// pas faire (transitions vers SHADER_READ_ONLY). Ce second command buffer n'est soumis (Acquire) qu'une fois la copie terminee,
+// la graphics queue n'attend donc jamais le transfert : pas d'a-coup pendant les chargements en arriere-plan.
+// Le lot n signale n sur transferTimeline (copie terminee) puis n sur timeline (ressources utilisables par le rendu) :
+// deux semaphores car les deux queues progressent independamment (un timeline ne peut que croitre).
+// Sans queue dediee, tout est enregistre dans un seul command buffer soumis sur la graphics queue.
+//
+// Une donnee plus grosse que MaxChunk() doit etre decoupee par l'appelant (cf. TransferImage/TransferBuffer)
+// Utilisation depuis le thread principal uniquement
+struct StagingRing
+{
+	static constexpr uint32_t MAX_BATCHES = 4;
+
+	struct Batch
+	{
+		VkCommandPool pool;
+		VkCommandBuffer commandBuffer;			// transfer queue (ou graphics queue sans queue dediee)
+		VkCommandPool acquirePool;
+		VkCommandBuffer acquireCommandBuffer;	// graphics queue, VK_NULL_HANDLE sans queue dediee
+		uint64_t value;				// numero du lot, signale par transferTimeline puis timeline
+		uint64_t ringEnd;			// position (monotone) de l'anneau liberee par ce lot
+	};
+
+	Buffer buffer;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize alignment = 16;	// multiple de la taille d'un texel (RGBA32F) et de optimalBufferCopyOffsetAlignment
+	// positions monotones dans l'anneau, offset reel = position % capacity
+	uint64_t head = 0;				// prochaine ecriture
+	uint64_t tail = 0;				// debut de la plus ancienne region encore utilisee par le GPU
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkQueue graphicsQueue = VK_NULL_HANDLE;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+	VkSemaphore timeline = VK_NULL_HANDLE;				// ressources utilisables par la graphics queue
+	VkSemaphore transferTimeline = VK_NULL_HANDLE;		// copies terminees (queue dediee uniquement)
+	Batch batches[MAX_BATCHES];
+	// lots [retiredBatches, acquiredBatches[ : acquire soumis, [acquiredBatches, submittedBatches[ : copie en cours
+	uint64_t submittedBatches = 0;
+	uint64_t acquiredBatches = 0;
+	uint64_t retiredBatches = 0;
+	bool batchOpen = false;
+
+	// statistiques
+	uint32_t submitCount = 0;
+	uint32_t waitCount = 0;			// attentes CPU (anneau ou lots pleins)
+	uint64_t uploadedBytes = 0;
+
+	bool Create(struct VulkanRenderContext& rendercontext, VkDeviceSize size);
+	void Destroy(struct VulkanRenderContext& rendercontext);
+
+	// plus grosse reservation possible en une fois
+	VkDeviceSize MaxChunk() const { return capacity / 2; }
+	// les ressources changent de famille de queue (release dans CommandBuffer(), acquire dans AcquireCommandBuffer())
+	bool OwnershipTransfer() const { return transferFamily != graphicsFamily; }
+
+	// command buffer de copie du lot ouvert (ouvre un nouveau lot si necessaire)
+	VkCommandBuffer CommandBuffer();
+	// command buffer graphics du lot ouvert : acquire barriers, transitions finales
+	// (le meme que CommandBuffer() sans queue dediee)
+	VkCommandBuffer AcquireCommandBuffer();
+	// reserve size octets : *ptr pour la copie CPU, offset pour la copie GPU
+	// size > MaxChunk() est une erreur : VK_NULL_HANDLE (et *ptr = nullptr), rien n'est reserve
+	// peut soumettre le lot courant pour faire de la place, il faut donc utiliser le command buffer retourne
+	VkCommandBuffer Allocate(VkDeviceSize size, VkDeviceSize& offset, void** ptr);
+	// valeur du timeline semaphore signalee quand les transferts enregistres jusqu'ici seront utilisables
+	uint64_t UploadValue() const { return batchOpen ? submittedBatches + 1 : submittedBatches; }
+	bool IsComplete(uint64_t value);
+
+	// soumet le lot ouvert (sans effet s'il n'y en a pas)
+	void Flush();
+	// soumet sur la graphics queue la partie "acquire" des lots dont la copie est terminee
+	// wait = true : attend d'abord la fin de toutes les copies (avant la premiere frame)
+	void Acquire(bool wait);
+	// recycle les regions des lots termines
+	void Retire();
+	void Wait(uint64_t value);
+
+private:
+	void WaitOldestBatch();
+	void SubmitAcquire(Batch& batch);
+	uint64_t CounterValue(VkSemaphore semaphore);
+	void WaitValue(VkSemaphore semaphore, uint64_t value);
+};
@@ -1,50 +1,54 @@
 #include "vk_common.h"
 #include "DeviceContext.h"
 #include "RenderContext.h"
+#include "JobSystem.h"
+#include "Ktx2.h"
+#include "TextureCache.h"
+
+#include <algorithm>
 
 void RenderSurface::CopyImage(VkCommandBuffer commandBuffer, VkImage dest, VkImage source, uint32_t imageWidth, uint32_t imageHeight, VkImageAspectFlags aspectFlag)
 {
-	VkImageMemoryBarrier srcBarrier{};
-	srcBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	const bool isColor = aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT;
+	const VkImageLayout attachmentLayout = isColor ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	const VkPipelineStageFlags2 attachmentStages = isColor ? VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+		: VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+	const VkAccessFlags2 attachmentWrite = isColor ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	const VkAccessFlags2 attachmentAccess = attachmentWrite | (isColor ? VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT : VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT);
+
+	// les deux transitions avant la copie sont regroupees dans une seule barriere
+	VkImageMemoryBarrier2 barriers[2] = {};
+	for (VkImageMemoryBarrier2& barrier : barriers) {
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange = { aspectFlag, 0, 1, 0, 1 };
+	}
+	VkImageMemoryBarrier2& srcBarrier = barriers[0];
 	srcBarrier.image = source;
-	srcBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	srcBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	srcBarrier.subresourceRange.aspectMask = aspectFlag;
-	srcBarrier.subresourceRange.baseArrayLayer = 0;
-	srcBarrier.subresourceRange.layerCount = 1;
-	srcBarrier.subresourceRange.levelCount = 1;
-	srcBarrier.oldLayout = aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	srcBarrier.oldLayout = attachmentLayout;
 	srcBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-	srcBarrier.srcAccessMask = aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-	srcBarrier.dstAccessMask = 0;
-
-	vkCmdPipelineBarrier(commandBuffer,
-		aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
-		, VK_PIPELINE_STAGE_TRANSFER_BIT
-		, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &srcBarrier);
-
-	VkImageMemoryBarrier dstBarrier{};
-	dstBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	srcBarrier.srcStageMask = attachmentStages;
+	srcBarrier.srcAccessMask = attachmentWrite;
+	srcBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	srcBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+	// le contenu precedent de la destination est ignore (UNDEFINED) mais
+	// les lectures d'une frame precedente (fragment shader) doivent etre terminees (WAR)
+	VkImageMemoryBarrier2& dstBarrier = barriers[1];
 	dstBarrier.image = dest;
-	dstBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	dstBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	dstBarrier.subresourceRange.aspectMask = aspectFlag;
-	dstBarrier.subresourceRange.baseArrayLayer = 0;
-	dstBarrier.subresourceRange.layerCount = 1;
-	dstBarrier.subresourceRange.levelCount = 1;
 	dstBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	dstBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	dstBarrier.srcAccessMask = 0;
-	dstBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	dstBarrier.srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	dstBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+	dstBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	dstBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
 
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &dstBarrier);
+	VkDependencyInfo dependencyInfo = {};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.imageMemoryBarrierCount = 2;
+	dependencyInfo.pImageMemoryBarriers = barriers;
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
 
 	VkImageCopy blit = {};
 	blit.srcOffset = { 0, 0, 0 };
@@ -64,88 +68,58 @@ void RenderSurface::CopyImage(VkCommandBuffer commandBuffer, VkImage dest, VkIma
 		dest, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 		1, &blit);
 
+	// la destination est ensuite echantillonnee par le fragment shader
 	dstBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	dstBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	dstBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	dstBarrier.dstAccessMask = 0;
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &dstBarrier);
+	dstBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	dstBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	dstBarrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	dstBarrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
 
+	// la source redevient un attachment : seule la lecture de la copie est a attendre (WAR)
 	srcBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-	srcBarrier.newLayout = aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-	srcBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	srcBarrier.dstAccessMask = aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	srcBarrier.newLayout = attachmentLayout;
+	srcBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	srcBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+	srcBarrier.dstStageMask = attachmentStages;
+	srcBarrier.dstAccessMask = attachmentAccess;
 
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		aspectFlag == VK_IMAGE_ASPECT_COLOR_BIT ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
-		, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &srcBarrier);
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
 }
 
-bool GenerateMipmaps(VkCommandBuffer commandBuffer, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+static bool IsBlockCompressed(PixelFormat pixelFormat)
 {
-	// on suppose une image 2D donc layerCount = 1
-	
-	VkImageMemoryBarrier barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-	barrier.image = image;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
-
-	int32_t mipWidth = texWidth;
-	int32_t mipHeight = texHeight;
-
-	VkImageBlit blit = {};
-	memset(&blit, 0, sizeof VkImageBlit);
-	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	blit.srcSubresource.layerCount = 1;
-	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	blit.dstSubresource.layerCount = 1;
+	return pixelFormat >= PIXFMT_BC1_RGB && pixelFormat <= PIXFMT_BC5;
+}
 
-	for (uint32_t i = 1; i < mipLevels; i++) 
+// octets par bloc : 4x4 texels pour les formats BCn, un texel sinon
+static uint32_t FormatBlockBytes(PixelFormat pixelFormat)
+{
+	switch (pixelFormat)
 	{
-		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-		int32_t newMipWidth = mipWidth > 1 ? mipWidth / 2 : 1;
-		int32_t newMipHeight = mipHeight > 1 ? mipHeight / 2 : 1;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.dstOffsets[1] = { newMipWidth, newMipHeight, 1 };
-		blit.dstSubresource.mipLevel = i;
-
-		mipWidth = newMipWidth;
-		mipHeight = newMipHeight;
-
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-			0, nullptr, 0, nullptr, 1, &barrier);
-
-		vkCmdBlitImage(commandBuffer,
-			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit, VK_FILTER_LINEAR);
-	}
-
-	// dernier level (ou premier level si pas de mipmaps)
-	barrier.subresourceRange.baseMipLevel = mipLevels-1;
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-		0, nullptr, 0, nullptr, 1, &barrier);
+	case PIXFMT_RGBA32F: return 4 * sizeof(float);
+	case PIXFMT_RGB32F: return 3 * sizeof(float);
+	case PIXFMT_RGBA16F: return 4 * sizeof(uint16_t);
+	case PIXFMT_BC1_RGB:
+	case PIXFMT_BC1_SRGB:
+	case PIXFMT_BC4: return 8;
+	case PIXFMT_BC3:
+	case PIXFMT_BC3_SRGB:
+	case PIXFMT_BC5: return 16;
+	default: return 4;
+	}
+}
 
-	return true;
+static uint32_t FormatBlockDim(PixelFormat pixelFormat)
+{
+	return IsBlockCompressed(pixelFormat) ? 4 : 1;
+}
+
+// octets d'une ligne de blocs
+static uint32_t FormatRowPitch(PixelFormat pixelFormat, uint32_t width)
+{
+	const uint32_t dim = FormatBlockDim(pixelFormat);
+	return (width + dim - 1) / dim * FormatBlockBytes(pixelFormat);
 }
 
 bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width, int height, PixelFormat pixelformat, uint32_t mipLevels, ImageUsage usage)
@@ -161,6 +135,12 @@ bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width,
 	case PIXFMT_RGB32F: format = VK_FORMAT_R32G32B32_SFLOAT; break;
 	case PIXFMT_RGBA16F: format = VK_FORMAT_R16G16B16A16_SFLOAT; break;
 	case PIXFMT_SRGBA8: format = VK_FORMAT_R8G8B8A8_SRGB; break;
+	case PIXFMT_BC1_RGB: format = VK_FORMAT_BC1_RGB_UNORM_BLOCK; break;
+	case PIXFMT_BC1_SRGB: format = VK_FORMAT_BC1_RGB_SRGB_BLOCK; break;
+	case PIXFMT_BC3: format = VK_FORMAT_BC3_UNORM_BLOCK; break;
+	case PIXFMT_BC3_SRGB: format = VK_FORMAT_BC3_SRGB_BLOCK; break;
+	case PIXFMT_BC4: format = VK_FORMAT_BC4_UNORM_BLOCK; break;
+	case PIXFMT_BC5: format = VK_FORMAT_BC5_UNORM_BLOCK; break;
 	case PIXFMT_RGBA8:
 	default: format = VK_FORMAT_R8G8B8A8_UNORM; break;
 	}
@@ -169,7 +149,7 @@ bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width,
 	VkImageUsageFlags usageFlags = 0;
 	if (usage & IMAGE_USAGE_TEXTURE) {
 		usageFlags |= VK_IMAGE_USAGE_SAMPLED_BIT;
-		if (mipLevels > 1 || (usage & IMAGE_USAGE_TRANSFER))
+		if (usage & IMAGE_USAGE_TRANSFER)
 			usageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		if (mipLevels > 1 || (usage & IMAGE_USAGE_BITMAP))
 			usageFlags |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
@@ -182,6 +162,10 @@ bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width,
 		if (usage & IMAGE_USAGE_RENDERPASS)
 			usageFlags |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
 	}
+	// TRANSIENT_ATTACHMENT n'est compatible qu'avec des usages d'attachment (ni sampled, ni transfer)
+	const VkImageUsageFlags attachmentUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	if ((usage & IMAGE_USAGE_TRANSIENT) && (usageFlags & ~attachmentUsages) == 0)
+		usageFlags |= rendercontext.transientAttachmentUsage;
 
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -196,7 +180,6 @@ bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width,
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = usageFlags;
-	// | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
 	imageInfo.samples = (VkSampleCountFlagBits)1;//VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
@@ -206,30 +189,18 @@ bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width,
 	}
 
 	{
-		VkMemoryRequirements memRequirements;
-		vkGetImageMemoryRequirements(context.device, image, &memRequirements);
-
-		VkMemoryAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		// LAZILY_ALLOCATED couple a USAGE_TRANSIENT est utile sur mobile pour indiquer
-		// que la zone memoire est volatile / temporaire et qu'elle peut etre utilisee
-		// par toute autre partie du rendering lorsque notre render pass ne dessine pas dedans
-		// sur PC cela ne semble pas supporte par tous les drivers
-		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;//LAZILY_ALLOCATED_BIT;
-		allocInfo.memoryTypeIndex = context.findMemoryType(memRequirements.memoryTypeBits, properties);
-		if (allocInfo.memoryTypeIndex == ~0) {
-			properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-			allocInfo.memoryTypeIndex = context.findMemoryType(memRequirements.memoryTypeBits, properties);
-		}
-		if (vkAllocateMemory(context.device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+		// LAZILY_ALLOCATED couple a USAGE_TRANSIENT est utile sur mobile/integres : la memoire n'est engagee
+		// que si le driver en a besoin (souvent jamais, l'attachment reste en tile memory)
+		// en preference seulement : sur PC aucun memory type ne l'expose en general, on retombe sur DEVICE_LOCAL
+		MemoryCategory category = (usage & (IMAGE_USAGE_RENDERTARGET | IMAGE_USAGE_RENDERPASS)) ? MEMORY_CATEGORY_RENDER_TARGET : MEMORY_CATEGORY_TEXTURE;
+		DeviceMemoryAllocator& allocator = rendercontext.memoryAllocator;
+		bool allocated = (usageFlags & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+			? allocator.AllocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, category, allocation)
+			: allocator.AllocateImage(image, MEMORY_USAGE_GPU_ONLY, category, allocation);
+		if (!allocated) {
 			std::cout << "error: failed to allocate image memory!" << std::endl;
 			return false;
 		}
-		if (vkBindImageMemory(context.device, image, memory, 0) != VK_SUCCESS) {
-			std::cout << "error: failed to bind image memory!" << std::endl;
-			return false;
-		}
 
 		VkImageViewCreateInfo viewInfo = {};
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -252,10 +223,11 @@ bool RenderSurface::CreateSurface(VulkanRenderContext& rendercontext, int width,
 
 void RenderSurface::Destroy(VulkanRenderContext& rendercontext)
 {
-	VulkanDeviceContext& context = *rendercontext.context;
-	vkDestroyImageView(context.device, view, nullptr);
-	vkDestroyImage(context.device, image, nullptr);
-	vkFreeMemory(context.device, memory, nullptr);
+	// l'image peut encore etre lue par les frames en vol
+	rendercontext.deferredDestroy.DestroyImageView(view);
+	rendercontext.deferredDestroy.DestroyImage(image, allocation);
+	view = VK_NULL_HANDLE;
+	image = VK_NULL_HANDLE;
 }
 
 uint32_t LoadImage(const char* filepath, bool sRGB, uint8_t** pixels, int& w, int &h, PixelFormat& pixelFormat)
@@ -284,23 +256,174 @@ uint32_t LoadImage(const char* filepath, bool sRGB, uint8_t** pixels, int& w, in
 	return imageSize;
 }
 
+static PixelFormat Ktx2PixelFormat(uint32_t vkFormat)
+{
+	switch (vkFormat)
+	{
+	case KTX2_FORMAT_R8G8B8A8_UNORM: return PIXFMT_RGBA8;
+	case KTX2_FORMAT_R8G8B8A8_SRGB: return PIXFMT_SRGBA8;
+	case KTX2_FORMAT_BC1_RGB_UNORM: return PIXFMT_BC1_RGB;
+	case KTX2_FORMAT_BC1_RGB_SRGB: return PIXFMT_BC1_SRGB;
+	case KTX2_FORMAT_BC3_UNORM: return PIXFMT_BC3;
+	case KTX2_FORMAT_BC3_SRGB: return PIXFMT_BC3_SRGB;
+	case KTX2_FORMAT_BC4_UNORM: return PIXFMT_BC4;
+	case KTX2_FORMAT_BC5_UNORM: return PIXFMT_BC5;
+	default: return PIXFMT_MAX;
+	}
+}
+
+// texture convertie par tools/texconv : les niveaux sont recopies a la suite, niveau 0 en premier
+// (allocation ArenaMalloc comme stb, liberee par FreeImage), 0 si le fichier n'existe pas ou n'est pas supporte
+static uint32_t LoadKtx2(const char* filepath, uint8_t** pixels, int& w, int& h, PixelFormat& pixelFormat, uint32_t& levelCount)
+{
+	static constexpr uint32_t MAX_LEVELS = 16;
+	*pixels = nullptr;
+	FILE* file = fopen(filepath, "rb");
+	if (file == nullptr)
+		return 0;
+
+	Ktx2Header header;
+	Ktx2Level levels[MAX_LEVELS];
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0
+		&& header.pixelDepth == 0 && header.layerCount <= 1 && header.faceCount == 1 && header.supercompressionScheme == 0
+		&& header.levelCount > 0 && header.levelCount <= MAX_LEVELS && Ktx2PixelFormat(header.vkFormat) != PIXFMT_MAX
+		&& fread(levels, sizeof(Ktx2Level), header.levelCount, file) == header.levelCount;
+
+	uint64_t imageSize = 0;
+	for (uint32_t i = 0; valid && i < header.levelCount; i++)
+	{
+		uint64_t levelSize = Ktx2LevelSize(header.vkFormat, std::max(1u, header.pixelWidth >> i), std::max(1u, header.pixelHeight >> i));
+		valid = levels[i].byteLength == levelSize;
+		imageSize += levelSize;
+	}
+	uint8_t* data = valid ? (uint8_t*)ArenaMalloc((size_t)imageSize) : nullptr;
+	uint8_t* dst = data;
+	for (uint32_t i = 0; data && i < header.levelCount; i++)
+	{
+		if (fseek(file, (long)levels[i].byteOffset, SEEK_SET) != 0 || fread(dst, 1, (size_t)levels[i].byteLength, file) != levels[i].byteLength) {
+			ArenaFree(data);
+			data = nullptr;
+			break;
+		}
+		dst += levels[i].byteLength;
+	}
+	fclose(file);
+
+	if (data == nullptr) {
+		std::cout << "error: invalid or unsupported KTX2 file " << filepath << std::endl;
+		return 0;
+	}
+	*pixels = data;
+	w = header.pixelWidth;
+	h = header.pixelHeight;
+	pixelFormat = Ktx2PixelFormat(header.vkFormat);
+	levelCount = header.levelCount;
+	return (uint32_t)imageSize;
+}
+
 void FreeImage(uint8_t* pixels)
 {
 	stbi_image_free(pixels);
 }
 
+// chaine de mips calculee sur le CPU (MipGenerator), pour les formats non compresses RGBA8/sRGB/RGBA32F
+// allocation ArenaMalloc liberee par FreeImage, nullptr si le format n'est pas supporte ou l'image fait 1x1
+static uint8_t* BuildMipChain(const uint8_t* pixels, int w, int h, PixelFormat pixelFormat, bool normalMap, uint32_t& levelCount)
+{
+	MipSource source;
+	switch (pixelFormat)
+	{
+	case PIXFMT_RGBA8: source = normalMap ? MIP_SOURCE_NORMAL8 : MIP_SOURCE_UNORM8; break;
+	case PIXFMT_SRGBA8: source = normalMap ? MIP_SOURCE_NORMAL8 : MIP_SOURCE_SRGB8; break;
+	case PIXFMT_RGBA32F: source = MIP_SOURCE_FLOAT32; break;
+	default: return nullptr;
+	}
+	const uint32_t chainLevels = MipLevelCount(w, h);
+	if (chainLevels == 1)
+		return nullptr;
+
+	uint8_t* chain = (uint8_t*)ArenaMalloc(MipChainSize(w, h, chainLevels, FormatBlockBytes(pixelFormat)));
+	if (chain == nullptr)
+		return nullptr;
+	GenerateMipChain(pixels, w, h, source, Texture::mipFilter, chain, chainLevels);
+	levelCount = chainLevels;
+	return chain;
+}
+
+// image source, ou sa version KTX2 (meme nom, extension .ktx2) si tools/texconv l'a convertie et que le device supporte BCn
+// la chaine de mips est toujours complete en sortie : lue dans le fichier KTX2, dans le cache disque (cacheFile projete,
+// pixels pointe dedans) ou calculee ici, sur le thread de decodage, puis ajoutee au cache
+static uint32_t LoadTextureFile(const char* filepath, bool sRGB, bool normalMap, uint8_t** pixels, int& w, int& h, PixelFormat& pixelFormat, uint32_t& levelCount, MappedFile& cacheFile)
+{
+	levelCount = 1;
+	if (Texture::rendercontext && Texture::rendercontext->context->textureCompressionBC)
+	{
+		std::string ktxPath = filepath;
+		size_t dot = ktxPath.find_last_of('.');
+		ktxPath = (dot != std::string::npos ? ktxPath.substr(0, dot) : ktxPath) + ".ktx2";
+		if (uint32_t imageSize = LoadKtx2(ktxPath.c_str(), pixels, w, h, pixelFormat, levelCount))
+			return imageSize;
+	}
+
+	// le resultat depend aussi des options de decodage, elles font partie de la cle
+	const uint32_t cacheOptions = (sRGB ? 1u : 0u) | (normalMap ? 2u : 0u) | ((uint32_t)Texture::mipFilter << 8);
+	TextureCacheHeader entry;
+	if (TextureCache::Lookup(filepath, cacheOptions, cacheFile, entry))
+	{
+		// formats non compresses uniquement, taille coherente avec la chaine annoncee
+		const PixelFormat format = (PixelFormat)entry.pixelFormat;
+		if (format <= PIXFMT_RGBA32F && entry.width > 0 && entry.height > 0
+			&& entry.levelCount >= 1 && entry.levelCount <= MipLevelCount(entry.width, entry.height)
+			&& entry.dataSize == MipChainSize(entry.width, entry.height, entry.levelCount, FormatBlockBytes(format)))
+		{
+			*pixels = (uint8_t*)cacheFile.data + sizeof(TextureCacheHeader);
+			w = (int)entry.width;
+			h = (int)entry.height;
+			pixelFormat = format;
+			levelCount = entry.levelCount;
+			return (uint32_t)entry.dataSize;
+		}
+		cacheFile.Close();
+	}
+
+	uint32_t imageSize = LoadImage(filepath, sRGB, pixels, w, h, pixelFormat);
+	if (*pixels == nullptr)
+		return 0;
+	if (uint8_t* chain = BuildMipChain(*pixels, w, h, pixelFormat, normalMap, levelCount)) {
+		FreeImage(*pixels);
+		*pixels = chain;
+		imageSize = (uint32_t)MipChainSize(w, h, levelCount, FormatBlockBytes(pixelFormat));
+	}
+	if (TextureCache::Enabled())
+	{
+		entry = {};
+		entry.options = cacheOptions;
+		entry.pixelFormat = pixelFormat;
+		entry.width = w;
+		entry.height = h;
+		entry.levelCount = levelCount;
+		entry.dataSize = MipChainSize(w, h, levelCount, FormatBlockBytes(pixelFormat));
+		TextureCache::Store(filepath, entry, *pixels);
+	}
+	return imageSize;
+}
+
+void DecodedImage::Release()
+{
+	if (cacheFile.data)
+		cacheFile.Close();
+	else
+		FreeImage(pixels);
+	pixels = nullptr;
+}
+
 uint32_t Texture::CreateTexture(VulkanRenderContext& rendercontext, int w, int h, PixelFormat pixelFormat, uint32_t mipLevels)
 {
 	VulkanDeviceContext& context = *rendercontext.context;
 	RenderSurface::CreateSurface(rendercontext, w, h, pixelFormat, mipLevels, IMAGE_USAGE_TEXTURE | IMAGE_USAGE_BITMAP);
 
-	uint32_t imageSize = w * h;
-	switch (pixelFormat)
-	{
-	case PixelFormat::PIXFMT_RGBA32F: imageSize *= 4 * sizeof(float); break;
-	default:
-		imageSize *= 4;
-	}
+	const uint32_t dim = FormatBlockDim(pixelFormat);
+	uint32_t imageSize = FormatRowPitch(pixelFormat, w) * ((h + dim - 1) / dim);
 
 	VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -320,99 +443,181 @@ uint32_t Texture::CreateTexture(VulkanRenderContext& rendercontext, int w, int h
 	return imageSize;
 }
 
-bool TransferImage(VulkanRenderContext& rendercontext, VkImage image, const uint8_t* pixels, uint32_t imageSize, int w, int h, int mipLevels)
+// levelCount : niveaux fournis a la suite dans pixels (niveau 0 en premier), tous copies tels quels
+bool TransferImage(VulkanRenderContext& rendercontext, VkImage image, const uint8_t* pixels, PixelFormat pixelFormat, int w, int h, int levelCount)
 {
-	// todo: decoupler la copie dans le staging buffer du transfert de l'image
-	Buffer& stagingBuffer = rendercontext.stagingBuffer;
-	memcpy(stagingBuffer.data, pixels, imageSize);
-	// idealement, il faudrait recycler le command buffer de transfert plutot
-	VkCommandBuffer commandBuffer = rendercontext.BeginOneTimeCommandBuffer();
+	// les copies sont enregistrees dans le lot de transfert courant, soumis plus tard (StagingRing::Flush)
+	StagingRing& staging = rendercontext.staging;
+	VkCommandBuffer commandBuffer = staging.CommandBuffer();
 
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	VkImageMemoryBarrier2 barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image = image;
 	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 
-		/*baseLevel*/0, /*levelCount*/(uint32_t)mipLevels, 
+		/*baseLevel*/0, /*levelCount*/(uint32_t)levelCount, 
 		/*baseLayer*/0, /*layerCount*/1 };
 
+	VkDependencyInfo dependencyInfo = {};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.imageMemoryBarrierCount = 1;
+	dependencyInfo.pImageMemoryBarriers = &barrier;
+
+	// image neuve : rien a attendre, le contenu precedent est ignore
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
 	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.srcAccessMask = 0;
-	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-	vkCmdPipelineBarrier(commandBuffer, 
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		0, 0, nullptr, 0, nullptr, 1, &barrier);
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
 
-	VkBufferImageCopy region = {};
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.layerCount = 1;
-	region.imageExtent = { (uint32_t)w, (uint32_t)h, 1 };
-	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image, 
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	if (mipLevels > 1)
+	// une image trop grosse pour l'anneau est copiee par bandes de lignes (de blocs 4x4 pour BCn)
+	const uint32_t blockDim = FormatBlockDim(pixelFormat);
+	for (uint32_t level = 0; level < (uint32_t)levelCount; level++)
 	{
-		GenerateMipmaps(commandBuffer, image, w, h, mipLevels);
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-	}
-	else {
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		const uint32_t levelWidth = std::max(1u, (uint32_t)w >> level);
+		const uint32_t levelHeight = std::max(1u, (uint32_t)h >> level);
+		const uint32_t rowPitch = FormatRowPitch(pixelFormat, levelWidth);
+		const uint32_t rowCount = (levelHeight + blockDim - 1) / blockDim;
+		uint32_t rowsPerChunk = (uint32_t)(staging.MaxChunk() / rowPitch);
+		if (rowsPerChunk == 0) {
+			std::cout << "error: image rows of " << rowPitch << " bytes do not fit in the staging ring" << std::endl;
+			return false;
+		}
+
+		for (uint32_t row = 0; row < rowCount; row += rowsPerChunk)
+		{
+			uint32_t rows = std::min(rowsPerChunk, rowCount - row);
+			VkDeviceSize offset;
+			void* data;
+			// peut soumettre le lot precedent : la transition ci-dessus est deja enregistree, l'ordre est conserve
+			commandBuffer = staging.Allocate((VkDeviceSize)rows * rowPitch, offset, &data);
+			if (commandBuffer == VK_NULL_HANDLE)
+				return false;
+			memcpy(data, pixels + (size_t)row * rowPitch, (size_t)rows * rowPitch);
+
+			VkBufferImageCopy region = {};
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, (int32_t)(row * blockDim), 0 };
+			// la derniere bande d'un format compresse peut s'arreter au milieu d'un bloc (bord de l'image)
+			region.imageExtent = { levelWidth, std::min(rows * blockDim, levelHeight - row * blockDim), 1 };
+			vkCmdCopyBufferToImage(commandBuffer, staging.buffer.buffer, image, 
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		}
+		pixels += (size_t)rowCount * rowPitch;
 	}
 
+	// lecture par les fragment shaders apres la copie
+	// todo: remplacer VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT par un parametre
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	// todo: remplacer VK_PIPELINE_STAGE_FRAGMENT_BIT par un parametre 
-	vkCmdPipelineBarrier(commandBuffer, 
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-		0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	rendercontext.EndOneTimeCommandBuffer(commandBuffer);
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+
+	// queue de transfert dediee : l'image passe a la famille graphics, release ici puis acquire dans le command
+	// buffer graphics du lot. Les deux barrieres decrivent la meme transition de layout, executee une seule fois
+	if (staging.OwnershipTransfer())
+	{
+		barrier.srcQueueFamilyIndex = staging.transferFamily;
+		barrier.dstQueueFamilyIndex = staging.graphicsFamily;
+		// release : la partie destination est ignoree
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier.dstAccessMask = VK_ACCESS_2_NONE;
+		vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+
+		// acquire : la partie source est ignoree, l'ordre avec la copie vient du semaphore entre les deux queues
+		commandBuffer = staging.AcquireCommandBuffer();
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier.srcAccessMask = VK_ACCESS_2_NONE;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	}
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
 
 	return true;
 }
 
 bool TransferBuffer(VulkanRenderContext& rendercontext, VkBuffer buffer, const uint8_t* data, uint32_t dataSize)
 {
-	Buffer& stagingBuffer = rendercontext.stagingBuffer;
-	memcpy(stagingBuffer.data, data, dataSize);
-
-	VkCommandBuffer commandBuffer = rendercontext.BeginOneTimeCommandBuffer();
-
-	VkBufferMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.buffer = buffer;
-	barrier.size = dataSize;
-	barrier.srcAccessMask = 0;
-	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-	// on n'attend rien en particulier jusqu'a commencer les acces en ecriture vers ce buffer
-	VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-	VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-
-	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage,
-		                 0, 0, nullptr, 1, &barrier, 0, nullptr);
-
-	VkBufferCopy region = {};
-	region.size = dataSize;
-	vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffer, 1, &region);
+	StagingRing& staging = rendercontext.staging;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
 
-	// on bloque les acces en lecture depuis les shaders tant que le transfert n'est pas fini
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = 0;
-
-	sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	destinationStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	// pas de barriere avant la copie : le buffer n'est pas encore utilise par le GPU
+	// et l'ecriture de l'anneau par le CPU est rendue visible par le submit du lot
+	for (uint32_t start = 0; start < dataSize; )
+	{
+		uint32_t size = (uint32_t)std::min<VkDeviceSize>(staging.MaxChunk(), dataSize - start);
+		VkDeviceSize offset;
+		void* mapped;
+		commandBuffer = staging.Allocate(size, offset, &mapped);
+		if (commandBuffer == VK_NULL_HANDLE)
+			return false;
+		memcpy(mapped, data + start, size);
+
+		VkBufferCopy region = {};
+		region.srcOffset = offset;
+		region.dstOffset = start;
+		region.size = size;
+		vkCmdCopyBuffer(commandBuffer, staging.buffer.buffer, buffer, 1, &region);
+		start += size;
+	}
+	if (commandBuffer == VK_NULL_HANDLE)
+		return true;
 
-	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage,
-		0, 0, nullptr, 1, &barrier, 0, nullptr);
+	// queue de transfert dediee : le buffer passe a la famille graphics, release ici puis acquire
+	// (avec la barriere ci-dessous) dans le command buffer graphics du lot
+	if (staging.OwnershipTransfer())
+	{
+		VkBufferMemoryBarrier2 ownership = {};
+		ownership.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+		ownership.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		ownership.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		ownership.srcQueueFamilyIndex = staging.transferFamily;
+		ownership.dstQueueFamilyIndex = staging.graphicsFamily;
+		ownership.buffer = buffer;
+		ownership.offset = 0;
+		ownership.size = VK_WHOLE_SIZE;
+
+		VkDependencyInfo dependencyInfo = {};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.bufferMemoryBarrierCount = 1;
+		dependencyInfo.pBufferMemoryBarriers = &ownership;
+		vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+
+		commandBuffer = staging.AcquireCommandBuffer();
+		ownership.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		ownership.srcAccessMask = VK_ACCESS_2_NONE;
+		ownership.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+			| VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		ownership.dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT
+			| VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+		return true;
+	}
 
-	rendercontext.EndOneTimeCommandBuffer(commandBuffer);
+	// l'ecriture doit etre visible des etages qui consomment le buffer (vertex/index, shaders)
+	VkMemoryBarrier2 barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	// (SHADER_STORAGE_WRITE : les SSBOs de la simulation sont reecrits par le compute apres la copie)
+	barrier.dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT
+		| VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+	VkDependencyInfo dependencyInfo = {};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.memoryBarrierCount = 1;
+	dependencyInfo.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
 
 	return true;
 }
@@ -420,8 +625,19 @@ bool TransferBuffer(VulkanRenderContext& rendercontext, VkBuffer buffer, const u
 // ---
 
 VulkanRenderContext* Texture::rendercontext = nullptr;
-std::vector<Texture> Texture::textures;
-std::vector<TextureRef> Texture::textureRefs;
+std::vector<TextureSlot> Texture::slots;
+std::unordered_map<std::string, TextureHandle> Texture::pathToHandle;
+uint32_t Texture::firstFree = TEXTURE_HANDLE_INDEX_MASK;	// TEXTURE_HANDLE_INDEX_MASK = free list vide
+uint32_t Texture::liveCount = 0;
+JobSystem* Texture::decodeJobs = nullptr;
+std::mutex Texture::mutex;
+std::condition_variable Texture::decodedCondition;
+std::vector<DecodedImage> Texture::decoded;
+std::vector<TextureRequest> Texture::deferredDecodes;
+std::vector<UploadingTexture> Texture::uploading;
+uint32_t Texture::decodesInFlight = 0;
+uint32_t Texture::pendingUploads = 0;
+MipFilter Texture::mipFilter = MIP_FILTER_KAISER;
 
 bool Image::Load(const char* filepath, bool sRGB)
 {
@@ -439,55 +655,398 @@ void Image::Destroy() {
 }
 
 
-bool Texture::Load(VulkanRenderContext& rendercontext, const uint8_t* pixels, int w, int h, PixelFormat pixelFormat)
+bool Texture::Load(VulkanRenderContext& rendercontext, const uint8_t* pixels, int w, int h, PixelFormat pixelFormat, uint32_t levelCount)
 {
-	uint32_t mipLevels = (int)log2(w) + 1;
-	uint32_t imageSize = CreateTexture(rendercontext, w, h, pixelFormat, mipLevels);
+	// pixels bruts (LoadTexture(pixels)) : la chaine de mips est calculee ici, sur le thread appelant,
+	// elle ne vit que le temps de la copie dans l'anneau de staging
+	ArenaScope scope(ThreadArena());
+	if (levelCount == 1 && !IsBlockCompressed(pixelFormat)) {
+		if (const uint8_t* chain = BuildMipChain(pixels, w, h, pixelFormat, false, levelCount))
+			pixels = chain;
+	}
+	CreateTexture(rendercontext, w, h, pixelFormat, levelCount);
 
-	TransferImage(rendercontext, image, pixels, imageSize, w, h, mipLevels);
+	TransferImage(rendercontext, image, pixels, pixelFormat, w, h, levelCount);
 
 	return true;
 }
 
-bool Texture::Load(VulkanRenderContext& rendercontext, const char* filepath, bool sRGB)
+bool Texture::Load(VulkanRenderContext& rendercontext, const char* filepath, bool sRGB, bool normalMap)
 {
-	uint8_t* pixels;
-	
-	int w, h;
-	PixelFormat pixelFormat;
-
-	uint32_t imageSize = LoadImage(filepath, sRGB, &pixels, w, h, pixelFormat);
-	Load(rendercontext,pixels, w, h, pixelFormat);
-	FreeImage(pixels);
+	// l'image decodee (et les buffers intermediaires de stb) ne vivent que le temps du transfert
+	ArenaScope scope(ThreadArena());
+	DecodedImage image = DecodeImage(INVALID_TEXTURE_HANDLE, filepath, sRGB, normalMap);
+	if (image.pixels == nullptr)
+		return false;
+	Load(rendercontext, image.pixels, image.width, image.height, image.format, image.levelCount);
+	image.Release();
 
 	return true;
 }
 
-uint32_t Texture::LoadTexture(const char* filepath, bool sRGB)
+// chargement synchrone : le lot de staging ouvert est soumis puis attendu, acquire par la graphics queue compris,
+// la texture est utilisable par le rendu des son enregistrement dans le slot
+static void WaitForUploads(VulkanRenderContext& rendercontext)
 {
+	rendercontext.staging.Flush();
+	rendercontext.staging.Wait(rendercontext.staging.UploadValue());
+}
+
+TextureHandle Texture::FindPath(const char* path)
+{
+	auto it = pathToHandle.find(path);
+	return it != pathToHandle.end() ? it->second : INVALID_TEXTURE_HANDLE;
+}
+
+TextureHandle Texture::AllocateSlot(const Texture& texture, const char* path, bool ready)
+{
+	uint32_t index;
+	if (firstFree != TEXTURE_HANDLE_INDEX_MASK) {
+		index = firstFree;
+		firstFree = slots[index].nextFree;
+	}
+	else {
+		// le dernier index est reserve (free list vide, INVALID_TEXTURE_HANDLE)
+		if (slots.size() >= TEXTURE_HANDLE_INDEX_MASK) {
+			std::cout << "error: texture manager full!" << std::endl;
+			return INVALID_TEXTURE_HANDLE;
+		}
+		index = (uint32_t)slots.size();
+		slots.push_back({});
+		slots[index].generation = 0;
+	}
+
+	TextureSlot& slot = slots[index];
+	slot.texture = texture;
+	slot.path = path ? path : "";
+	slot.refCount = 1;
+	slot.ready = ready;
+	slot.nextFree = TEXTURE_HANDLE_INDEX_MASK;
+	liveCount++;
+
+	TextureHandle handle = MakeHandle(index, slot.generation);
+	if (!slot.path.empty())
+		pathToHandle[slot.path] = handle;
+	return handle;
+}
+
+void Texture::ReleaseSlot(uint32_t index)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// PurgeTextures() a pu vider (ou reremplir) le manager entre temps
+		if (index >= slots.size() || slots[index].refCount != 0)
+			return;
+		slots[index].nextFree = firstFree;
+		firstFree = index;
+	}
+	// plus aucune frame en vol ne lit l'element : il repasse sur la texture par defaut (slot pas pret)
+	// au lieu de garder la vue detruite de l'ancienne texture jusqu'a la reutilisation du slot
+	UpdateTextureTable(index);
+}
+
+TextureHandle Texture::LoadTexture(const char* filepath, bool sRGB, bool normalMap)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		TextureHandle handle = FindPath(filepath);
+		if (handle != INVALID_TEXTURE_HANDLE) {
+			slots[HandleIndex(handle)].refCount++;
+			return handle;
+		}
+	}
+
+	// decodage et transfert hors du verrou
 	Texture tex;
-	tex.Load(*rendercontext, filepath, sRGB);
-	uint32_t id = (uint32_t)textures.size();
-	textures.push_back(tex);
-	textureRefs.push_back({ &textures[id], id, filepath });
-	return id;
+	if (!tex.Load(*rendercontext, filepath, sRGB, normalMap))
+		return INVALID_TEXTURE_HANDLE;
+	WaitForUploads(*rendercontext);
+
+	TextureHandle handle;
+	bool registered = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// le meme chemin a pu etre demande (RequestTexture) entre temps
+		handle = FindPath(filepath);
+		if (handle != INVALID_TEXTURE_HANDLE)
+			slots[HandleIndex(handle)].refCount++;
+		else {
+			handle = AllocateSlot(tex, filepath, true);
+			registered = handle != INVALID_TEXTURE_HANDLE;
+		}
+	}
+	if (!registered) {
+		tex.Destroy(*rendercontext);
+		return handle;
+	}
+	UpdateTextureTable(HandleIndex(handle));
+	return handle;
 }
 
-uint32_t Texture::LoadTexture(const uint8_t* pixels, int w, int h, PixelFormat pixelFormat)
+TextureHandle Texture::LoadTexture(const uint8_t* pixels, int w, int h, PixelFormat pixelFormat)
 {
 	Texture tex;
 	tex.Load(*rendercontext, pixels, w, h, pixelFormat);
-	uint32_t id = (uint32_t)textures.size();
-	textures.push_back(tex);
-	textureRefs.push_back({ &textures[id], id, "" });
-	return id;
+	WaitForUploads(*rendercontext);
+	TextureHandle handle;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		handle = AllocateSlot(tex, nullptr, true);
+	}
+	if (handle == INVALID_TEXTURE_HANDLE) {
+		tex.Destroy(*rendercontext);
+		return handle;
+	}
+	UpdateTextureTable(HandleIndex(handle));
+	return handle;
+}
+
+TextureHandle Texture::RequestTexture(const char* filepath, bool sRGB, bool normalMap)
+{
+	TextureHandle handle;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		handle = FindPath(filepath);
+		if (handle != INVALID_TEXTURE_HANDLE) {
+			slots[HandleIndex(handle)].refCount++;
+			return handle;
+		}
+		// le slot est reserve des maintenant pour que les demandes suivantes du meme chemin le retrouvent,
+		// la texture (et l'element de la table bindless) n'arrivent qu'au transfert
+		handle = AllocateSlot(Texture{}, filepath, false);
+		if (handle == INVALID_TEXTURE_HANDLE)
+			return handle;
+		pendingUploads++;
+		// sans workers, Submit() executerait le decodage sur place, peut-etre dans un ArenaScope de l'appelant
+		// (ParseGLTF) referme avant le transfert : il est differe jusqu'a ProcessPendingUploads()
+		if (decodeJobs == nullptr || decodeJobs->ThreadCount() == 0) {
+			deferredDecodes.push_back({ handle, filepath, sRGB, normalMap });
+			return handle;
+		}
+		decodesInFlight++;
+	}
+
+	std::string path = filepath;
+	decodeJobs->Submit([handle, path, sRGB, normalMap](uint32_t) {
+		// pas d'ArenaScope : les pixels doivent survivre a la tache, ils sont alloues sur le tas
+		// et liberes par le thread de rendu apres le transfert
+		DecodedImage image = DecodeImage(handle, path.c_str(), sRGB, normalMap);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back(image);
+			decodesInFlight--;
+		}
+		decodedCondition.notify_all();
+	});
+	return handle;
+}
+
+DecodedImage Texture::DecodeImage(TextureHandle handle, const char* path, bool sRGB, bool normalMap)
+{
+	DecodedImage image = { handle, nullptr, 0, 0, PIXFMT_RGBA8, 1 };
+	LoadTextureFile(path, sRGB, normalMap, &image.pixels, image.width, image.height, image.format, image.levelCount, image.cacheFile);
+	if (image.pixels == nullptr)
+		std::cout << "error: failed to load image " << path << std::endl;
+	return image;
+}
+
+bool Texture::PublishTexture(TextureHandle handle, Texture& texture, bool loaded)
+{
+	bool stale;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingUploads--;
+		// dechargee pendant le decodage ou le transfert (le slot a meme pu etre reutilise)
+		stale = !IsValidLocked(handle);
+		if (!stale && loaded) {
+			TextureSlot& slot = slots[HandleIndex(handle)];
+			slot.texture = texture;
+			slot.ready = true;
+		}
+	}
+	if (stale) {
+		if (loaded)
+			texture.Destroy(*rendercontext);
+		return false;
+	}
+	// en cas d'echec l'element de la table pointe sur la texture par defaut
+	UpdateTextureTable(HandleIndex(handle));
+	return loaded;
+}
+
+uint32_t Texture::PublishUploads()
+{
+	// lots termines et acquis par la graphics queue (staging.Acquire() dans Begin()) : avant, l'image peut
+	// encore appartenir a la famille transfer, en layout TRANSFER_DST, voire etre en cours de copie
+	uint32_t readyCount = 0;
+	size_t count = 0;
+	while (count < uploading.size() && rendercontext->staging.IsComplete(uploading[count].uploadValue)) {
+		if (PublishTexture(uploading[count].handle, uploading[count].texture, true))
+			readyCount++;
+		count++;
+	}
+	uploading.erase(uploading.begin(), uploading.begin() + count);
+	return readyCount;
+}
+
+uint32_t Texture::ProcessPendingUploads()
+{
+	uint32_t readyCount = PublishUploads();
+
+	// listes temporaires dans l'arena de frame : decoded et deferredDecodes gardent leur capacite,
+	// les demandes suivantes ne repassent pas par le tas
+	MemoryArena& arena = rendercontext->frameArena;
+	ArenaVector<DecodedImage> images{ ArenaAllocator<DecodedImage>(arena) };
+	ArenaVector<TextureRequest> requests{ ArenaAllocator<TextureRequest>(arena) };
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (decoded.empty() && deferredDecodes.empty())
+			return readyCount;
+		images.reserve(decoded.size() + deferredDecodes.size());
+		images.assign(decoded.begin(), decoded.end());
+		requests.assign(std::make_move_iterator(deferredDecodes.begin()), std::make_move_iterator(deferredDecodes.end()));
+		decoded.clear();
+		deferredDecodes.clear();
+	}
+	// decodages differes (pas de workers) : sur ce thread, les pixels sont transferes avant le retour
+	for (const TextureRequest& request : requests)
+		images.push_back(DecodeImage(request.handle, request.path.c_str(), request.sRGB, request.normalMap));
+
+	for (DecodedImage& image : images)
+	{
+		// les copies s'ajoutent au lot courant de l'anneau de staging : toutes les images du lot
+		// partent dans la meme soumission au prochain staging.Flush()
+		Texture tex = {};
+		bool loaded = false;
+		if (image.pixels) {
+			loaded = tex.Load(*rendercontext, image.pixels, image.width, image.height, image.format, image.levelCount);
+			image.Release();
+		}
+		// publiee par un appel suivant, une fois le lot utilisable par le rendu
+		if (loaded)
+			uploading.push_back({ image.handle, tex, rendercontext->staging.UploadValue() });
+		else
+			PublishTexture(image.handle, tex, false);
+	}
+	return readyCount;
+}
+
+void Texture::FinishPendingLoads()
+{
+	for (;;)
+	{
+		// hors de la boucle de rendu (chargement) : pas de Reset() de l'arena de frame entre deux appels
+		{
+			ArenaScope scope(rendercontext->frameArena);
+			ProcessPendingUploads();
+		}
+		// copies en attente : le lot est soumis et attendu (acquire compris), publication au tour suivant
+		if (!uploading.empty()) {
+			rendercontext->staging.Flush();
+			rendercontext->staging.Wait(uploading.back().uploadValue);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (pendingUploads == 0)
+			break;
+		decodedCondition.wait(lock, []() { return !decoded.empty() || !deferredDecodes.empty(); });
+	}
+}
+
+void Texture::UnloadTexture(TextureHandle handle)
+{
+	const uint32_t index = HandleIndex(handle);
+	Texture texture;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!IsValidLocked(handle))
+			return;
+		TextureSlot& slot = slots[index];
+		if (--slot.refCount > 0)
+			return;
+
+		if (!slot.path.empty())
+			pathToHandle.erase(slot.path);
+		slot.path.clear();
+		// les handles existants sont invalides des maintenant
+		slot.generation = (slot.generation + 1) & TEXTURE_HANDLE_GENERATION_MASK;
+		liveCount--;
+
+		// encore en cours de decodage : texture vide, l'image sera ignoree au transfert
+		texture = slot.texture;
+		slot.texture = {};
+		slot.ready = false;
+	}
+
+	texture.Destroy(*rendercontext);
+	// l'element de la table bindless peut encore etre lu par les frames en vol :
+	// le slot n'est recycle (et l'element reecrit) qu'une fois ces frames terminees
+	rendercontext->deferredDestroy.Enqueue([index]() { ReleaseSlot(index); });
+}
+
+bool Texture::IsValidLocked(TextureHandle handle)
+{
+	const uint32_t index = HandleIndex(handle);
+	return index < slots.size() && slots[index].refCount > 0 && slots[index].generation == HandleGeneration(handle);
+}
+
+bool Texture::IsValid(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return IsValidLocked(handle);
+}
+
+bool Texture::IsReady(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return IsValidLocked(handle) && slots[HandleIndex(handle)].ready;
+}
+
+Texture* Texture::Get(TextureHandle handle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return IsValidLocked(handle) ? &slots[HandleIndex(handle)].texture : nullptr;
+}
+
+void Texture::UpdateTextureTable(uint32_t index)
+{
+	if (rendercontext == nullptr || rendercontext->textureTable == VK_NULL_HANDLE)
+		return;
+	if (index >= rendercontext->textureTableSize) {
+		std::cout << "error: texture table full, texture " << index << " not bound!" << std::endl;
+		return;
+	}
+
+	// le set est lie par la frame en vol et par les command buffers pre-enregistres : UPDATE_AFTER_BIND seul
+	// n'autorise l'ecriture qu'avant leur soumission. UPDATE_UNUSED_WHILE_PENDING (+ PARTIALLY_BOUND) permet
+	// d'ecrire pendant leur execution un element qu'ils ne lisent pas : slot libere (reecrit une fois les frames
+	// qui l'utilisaient terminees) ou texture pas encore prete, qu'aucun materiau dessine ne doit referencer avant IsReady()
+	VkDescriptorImageInfo imageInfo;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (index >= slots.size())
+			return;
+		// pas (encore) de texture : texture par defaut (slot 0)
+		const Texture& texture = slots[index].ready ? slots[index].texture : slots[0].texture;
+		imageInfo = { texture.sampler, texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	}
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = rendercontext->textureTable;
+	write.dstBinding = rendercontext->textureTableBinding;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(rendercontext->context->device, 1, &write, 0, nullptr);
 }
 
 
 void Texture::Destroy(VulkanRenderContext& rendercontext)
 {
-	VulkanDeviceContext& context = *rendercontext.context;
-	vkDestroySampler(context.device, sampler, nullptr);
+	rendercontext.deferredDestroy.DestroySampler(sampler);
+	sampler = VK_NULL_HANDLE;
 	RenderSurface::Destroy(rendercontext);
 }
 
@@ -495,14 +1054,21 @@ void Texture::Destroy(VulkanRenderContext& rendercontext)
 
 void Buffer::Destroy(VulkanRenderContext& rendercontext)
 {
-	VkDevice device = rendercontext.context->device;
-	vkDestroyBuffer(device, buffer, nullptr);
-	if (data) {
-		vkUnmapMemory(device, memory);
-		data = nullptr;
-	}
-	if (offset == 0)
-		vkFreeMemory(device, memory, nullptr);
+	// detruit (et memoire rendue) quand plus aucune frame en vol ne peut l'utiliser
+	rendercontext.deferredDestroy.DestroyBuffer(buffer, allocation);
+	buffer = VK_NULL_HANDLE;
+	// le mapping appartient au bloc memoire, pas au buffer
+	data = nullptr;
+}
+
+// categorie de comptabilite memoire d'apres l'usage du buffer
+static MemoryCategory BufferCategory(VkBufferUsageFlags usage)
+{
+	if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+		return MEMORY_CATEGORY_MESH;
+	if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		return MEMORY_CATEGORY_CONSTANTS;
+	return MEMORY_CATEGORY_OTHER;
 }
 
 bool Buffer::CreateBuffer(VulkanRenderContext& rendercontext, Buffer& bo, uint32_t size, VkBufferUsageFlags usage, const void* data, uint32_t dataSize)
@@ -529,23 +1095,33 @@ bool Buffer::CreateBuffer(VulkanRenderContext& rendercontext, Buffer& bo, uint32
 	vkGetBufferMemoryRequirements(context.device, bo.buffer, &bufferMemReq);
 	bo.size = (bufferMemReq.size + bufferMemReq.alignment) & ~(bufferMemReq.alignment - 1);
 
-	VkMemoryAllocateInfo bufferAllocInfo = {};
-	bufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	bufferAllocInfo.allocationSize = bo.size;
 	// ainsi le buffer actuel devra etre USAGE_TRANSFER_DST et copie avec vkCmdCopyBuffer()
-	bufferAllocInfo.memoryTypeIndex = context.findMemoryType(bufferMemReq.memoryTypeBits
-		, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	DEBUG_CHECK_VK(vkAllocateMemory(context.device, &bufferAllocInfo, nullptr, &bo.memory));
-	DEBUG_CHECK_VK(vkBindBufferMemory(context.device, bo.buffer, bo.memory, 0));
+	// (ou ecrit directement si la memoire video est visible du CPU, cf. MEMORY_USAGE_STATIC)
+	if (!rendercontext.memoryAllocator.AllocateBuffer(bo.buffer, data ? MEMORY_USAGE_STATIC : MEMORY_USAGE_GPU_ONLY, BufferCategory(usage), bo.allocation))
+		return false;
 
 	if (data)
-	{
-		// todo: queue pour les copies 
-		TransferBuffer(rendercontext, bo.buffer, (uint8_t*)data, dataSize);
-	}
+		bo.Upload(rendercontext, data, dataSize);
 	return true;
 }
 
+bool Buffer::Upload(VulkanRenderContext& rendercontext, const void* src, uint32_t srcSize, VkDeviceSize dstOffset)
+{
+	// memoire mappee (resizable BAR, memoire unifiee ou repli en RAM systeme) : ecriture directe,
+	// visible du GPU au prochain vkQueueSubmit
+	if (allocation.mapped) {
+		memcpy((uint8_t*)allocation.mapped + dstOffset, src, srcSize);
+		rendercontext.memoryAllocator.Flush(allocation, dstOffset, srcSize);
+		return true;
+	}
+	// sinon copie par l'anneau de staging (le buffer doit etre USAGE_TRANSFER_DST)
+	if (dstOffset != 0) {
+		std::cout << "error: staged buffer uploads start at offset 0" << std::endl;
+		return false;
+	}
+	return TransferBuffer(rendercontext, buffer, (const uint8_t*)src, srcSize);
+}
+
 bool Buffer::CreateMappedBuffer(VulkanRenderContext& rendercontext, Buffer& bo, uint32_t size, VkBufferUsageFlags usage, const void* data)
 {
 	bo.offset = 0;
@@ -566,28 +1142,19 @@ bool Buffer::CreateMappedBuffer(VulkanRenderContext& rendercontext, Buffer& bo,
 	vkGetBufferMemoryRequirements(context.device, bo.buffer, &bufferMemReq);
 	bo.size = (bufferMemReq.size + bufferMemReq.alignment) & ~(bufferMemReq.alignment - 1);
 
-	VkMemoryAllocateInfo bufferAllocInfo = {};
-	bufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	bufferAllocInfo.allocationSize = bo.size;
-	// possible d'eviter de rendre la memoire host visible en passant par un buffer intermediaire
-	// ("staging buffer") qui est lui HOST_VISIBLE|COHERENT et USAGE_TRANSFER_SRC
-	// ainsi le buffer actuel devra etre USAGE_TRANSFER_DST et copie avec vkCmdCopyBuffer()
-	bufferAllocInfo.memoryTypeIndex = context.findMemoryType(bufferMemReq.memoryTypeBits
-		, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-	DEBUG_CHECK_VK(vkAllocateMemory(context.device, &bufferAllocInfo, nullptr, &bo.memory));
-	DEBUG_CHECK_VK(vkBindBufferMemory(context.device, bo.buffer, bo.memory, 0));
-
-	// copie des donnees
-	VkMappedMemoryRange mappedRange = {};
-	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mappedRange.memory = bo.memory;
-	mappedRange.size = VK_WHOLE_SIZE;
-	DEBUG_CHECK_VK(vkMapMemory(context.device, bo.memory, 0, VK_WHOLE_SIZE, 0, &bo.data));
-	DEBUG_CHECK_VK(vkInvalidateMappedMemoryRanges(context.device, 1, &mappedRange));
+	// buffer reecrit par le CPU et lu directement par le GPU : DEVICE_LOCAL|HOST_VISIBLE (BAR) si possible,
+	// sinon HOST_VISIBLE en RAM systeme (aucun GPU n'est oblige d'exposer DEVICE_LOCAL|HOST_VISIBLE)
+	DeviceMemoryAllocator& allocator = rendercontext.memoryAllocator;
+	if (!allocator.AllocateBuffer(bo.buffer, MEMORY_USAGE_STREAM, BufferCategory(usage), bo.allocation))
+		return false;
+
+	// copie des donnees, le bloc est mappe en permanence
+	bo.data = bo.allocation.mapped;
+	allocator.Invalidate(bo.allocation);
 	if (data)
 	{
 		memcpy(bo.data, data, size);
-		DEBUG_CHECK_VK(vkFlushMappedMemoryRanges(context.device, 1, &mappedRange));
+		allocator.Flush(bo.allocation);
 	}
 	return true;
 }
@@ -605,7 +1172,8 @@ bool Buffer::CreateDualBuffer(VulkanRenderContext& rendercontext, Buffer& vbo, B
 	uint32_t queueFamilyIndices[] = { rendercontext.graphicsQueueIndex };
 	bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
 
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	// TRANSFER_DST : remplis par le staging quand la memoire video n'est pas visible du CPU
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	bufferInfo.size = verticesSize;// =requestedSize sizeof(Vertex) * scene.meshes[0].vertices.size();
 
 	//VkDeviceBufferMemoryRequirementsKHR bufferReq{ VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS_KHR };
@@ -619,7 +1187,7 @@ bool Buffer::CreateDualBuffer(VulkanRenderContext& rendercontext, Buffer& vbo, B
 	vbo.size = (bufferMemReq.memoryRequirements.size + bufferMemReq.memoryRequirements.alignment) & ~(bufferMemReq.memoryRequirements.alignment - 1);
 
 	
-	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	bufferInfo.size = indicesSize;// = requestedSize sizeof(uint16_t) * scene.meshes[0].indices.size();
 	DEBUG_CHECK_VK(vkCreateBuffer(context.device, &bufferInfo, nullptr, &ibo.buffer));
 	vkGetBufferMemoryRequirements(context.device, ibo.buffer, &bufferMemReq.memoryRequirements);
@@ -627,37 +1195,28 @@ bool Buffer::CreateDualBuffer(VulkanRenderContext& rendercontext, Buffer& vbo, B
 	// les donnees de l'IBO commencent apres celles du VBO (en tenant compte de l'alignement) 
 	ibo.offset = vbo.size;
 
-	VkMemoryAllocateInfo bufferAllocInfo = {};
-	bufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	// possible d'eviter de rendre la memoire host visible en passant par un buffer intermediaire
-	// ("staging buffer") qui est lui HOST_VISIBLE|COHERENT et USAGE_TRANSFER_SRC
-	// ainsi le buffer actuel devra etre USAGE_TRANSFER_DST et copie avec vkCmdCopyBuffer()
-	bufferAllocInfo.memoryTypeIndex = context.findMemoryType(bufferMemReq.memoryRequirements.memoryTypeBits
-		, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-	bufferAllocInfo.allocationSize = (vbo.size + ibo.size + 0x80) & ~(0x80 - 1);
-	DEBUG_CHECK_VK(vkAllocateMemory(context.device, &bufferAllocInfo, nullptr, &vbo.memory));
-	ibo.memory = vbo.memory;
-	//DEBUG_CHECK_VK(vkBindBufferMemory(context.device, vbo.buffer, vbo.memory, 0));
-	//DEBUG_CHECK_VK(vkBindBufferMemory(context.device, ibo.buffer, ibo.memory, ibo.offset));
+	// geometrie statique : toujours dans le heap video, ecrite directement si le CPU le voit en entier
+	// (resizable BAR, memoire unifiee), sinon par l'anneau de staging. La petite fenetre BAR d'un GPU
+	// sans resizable BAR n'est pas utilisee : elle est reservee aux donnees reecrites a chaque frame
+	// une seule sous-allocation pour les deux buffers, possedee par le VBO (celle de l'IBO reste vide)
+	VkMemoryRequirements dualReq = bufferMemReq.memoryRequirements;
+	dualReq.size = vbo.size + ibo.size;
+	DeviceMemoryAllocator& allocator = rendercontext.memoryAllocator;
+	if (!allocator.Allocate(dualReq, MEMORY_USAGE_STATIC, ALLOCATION_LINEAR, MEMORY_CATEGORY_MESH, vbo.allocation))
+		return false;
+	ibo.allocation = {};
 	VkBindBufferMemoryInfo bindInfos[] = {
-		{VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr, vbo.buffer, vbo.memory, 0},
-		{VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr, ibo.buffer, ibo.memory, ibo.offset}
+		{VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr, vbo.buffer, vbo.allocation.memory, vbo.allocation.offset},
+		{VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr, ibo.buffer, vbo.allocation.memory, vbo.allocation.offset + ibo.offset}
 	};
 	DEBUG_CHECK_VK(vkBindBufferMemory2(context.device, 2, bindInfos));
 
-	// copie des donnees
-	VkMappedMemoryRange mappedRange = {};
-	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mappedRange.memory = vbo.memory;
-	mappedRange.size = VK_WHOLE_SIZE;
-	DEBUG_CHECK_VK(vkMapMemory(context.device, vbo.memory, 0, VK_WHOLE_SIZE, 0, &vbo.data));
-	DEBUG_CHECK_VK(vkInvalidateMappedMemoryRanges(context.device, 1, &mappedRange));
-	memcpy(vbo.data, verticesData, verticesSize);
-	// hack pointeur car j'ai la flemme de creer une variable locale (mais pas de taper ce texte)
-	*((uint8_t**)&vbo.data) += ibo.offset;
-	memcpy(vbo.data, indicesData, indicesSize);
-	DEBUG_CHECK_VK(vkFlushMappedMemoryRanges(context.device, 1, &mappedRange));
-	vkUnmapMemory(context.device, vbo.memory);
+	// copie des donnees, l'IBO partage la memoire (et donc le mapping) du VBO
+	vbo.Upload(rendercontext, verticesData, verticesSize);
+	if (vbo.allocation.mapped)
+		vbo.Upload(rendercontext, indicesData, indicesSize, ibo.offset);
+	else
+		TransferBuffer(rendercontext, ibo.buffer, (const uint8_t*)indicesData, indicesSize);
 	vbo.data = nullptr;
 
 	return true;
@@ -0,0 +1,276 @@
+#include "TextureCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x58455443;		// "CTEX"
+
+std::string TextureCache::directory;
+std::atomic<uint32_t> TextureCache::hits{ 0 };
+std::atomic<uint32_t> TextureCache::misses{ 0 };
+std::atomic<uint64_t> TextureCache::bytesWritten{ 0 };
+
+bool MappedFile::Open(const char* path)
+{
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(fileHandle);
+		return false;
+	}
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (view == nullptr) {
+		if (mappingHandle)
+			CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		return false;
+	}
+	file = fileHandle;
+	mapping = mappingHandle;
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// la projection reste valide apres la fermeture du descripteur
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	size = (size_t)info.st_size;
+#endif
+	data = (const uint8_t*)view;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapping);
+	CloseHandle((HANDLE)file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+// ---
+
+static uint64_t HashBytes(const uint8_t* bytes, size_t size, uint64_t hash)
+{
+	// 8 octets par iteration, le fichier source entier passe par ici quand sa date a change
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	return hash;
+}
+
+static bool HashFile(const char* path, uint64_t& hash)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr)
+		return false;
+	static constexpr size_t BLOCK_SIZE = 64 * 1024;
+	uint8_t block[BLOCK_SIZE];
+	hash = 0xCBF29CE484222325ull;
+	size_t count;
+	while ((count = fread(block, 1, BLOCK_SIZE, file)) > 0)
+		hash = HashBytes(block, count, hash);
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+static bool SourceInfo(const char* path, uint64_t& size, int64_t& time)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path, &info) != 0)
+		return false;
+#else
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return false;
+#endif
+	size = (uint64_t)info.st_size;
+	time = (int64_t)info.st_mtime;
+	return true;
+}
+
+static std::string EntryPath(const char* sourcePath, uint32_t options)
+{
+	uint64_t key = HashBytes((const uint8_t*)sourcePath, strlen(sourcePath), 0xCBF29CE484222325ull);
+	key = HashBytes((const uint8_t*)&options, sizeof(options), key);
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.tex", (unsigned long long)key);
+	return TextureCache::directory + "/" + name;
+}
+
+// ecrit un fichier temporaire propre au processus et au thread puis le renomme : deux processus (ou deux
+// threads) qui produisent la meme entree en meme temps n'ecrivent jamais dans le meme fichier
+static bool WriteEntry(const std::string& path, const TextureCacheHeader& header, const void* data)
+{
+#ifdef _WIN32
+	const unsigned long processId = GetCurrentProcessId();
+#else
+	const unsigned long processId = (unsigned long)getpid();
+#endif
+	const std::string tempPath = path + "." + std::to_string(processId) + "."
+		+ std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == nullptr) {
+		std::cout << "error: failed to write texture cache entry " << tempPath << std::endl;
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(data, 1, (size_t)header.dataSize, file) == header.dataSize;
+	written = fclose(file) == 0 && written;
+	if (!written) {
+		std::cout << "error: failed to write texture cache entry " << tempPath << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed) {
+		// l'ancienne entree est encore projetee (Windows) : elle sera remplacee a un prochain lancement
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	TextureCache::bytesWritten += sizeof(header) + header.dataSize;
+	return true;
+}
+
+// ---
+
+bool TextureCache::Open(const char* cacheDirectory)
+{
+	directory.clear();
+#ifdef _WIN32
+	int result = _mkdir(cacheDirectory);
+#else
+	int result = mkdir(cacheDirectory, 0755);
+#endif
+	struct stat info;
+	if (result != 0 && (stat(cacheDirectory, &info) != 0 || (info.st_mode & S_IFDIR) == 0)) {
+		std::cout << "error: cannot create texture cache directory " << cacheDirectory << ", cache disabled" << std::endl;
+		return false;
+	}
+	directory = cacheDirectory;
+	return true;
+}
+
+bool TextureCache::Lookup(const char* sourcePath, uint32_t options, MappedFile& file, TextureCacheHeader& header)
+{
+	if (directory.empty())
+		return false;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!SourceInfo(sourcePath, sourceSize, sourceTime))
+		return false;
+
+	// l'entete est verifie avant de projeter le fichier
+	const std::string path = EntryPath(sourcePath, options);
+	FILE* entry = fopen(path.c_str(), "rb");
+	if (entry == nullptr) {
+		misses++;
+		return false;
+	}
+	bool valid = fread(&header, sizeof(header), 1, entry) == 1
+		&& header.magic == TEXTURE_CACHE_MAGIC && header.version == TEXTURE_CACHE_VERSION
+		&& header.options == options && header.sourceSize == sourceSize;
+	bool touched = false;
+	if (valid && header.sourceTime != sourceTime)
+	{
+		uint64_t contentHash;
+		valid = HashFile(sourcePath, contentHash) && contentHash == header.contentHash;
+		touched = valid;
+	}
+	fclose(entry);
+
+	valid = valid && file.Open(path.c_str());
+	if (valid && file.size != sizeof(header) + header.dataSize) {
+		// tronque (ecriture interrompue hors du renommage, disque plein...)
+		file.Close();
+		valid = false;
+	}
+	if (!valid) {
+		misses++;
+		return false;
+	}
+	// meme contenu, nouvelle date : l'entree est reecrite (jamais modifiee sur place, un autre processus
+	// peut l'avoir projetee) pour que les lancements suivants ne rehashent pas la source
+	if (touched) {
+		header.sourceTime = sourceTime;
+		WriteEntry(path, header, file.data + sizeof(header));
+	}
+	hits++;
+	return true;
+}
+
+bool TextureCache::Store(const char* sourcePath, const TextureCacheHeader& desc, const void* data)
+{
+	if (directory.empty())
+		return false;
+
+	TextureCacheHeader header = desc;
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.padding = 0;
+	if (!SourceInfo(sourcePath, header.sourceSize, header.sourceTime) || !HashFile(sourcePath, header.contentHash))
+		return false;
+
+	return WriteEntry(EntryPath(sourcePath, header.options), header, data);
+}
+
+void TextureCache::ResetStats()
+{
+	hits = 0;
+	misses = 0;
+	bytesWritten = 0;
+}
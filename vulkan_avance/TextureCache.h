@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// fichier projete en memoire en lecture seule (mmap / MapViewOfFile)
+// copiable, pas de destructeur : Close() explicite une fois les donnees utilisees
+struct MappedFile
+{
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file = nullptr;			// HANDLE
+	void* mapping = nullptr;		// HANDLE
+#endif
+
+	bool Open(const char* path);
+	void Close();
+};
+
+// a incrementer quand le decodage ou la generation des mips change : les anciennes entrees sont ignorees
+static constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+
+struct TextureCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t options;				// options de decodage (sRGB, normal map, filtre des mips), font partie de la cle
+	uint32_t pixelFormat;			// PixelFormat
+	uint64_t sourceSize;
+	int64_t sourceTime;				// date de modification de l'image source
+	uint64_t contentHash;			// hash du fichier source
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t padding;
+	uint64_t dataSize;				// niveaux a la suite apres l'entete, niveau 0 en premier
+};
+static_assert(sizeof(TextureCacheHeader) == 64, "texture cache header must keep the texels 16-byte aligned");
+
+// Cache disque des textures decodees ("texture_cache/" par defaut)
+// Une entree par image source et options de decodage : les texels finaux de tous les niveaux de mip, tels qu'ils
+// sont copies dans l'anneau de staging. Au lancement suivant l'entree est projetee en memoire et copiee directement
+// dans l'anneau : ni decodage stb, ni generation des mips.
+// Le nom de l'entree est un hash du chemin source et des options. Elle est valide si la taille et la date de la
+// source n'ont pas change ; si seule la date a change (fichier touche ou recopie), le hash du contenu decide
+// et l'entree est reecrite avec la nouvelle date. Une entree tronquee ou d'une autre version est ignoree puis reecrite.
+// Une entree n'est jamais modifiee sur place (elle peut etre projetee par un autre processus) : l'ecriture passe par
+// un fichier temporaire propre au processus et au thread, renomme ensuite (comme PipelineCache).
+// Thread-safe : appele depuis les taches de decodage
+struct TextureCache
+{
+	static std::string directory;				// vide : cache desactive
+	static std::atomic<uint32_t> hits;
+	static std::atomic<uint32_t> misses;
+	static std::atomic<uint64_t> bytesWritten;
+
+	// cree le repertoire si besoin, false (cache desactive) en cas d'echec
+	static bool Open(const char* cacheDirectory);
+	static bool Enabled() { return !directory.empty(); }
+
+	// entree valide pour sourcePath : file est projete, les texels commencent a file.data + sizeof(TextureCacheHeader)
+	static bool Lookup(const char* sourcePath, uint32_t options, MappedFile& file, TextureCacheHeader& header);
+	// header : options, pixelFormat, width, height, levelCount et dataSize (le reste est complete ici)
+	static bool Store(const char* sourcePath, const TextureCacheHeader& header, const void* data);
+
+	static void ResetStats();
+};
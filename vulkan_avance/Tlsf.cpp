@@ -0,0 +1,213 @@
+#include "Tlsf.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static uint32_t HighestBit(uint64_t value) { unsigned long index; _BitScanReverse64(&index, value); return index; }
+static uint32_t LowestBit(uint64_t value) { unsigned long index; _BitScanForward64(&index, value); return index; }
+#else
+static uint32_t HighestBit(uint64_t value) { return 63 - __builtin_clzll(value); }
+static uint32_t LowestBit(uint64_t value) { return __builtin_ctzll(value); }
+#endif
+
+// classe (fl, sl) contenant size
+static void Mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+	if (size < TlsfAllocator::SL_COUNT) {
+		fl = 0;
+		sl = (uint32_t)size;
+	}
+	else {
+		uint32_t log2 = HighestBit(size);
+		sl = (uint32_t)(size >> (log2 - TlsfAllocator::SL_BITS)) ^ TlsfAllocator::SL_COUNT;
+		fl = log2 - TlsfAllocator::SL_BITS + 1;
+	}
+}
+
+void TlsfAllocator::Create(uint64_t size)
+{
+	nodes.clear();
+	unusedNodes.clear();
+	flBitmap = 0;
+	for (uint32_t fl = 0; fl < FL_COUNT; fl++) {
+		slBitmap[fl] = 0;
+		for (uint32_t sl = 0; sl < SL_COUNT; sl++)
+			freeLists[fl][sl] = INVALID;
+	}
+
+	capacity = size;
+	usedSize = 0;
+	allocationCount = 0;
+	freeBlockCount = 0;
+
+	uint32_t node = NewNode();
+	nodes[node] = { 0, size, INVALID, INVALID, INVALID, INVALID, true };
+	InsertFree(node);
+}
+
+uint32_t TlsfAllocator::NewNode()
+{
+	if (!unusedNodes.empty()) {
+		uint32_t node = unusedNodes.back();
+		unusedNodes.pop_back();
+		return node;
+	}
+	nodes.push_back({});
+	return (uint32_t)nodes.size() - 1;
+}
+
+void TlsfAllocator::InsertFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	Mapping(nodes[node].size, fl, sl);
+
+	Node& n = nodes[node];
+	n.free = true;
+	n.prevFree = INVALID;
+	n.nextFree = freeLists[fl][sl];
+	if (n.nextFree != INVALID)
+		nodes[n.nextFree].prevFree = node;
+	freeLists[fl][sl] = node;
+
+	flBitmap |= 1ull << fl;
+	slBitmap[fl] |= 1u << sl;
+	freeBlockCount++;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	Mapping(nodes[node].size, fl, sl);
+
+	Node& n = nodes[node];
+	if (n.prevFree != INVALID)
+		nodes[n.prevFree].nextFree = n.nextFree;
+	else
+		freeLists[fl][sl] = n.nextFree;
+	if (n.nextFree != INVALID)
+		nodes[n.nextFree].prevFree = n.prevFree;
+	n.free = false;
+
+	if (freeLists[fl][sl] == INVALID) {
+		slBitmap[fl] &= ~(1u << sl);
+		if (slBitmap[fl] == 0)
+			flBitmap &= ~(1ull << fl);
+	}
+	freeBlockCount--;
+}
+
+uint32_t TlsfAllocator::FindFree(uint64_t size) const
+{
+	// arrondi a la classe superieure : n'importe quel bloc de la liste trouvee convient
+	if (size >= SL_COUNT)
+		size += (1ull << (HighestBit(size) - SL_BITS)) - 1;
+
+	uint32_t fl, sl;
+	Mapping(size, fl, sl);
+	if (fl >= FL_COUNT)
+		return INVALID;
+
+	uint32_t slMap = slBitmap[fl] & (~0u << sl);
+	if (slMap == 0)
+	{
+		uint64_t flMap = fl + 1 < 64 ? flBitmap & (~0ull << (fl + 1)) : 0;
+		if (flMap == 0)
+			return INVALID;
+		fl = LowestBit(flMap);
+		slMap = slBitmap[fl];
+	}
+	sl = LowestBit(slMap);
+	return freeLists[fl][sl];
+}
+
+uint32_t TlsfAllocator::Allocate(uint64_t size, uint64_t alignment, uint64_t& offset)
+{
+	if (size == 0)
+		size = 1;
+	if (alignment == 0)
+		alignment = 1;
+
+	// pire cas de padding inclus dans la recherche
+	uint32_t node = FindFree(size + alignment - 1);
+	if (node == INVALID)
+		return INVALID;
+	RemoveFree(node);
+
+	uint64_t aligned = (nodes[node].offset + alignment - 1) / alignment * alignment;
+	uint64_t padding = aligned - nodes[node].offset;
+	if (padding > 0)
+	{
+		// le voisin precedent n'est jamais libre (fusion systematique), le padding devient un bloc libre
+		uint32_t front = NewNode();
+		Node& n = nodes[node];
+		nodes[front] = { n.offset, padding, n.prevPhysical, node, INVALID, INVALID, true };
+		if (n.prevPhysical != INVALID)
+			nodes[n.prevPhysical].nextPhysical = front;
+		n.prevPhysical = front;
+		n.offset = aligned;
+		n.size -= padding;
+		InsertFree(front);
+	}
+
+	if (nodes[node].size - size >= MIN_SPLIT)
+	{
+		uint32_t back = NewNode();
+		Node& n = nodes[node];
+		nodes[back] = { n.offset + size, n.size - size, node, n.nextPhysical, INVALID, INVALID, true };
+		if (n.nextPhysical != INVALID)
+			nodes[n.nextPhysical].prevPhysical = back;
+		n.nextPhysical = back;
+		n.size = size;
+		InsertFree(back);
+	}
+
+	Node& n = nodes[node];
+	n.free = false;
+	usedSize += n.size;
+	allocationCount++;
+	offset = n.offset;
+	return node;
+}
+
+void TlsfAllocator::Free(uint32_t node)
+{
+	usedSize -= nodes[node].size;
+	allocationCount--;
+
+	// fusion avec les voisins libres
+	uint32_t prev = nodes[node].prevPhysical;
+	if (prev != INVALID && nodes[prev].free)
+	{
+		RemoveFree(prev);
+		nodes[prev].size += nodes[node].size;
+		nodes[prev].nextPhysical = nodes[node].nextPhysical;
+		if (nodes[node].nextPhysical != INVALID)
+			nodes[nodes[node].nextPhysical].prevPhysical = prev;
+		unusedNodes.push_back(node);
+		node = prev;
+	}
+	uint32_t next = nodes[node].nextPhysical;
+	if (next != INVALID && nodes[next].free)
+	{
+		RemoveFree(next);
+		nodes[node].size += nodes[next].size;
+		nodes[node].nextPhysical = nodes[next].nextPhysical;
+		if (nodes[next].nextPhysical != INVALID)
+			nodes[nodes[next].nextPhysical].prevPhysical = node;
+		unusedNodes.push_back(next);
+	}
+
+	InsertFree(node);
+}
+
+uint64_t TlsfAllocator::LargestFreeBlock() const
+{
+	if (flBitmap == 0)
+		return 0;
+	// la plus grande classe non vide contient le plus grand bloc, mais ses blocs n'ont pas tous la meme taille
+	uint32_t fl = HighestBit(flBitmap);
+	uint32_t sl = HighestBit(slBitmap[fl]);
+	uint64_t largest = 0;
+	for (uint32_t node = freeLists[fl][sl]; node != INVALID; node = nodes[node].nextFree)
+		largest = nodes[node].size > largest ? nodes[node].size : largest;
+	return largest;
+}
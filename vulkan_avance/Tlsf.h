@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Allocateur TLSF ("Two-Level Segregated Fit") d'intervalles [offset, offset+size) dans un espace de taille fixe
+// Ne touche jamais a la memoire elle-meme : il gere uniquement des offsets, la memoire Vulkan est dans MemoryAllocator
+// Les blocs libres sont ranges dans des listes par classe de taille : premier niveau = puissance de 2,
+// second niveau = SL_COUNT subdivisions lineaires. Deux bitmaps donnent la premiere liste non vide en O(1)
+// (allocation et liberation en temps constant, fusion immediate des voisins libres)
+struct TlsfAllocator
+{
+	static constexpr uint32_t SL_BITS = 4;
+	static constexpr uint32_t SL_COUNT = 1 << SL_BITS;
+	static constexpr uint32_t FL_COUNT = 40;			// tailles jusqu'a 2^(FL_COUNT + SL_BITS - 1)
+	static constexpr uint32_t INVALID = UINT32_MAX;
+	static constexpr uint64_t MIN_SPLIT = 64;			// un reste plus petit n'est pas decoupe (reste dans l'allocation)
+
+	struct Node
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint32_t prevPhysical, nextPhysical;	// voisins dans l'espace d'adressage
+		uint32_t prevFree, nextFree;			// liste de la classe de taille (si libre)
+		bool free;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> unusedNodes;		// indices de nodes recyclables
+
+	uint64_t flBitmap = 0;
+	uint32_t slBitmap[FL_COUNT] = {};
+	uint32_t freeLists[FL_COUNT][SL_COUNT];
+
+	uint64_t capacity = 0;
+	uint64_t usedSize = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeBlockCount = 0;
+
+	void Create(uint64_t size);
+	// retourne un handle (a passer a Free) ou INVALID si aucun bloc libre ne convient
+	uint32_t Allocate(uint64_t size, uint64_t alignment, uint64_t& offset);
+	void Free(uint32_t node);
+
+	bool IsEmpty() const { return allocationCount == 0; }
+	// plus grand bloc libre : 1 - LargestFreeBlock()/espace libre mesure la fragmentation
+	uint64_t LargestFreeBlock() const;
+
+private:
+	uint32_t NewNode();
+	void InsertFree(uint32_t node);
+	void RemoveFree(uint32_t node);
+	uint32_t FindFree(uint64_t size) const;
+};
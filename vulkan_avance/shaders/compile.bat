@@ -1,8 +1,14 @@
-"%VK_SDK_PATH%/Bin/glslc.exe" mesh.vert -o mesh.vert.spv
-"%VK_SDK_PATH%/Bin/glslc.exe" gotanda.frag -o mesh.frag.spv
-"%VK_SDK_PATH%/Bin/glslc.exe" envmap.vert -o envmap.vert.spv
-"%VK_SDK_PATH%/Bin/glslc.exe" envmap.frag -o envmap.frag.spv
-"%VK_SDK_PATH%/Bin/glslc.exe" Instancing_Test.vert -o Instancing_Test.vert.spv
-"%VK_SDK_PATH%/Bin/glslc.exe" boid.comp -o boid.comp.spv
+"%VK_SDK_PATH%/Bin/glslc.exe" mesh.vert -o mesh.vert.spv || goto error
+"%VK_SDK_PATH%/Bin/glslc.exe" gotanda.frag -o mesh.frag.spv || goto error
+"%VK_SDK_PATH%/Bin/glslc.exe" envmap.vert -o envmap.vert.spv || goto error
+"%VK_SDK_PATH%/Bin/glslc.exe" envmap.frag -o envmap.frag.spv || goto error
+"%VK_SDK_PATH%/Bin/glslc.exe" Instancing_Test.vert -o Instancing_Test.vert.spv || goto error
+"%VK_SDK_PATH%/Bin/glslc.exe" boid.comp -o boid.comp.spv || goto error
 
-pause
\ No newline at end of file
+pause
+exit /b 0
+
+:error
+rem un shader qui ne compile plus fait echouer la compilation (pre-build) au lieu de garder l'ancien .spv
+pause
+exit /b 1
@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 #define PI 3.14159265
 
@@ -10,11 +11,35 @@ layout(location = 3) in vec4 v_tangent;
 layout(location = 4) in vec3 v_eyePosition;
 
 layout(set = 2, binding = 0) uniform sampler2D u_envmap;
-layout(set = 2, binding = 1) uniform sampler2D u_diffuseMap;
-layout(set = 2, binding = 2) uniform sampler2D u_normalMap;
-layout(set = 2, binding = 3) uniform sampler2D u_pbrMap;
-layout(set = 2, binding = 4) uniform sampler2D u_occlusionMap;
-layout(set = 2, binding = 5) uniform sampler2D u_emissiveMap;
+
+// doit correspondre a MaterialData (vk_common.h)
+struct MaterialData
+{
+	vec4 diffuseColor;
+	vec4 emissiveColor;
+	float roughness;
+	float metalness;
+	uint diffuseTexture;
+	uint normalTexture;
+	uint roughnessTexture;
+	uint ambientTexture;
+	uint emissiveTexture;
+	uint padding;
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer Materials {
+	MaterialData materials[];
+};
+
+// table de textures bindless, indexee par les ids du texture manager
+layout(set = 2, binding = 2) uniform sampler2D u_textures[];
+
+layout(push_constant) uniform DrawConstants {
+	uint materialIndex;
+};
+
+// nonuniformEXT : l'index peut varier au sein d'un meme draw (multi-draw, materiau par instance...)
+#define TEXTURE(id, uv) texture(u_textures[nonuniformEXT(id)], uv)
 
 layout(location = 0) out vec4 outColor;
 
@@ -34,8 +59,9 @@ void main()
 	const vec3 L = normalize(vec3(0.0, 0.0, 1.0));
 	
 	// MATERIAU
-	const vec3 albedo = texture(u_diffuseMap, v_uv).rgb; //vec3(1.0, 0.0, 1.0);	// albedo = Cdiff, ici magenta
-	const vec4 pbr = texture(u_pbrMap, v_uv);
+	const MaterialData material = materials[materialIndex];
+	const vec3 albedo = TEXTURE(material.diffuseTexture, v_uv).rgb; //vec3(1.0, 0.0, 1.0);	// albedo = Cdiff, ici magenta
+	const vec4 pbr = TEXTURE(material.roughnessTexture, v_uv);
 
 	const float metallic = pbr.b;					// surface metallique ou pas ?
 	const float perceptual_roughness = pbr.g;
@@ -52,7 +78,10 @@ void main()
 	vec3 T = normalize(v_tangent.xyz);
 	vec3 B = cross(N, T) * v_tangent.w;
 	mat3 TBN = mat3(T, B, N);
-	vec3 normalTS = texture(u_normalMap, v_uv).rgb * 2.0 - 1.0;
+	// seuls X et Y sont lus (normal maps BC5 a deux canaux), Z est reconstruit : la normale est unitaire
+	vec3 normalTS;
+	normalTS.xy = TEXTURE(material.normalTexture, v_uv).rg * 2.0 - 1.0;
+	normalTS.z = sqrt(max(1.0 - dot(normalTS.xy, normalTS.xy), 0.0));
 	N = normalize(TBN * normalTS);
 
 	vec3 V = normalize(v_eyePosition - v_position);
@@ -103,9 +132,9 @@ void main()
 	// final
 	//
 
-	float AO = texture(u_occlusionMap, v_uv).r;
+	float AO = TEXTURE(material.ambientTexture, v_uv).r;
 
-	vec3 emissiveColor = texture(u_emissiveMap, v_uv).rgb;
+	vec3 emissiveColor = TEXTURE(material.emissiveTexture, v_uv).rgb;
 
 	vec3 finalColor = emissiveColor + AO * (directColor + indirectColor);
 
@@ -6,6 +6,20 @@
 
 #include "volk/volk.h"
 
+#include "MemoryAllocator.h"
+#include "MemoryArena.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+
+// hors MSVC (Linux, CI avec un ICD logiciel type lavapipe)
+#if !defined(_MSC_VER)
+#include <csignal>
+#define __debugbreak() raise(SIGTRAP)
+#ifndef _countof
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+#endif
+
 #ifdef _DEBUG
 #define DEBUG_CHECK_VK(x) if (VK_SUCCESS != (x)) { std::cout << (#x) << std::endl; __debugbreak(); }
 #else
@@ -31,6 +45,13 @@ enum PixelFormat
 	PIXFMT_RGBA16F,
 	PIXFMT_RGB32F,
 	PIXFMT_RGBA32F,
+	// blocs 4x4 (BCn), chaine de mips fournie par le fichier (KTX2)
+	PIXFMT_BC1_RGB,
+	PIXFMT_BC1_SRGB,
+	PIXFMT_BC3,
+	PIXFMT_BC3_SRGB,
+	PIXFMT_BC4,
+	PIXFMT_BC5,
 	PIXFMT_DUMMY_ASPECT_DEPTH,
 	PIXFMT_DEPTH32F = PIXFMT_DUMMY_ASPECT_DEPTH,
 	PIXFMT_MAX
@@ -43,7 +64,8 @@ enum ImageUsageBits
 	IMAGE_USAGE_RENDERTARGET = 1 << 2,
 	IMAGE_USAGE_TRANSFER = 1 << 5,
 	IMAGE_USAGE_RENDERPASS = 1 << 6,
-	IMAGE_USAGE_STAGING = 1 << 7
+	IMAGE_USAGE_STAGING = 1 << 7,
+	IMAGE_USAGE_TRANSIENT = 1 << 8		// attachment jamais relu hors de sa render pass (storeOp DONT_CARE)
 };
 typedef uint32_t ImageUsage;
 
@@ -51,6 +73,10 @@ typedef uint32_t ImageUsage;
 #include <fstream>
 #include <vector>
 #include <array>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
 
 struct SwapchainImage
 {
@@ -60,7 +86,7 @@ struct SwapchainImage
 
 struct RenderSurface
 {
-	VkDeviceMemory memory;
+	Allocation allocation;
 	VkImage image;
 	VkImageView view;
 	VkFormat format;
@@ -71,11 +97,39 @@ struct RenderSurface
 	void Destroy(struct VulkanRenderContext& rendercontext);
 };
 
-struct TextureRef
+// handle generationnel du texture manager : index du slot (= element de la table bindless) dans les bits de poids faible,
+// generation du slot dans les bits de poids fort. Un handle dont la texture a ete dechargee n'est plus valide
+// meme si le slot a ete reutilise depuis (la generation a change)
+typedef uint32_t TextureHandle;
+static constexpr uint32_t TEXTURE_HANDLE_INDEX_BITS = 20;
+static constexpr uint32_t TEXTURE_HANDLE_INDEX_MASK = (1u << TEXTURE_HANDLE_INDEX_BITS) - 1;
+static constexpr uint32_t TEXTURE_HANDLE_GENERATION_MASK = (1u << (32 - TEXTURE_HANDLE_INDEX_BITS)) - 1;
+static constexpr TextureHandle INVALID_TEXTURE_HANDLE = ~0u;
+
+struct TextureSlot;
+struct UploadingTexture;
+
+// image decodee par une tache de chargement, en attente de transfert par le thread de rendu
+struct DecodedImage
+{
+	TextureHandle handle;
+	uint8_t* pixels;			// nullptr = echec du decodage
+	int width, height;
+	PixelFormat format;
+	uint32_t levelCount;		// niveaux de mip a la suite dans pixels (KTX2 ou MipGenerator)
+	MappedFile cacheFile;		// projete : pixels pointe dans une entree du cache disque (TextureCache)
+
+	// ferme l'entree du cache ou libere les pixels decodes
+	void Release();
+};
+
+// decodage differe (RequestTexture sans workers)
+struct TextureRequest
 {
-	struct Texture* tex;
-	uint32_t id;
-	const char* name;
+	TextureHandle handle;
+	std::string path;
+	bool sRGB;
+	bool normalMap;
 };
 
 struct Image
@@ -93,26 +147,102 @@ struct Texture : RenderSurface
 	VkSampler sampler;
 
 	//bool GenerateMipmaps(VkCommandBuffer commandBuffer, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
-	bool Load(struct VulkanRenderContext& rendercontext, const char* filepath, bool sRGB = true);
-	bool Load(struct VulkanRenderContext& rendercontext, const uint8_t* pixels, int w, int h, PixelFormat pixelFormat);
+	// normalMap : les mips sont renormalisees (xyz)
+	bool Load(struct VulkanRenderContext& rendercontext, const char* filepath, bool sRGB = true, bool normalMap = false);
+	// levelCount : niveaux de mip a la suite dans pixels (niveau 0 en premier), 1 = chaine calculee sur le CPU (RGBA8/sRGB/RGBA32F)
+	bool Load(struct VulkanRenderContext& rendercontext, const uint8_t* pixels, int w, int h, PixelFormat pixelFormat, uint32_t levelCount = 1);
 	void Destroy(struct VulkanRenderContext& rendercontext);
 	uint32_t CreateTexture(struct VulkanRenderContext& rendercontext, int w, int h, PixelFormat pixelFormat, uint32_t mipLevels);
 
-	// version tres basique d'un texture manager
+	// texture manager : slot map a handles generationnels
+	// les slots sont stockes par valeur (pas de pointeur conserve, la reallocation du vector est sans danger),
+	// les slots liberes sont chaines dans une free list, un chemin deja charge est retrouve en O(1) (table de hachage)
+	// et la texture est partagee (compteur de references)
+	// Chargement en deux etapes : RequestTexture() reserve le slot et confie le decodage au JobSystem,
+	// ProcessPendingUploads() (thread de rendu) cree les images et les transfere par lots dans l'anneau de staging.
+	// Le slot n'est pret (et son element de la table bindless ecrit) qu'une fois le lot utilisable par le rendu
+	// (StagingRing::IsComplete) : avec une queue de transfert dediee, l'acquire n'est soumis qu'un Begin() plus tard.
+	// L'enregistrement (slots, table des chemins, free list) est protege par mutex : RequestTexture() peut etre
+	// appele depuis n'importe quel thread, le reste depuis le thread de rendu uniquement
 	static VulkanRenderContext* rendercontext;
-	static uint32_t LoadTexture(const char* filepath, bool sRGB = true);
-	static uint32_t LoadTexture(const uint8_t* pixels, int w, int h, PixelFormat pixelFormat);
-	static std::vector<TextureRef> textureRefs;
-	static std::vector<Texture> textures;
+	static struct JobSystem* decodeJobs;		// nullptr ou sans workers : decodage differe a ProcessPendingUploads()
+	static std::mutex mutex;
+	static std::condition_variable decodedCondition;
+	static std::vector<DecodedImage> decoded;
+	static std::vector<TextureRequest> deferredDecodes;
+	static std::vector<UploadingTexture> uploading;		// copies enregistrees, par valeur de lot croissante (thread de rendu)
+	static uint32_t decodesInFlight;			// taches de decodage non terminees
+	static uint32_t pendingUploads;				// textures demandees pas encore pretes
+	static MipFilter mipFilter;					// filtre des mips calculees au chargement (--mip-filter)
+	static std::vector<TextureSlot> slots;
+	static std::unordered_map<std::string, TextureHandle> pathToHandle;
+	static uint32_t firstFree;
+	static uint32_t liveCount;
+
+	static uint32_t HandleIndex(TextureHandle handle) { return handle & TEXTURE_HANDLE_INDEX_MASK; }
+	static uint32_t HandleGeneration(TextureHandle handle) { return handle >> TEXTURE_HANDLE_INDEX_BITS; }
+	static TextureHandle MakeHandle(uint32_t index, uint32_t generation) { return (generation << TEXTURE_HANDLE_INDEX_BITS) | index; }
+	// element de la table bindless a utiliser dans les shaders
+	static uint32_t TableIndex(TextureHandle handle) { return HandleIndex(handle); }
+
+	// charge (ou retrouve, et reference une fois de plus) une texture, utilisable au retour (attend la fin du transfert)
+	static TextureHandle LoadTexture(const char* filepath, bool sRGB = true, bool normalMap = false);
+	static TextureHandle LoadTexture(const uint8_t* pixels, int w, int h, PixelFormat pixelFormat);
+	// version asynchrone : le handle est valide tout de suite mais la texture n'est utilisable (IsReady)
+	// qu'apres son transfert, un materiau ne doit pas etre dessine avec avant
+	static TextureHandle RequestTexture(const char* filepath, bool sRGB = true, bool normalMap = false);
+	// transfere les images decodees depuis le dernier appel et publie celles dont le transfert est termine,
+	// retourne le nombre de textures devenues pretes
+	static uint32_t ProcessPendingUploads();
+	// attend la fin de tous les decodages demandes et transfere les images
+	static void FinishPendingLoads();
+	// retire une reference, la texture est detruite et son slot recycle quand plus aucune frame en vol ne l'utilise
+	static void UnloadTexture(TextureHandle handle);
+	static bool IsValid(TextureHandle handle);
+	static bool IsReady(TextureHandle handle);
+	// nullptr si le handle n'est plus valide, pointeur valable jusqu'au prochain LoadTexture/RequestTexture
+	static Texture* Get(TextureHandle handle);
 	static void SetupManager();
-	static uint32_t CheckExist(const char* path);
+	// handle de la texture deja chargee depuis path, INVALID_TEXTURE_HANDLE sinon
+	static TextureHandle CheckExist(const char* path);
+	// ecrit le slot index dans la table bindless (si elle existe deja)
+	static void UpdateTextureTable(uint32_t index);
 	static void PurgeTextures();
+
+private:
+	// appeles mutex verrouille
+	static TextureHandle FindPath(const char* path);
+	static TextureHandle AllocateSlot(const Texture& texture, const char* path, bool ready);
+	static bool IsValidLocked(TextureHandle handle);
+	static void ReleaseSlot(uint32_t index);
+	static DecodedImage DecodeImage(TextureHandle handle, const char* path, bool sRGB, bool normalMap);
+	// slot pret (si loaded) et element de la table ecrit, false si la texture n'est pas utilisable
+	static bool PublishTexture(TextureHandle handle, Texture& texture, bool loaded);
+	static uint32_t PublishUploads();
+};
+
+struct TextureSlot
+{
+	Texture texture;
+	std::string path;			// vide pour une texture creee depuis des pixels
+	uint32_t generation;
+	uint32_t refCount;			// 0 = slot libre (ou en attente de recyclage)
+	bool ready;					// false : decodage ou transfert en cours (RequestTexture)
+	uint32_t nextFree;
+};
+
+// texture dont la copie est enregistree dans un lot de staging, en attente de publication
+struct UploadingTexture
+{
+	TextureHandle handle;
+	Texture texture;
+	uint64_t uploadValue;		// StagingRing::UploadValue() a l'enregistrement de la copie
 };
 
 struct Buffer
 {
 	VkBuffer buffer;
-	VkDeviceMemory memory;
+	Allocation allocation;	// vide pour un buffer qui partage la memoire d'un autre (IBO de CreateDualBuffer)
 	VkDeviceSize size;
 	void* data;	// != nullptr => persistent
 				// optionnels
@@ -123,6 +253,8 @@ struct Buffer
 	static bool CreateBuffer(struct VulkanRenderContext& rendercontext, Buffer& bo, uint32_t size, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, const void* data = nullptr, uint32_t dataSize = 0);
 	static bool CreateMappedBuffer(struct VulkanRenderContext& rendercontext, Buffer& bo, uint32_t size, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, const void* data = nullptr);
 	static bool CreateDualBuffer(struct VulkanRenderContext& rendercontext, Buffer& vbo, Buffer& ibo, uint32_t verticesSize, const void* verticesData, uint32_t indicesSize, const void* indicesData);
+	// ecrit src a dstOffset : directement si la memoire est mappee, sinon par le staging (dstOffset = 0 seulement)
+	bool Upload(struct VulkanRenderContext& rendercontext, const void* src, uint32_t srcSize, VkDeviceSize dstOffset = 0);
 	void Destroy(struct VulkanRenderContext& rendercontext);
 };
 
@@ -140,13 +272,28 @@ struct Material
 	glm::vec3 emissiveColor;
 	float roughness;	// perceptual
 	float metalness;
+	TextureHandle diffuseTexture;
+	TextureHandle normalTexture;
+	TextureHandle roughnessTexture;
+	TextureHandle ambientTexture;
+	TextureHandle emissiveTexture;
+
+	static Material defaultMaterial;
+};
+
+// version GPU d'un Material (std430), les textures sont des indices dans la table bindless
+struct MaterialData
+{
+	glm::vec4 diffuseColor;		// rgb
+	glm::vec4 emissiveColor;	// rgb
+	float roughness;
+	float metalness;
 	uint32_t diffuseTexture;
 	uint32_t normalTexture;
 	uint32_t roughnessTexture;
 	uint32_t ambientTexture;
 	uint32_t emissiveTexture;
-
-	static Material defaultMaterial;
+	uint32_t padding;
 };
 
 
@@ -159,6 +306,7 @@ struct Mesh
 	};
 	uint32_t vertexCount;
 	uint32_t indexCount;
+	uint32_t materialIndex = 0;	// index dans le SSBO des materiaux (push constant au draw)
 	Buffer staticBuffers[BufferType::BO_MAX];
 
 	static bool ParseGLTF(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, Material& material, const char* filepath);
@@ -166,8 +314,7 @@ struct Mesh
 
 
 enum RenderTarget {
-	SWAPCHAIN = 0,
-	//COLOR,
+	COLOR = 0,		// color buffer hors ecran (taille de rendu variable), recopie ensuite dans la swapchain
 	DEPTH,
 	RT_MAX
 };
@@ -8,10 +8,17 @@
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 
+#include <chrono>
+#include <cstring>
+
 #define APP_NAME "Vulkan_Avance"
 
 #define INSTANCE_COUNT 300
 
+// taille max du SSBO des materiaux et de la table de textures bindless
+#define MAX_MATERIALS 256
+#define MAX_BINDLESS_TEXTURES 4096
+
 #define RUN_COMPUTE
 
 //
@@ -22,31 +29,30 @@ enum MatrixBufferUsageType
 	MATRIXBUFFER_COUNT
 };
 
-enum MaterialTextureType
+// bindings du set SHARED
+// les textures des materiaux ne sont plus des bindings fixes mais des indices dans TEXTURETABLE
+enum SharedBindingType
 {
 	ENVMAP = 0,
-	ALBEDOMAP = 1,
-	NORMALMAP = 2,
-	PBRMAP = 3,
-	OCCLUSIONMAP = 4,
-	EMISSIVEMAP = 5,
-	MATERIALTEXTURE_COUNT
+	MATERIALS = 1,		// SSBO de MaterialData
+	TEXTURETABLE = 2,	// sampler2D[] de taille variable, indexe par l'id du texture manager
+	SHAREDBINDING_COUNT
 };
 
 // frequence d'usage de chacun des descriptor sets
-// peu de difference en pratique entre dynamic et perframe (dynamic = buffer circulaire par ex.)
 // l'index correspond au numero du set
+// aucun set n'est duplique par frame :
+// - DYNAMIC est un push descriptor set (VK_KHR_push_descriptor), ecrit directement dans le command buffer
+// - PERFRAME pointe sur le frameAllocator, seul l'offset dynamique change d'une frame a l'autre
+// (un seul push descriptor set autorise par pipeline layout, d'ou l'UBO dynamique pour PERFRAME)
 enum DescriptorSetType
 {
 	DYNAMIC = 0,
 	PERFRAME = 1,
-	SHARED = 2,		// pas duplique entre les frames
+	SHARED = 2,
 	DESCRIPTORSET_COUNT
 };
 
-static constexpr uint32_t DescriptorSetsDuplicatedCount = 2;
-static constexpr uint32_t DescriptorSetsSharedCount = 1;
-
 struct InstanceData
 {
 	glm::mat4 world;
@@ -83,18 +89,7 @@ struct SceneMatrices
 	// Instance data
 	glm::mat4 world;
 
-	// Partie GPU ---
-	Buffer constantBuffers[MATRIXBUFFER_COUNT];
-};
-
-// Resources d'une frame GPU qu'on associe a un command buffer principal
-struct Frame
-{
-	// Un DescriptorSet ne peut pas etre update ou utilise par un command buffer
-	// alors qu'il est "bind" par un autre command buffer
-	// On va donc avoir des descriptorSets par frame/main_command_buffer
-	VkDescriptorSet descriptorSet[DescriptorSetsDuplicatedCount];
-	VkDescriptorSet computeDescriptorSet;
+	// Partie GPU --- alloue chaque frame dans rendercontext.frameAllocator
 };
 
 struct Scene
@@ -109,24 +104,31 @@ struct Scene
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSetLayout descriptorSetLayout[DESCRIPTORSET_COUNT]; // todo encapsuler si destructeur
 
-	// on duplique ...
-	Frame frameData[VulkanRenderContext::PENDING_FRAMES];
-	// ...sauf ce qui est partage
+	// Un DescriptorSet ne peut pas etre update alors qu'il est utilise par un command buffer en vol
+	// les bindings qui changent par frame (instances, buffers du compute) sont donc "pushes" a l'enregistrement
+	// et les sets restants ne sont jamais reecrits apres Prepare()
+	VkDescriptorSet globalDescriptorSet;
 	VkDescriptorSet sharedDescriptorSet;
 
+	// materiaux de la scene cote GPU, le draw ne donne que l'index (push constant)
+	Buffer materialSSBO;
+
+	// offsets des constantes de la frame courante dans le frameAllocator
+	// allocations dans le meme ordre chaque frame => offsets identiques pour un meme index de frame
+	uint32_t globalOffset = 0;
+	uint32_t simParamsOffset = 0;
+
 	std::vector<InstanceData> cpuInstances;
 	Buffer instanceSSBO[VulkanRenderContext::PENDING_FRAMES];
 	uint32_t instanceCount = 0;
 
 	VkDescriptorSetLayout computeDescriptorSetLayout;
 	VkPipelineLayout computePipelineLayout;
-	VkPipeline computePipeline;
 
 	std::vector<BoidVelocity> cpuVelocities;
 	Buffer velocitySSBO[VulkanRenderContext::PENDING_FRAMES];
 
 	SimulationParams simParams;
-	Buffer simParamsUBO[VulkanRenderContext::PENDING_FRAMES];
 };
 
 // juste parceque j'ai la flemme de faire des headers 
@@ -181,18 +183,57 @@ bool VulkanGraphicsApplication::Prepare()
 		DEBUG_CHECK_VK(vkAllocateCommandBuffers(context.device, &cmdAllocInfo, &rendercontext.mainCommandBuffers[i]));
 	}
 
+	// enregistrement parallele : les workers enregistrent des secondary command buffers
+	// qui sont ensuite "cousus" dans le command buffer principal par vkCmdExecuteCommands()
+	if (recordThreadCount != 1)
+		jobs.Create(recordThreadCount);
+	rendercontext.recordSlotCount = jobs.ThreadCount();
+	if (rendercontext.recordSlotCount > rendercontext.MAX_RECORD_SLOTS)
+		rendercontext.recordSlotCount = rendercontext.MAX_RECORD_SLOTS;
+
+	cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	for (uint32_t i = 0; i < rendercontext.PENDING_FRAMES; i++)
+	{
+		for (uint32_t slot = 0; slot < rendercontext.recordSlotCount; slot++)
+		{
+			DEBUG_CHECK_VK(vkCreateCommandPool(context.device, &cmdPoolCreateInfo, nullptr, &rendercontext.recordCommandPools[i][slot]));
+			cmdAllocInfo.commandPool = rendercontext.recordCommandPools[i][slot];
+			DEBUG_CHECK_VK(vkAllocateCommandBuffers(context.device, &cmdAllocInfo, &rendercontext.recordCommandBuffers[i][slot]));
+		}
+	}
+
+	// command buffers pre-enregistres : un par frame et par image de la swapchain
+	// (l'image cible est fixee dans vkCmdBeginRenderPass), reset individuellement a la reecriture
+	if (cacheCommandBuffers)
+	{
+		cmdPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		cmdAllocInfo.commandBufferCount = context.SWAPCHAIN_IMAGES;
+		for (uint32_t i = 0; i < rendercontext.PENDING_FRAMES; i++)
+		{
+			DEBUG_CHECK_VK(vkCreateCommandPool(context.device, &cmdPoolCreateInfo, nullptr, &rendercontext.cachedCommandPool[i]));
+			cmdAllocInfo.commandPool = rendercontext.cachedCommandPool[i];
+			DEBUG_CHECK_VK(vkAllocateCommandBuffers(context.device, &cmdAllocInfo, rendercontext.cachedCommandBuffers[i]));
+		}
+		cmdAllocInfo.commandBufferCount = 1;
+		cmdPoolCreateInfo.flags = 0;
+	}
+	sceneDirty = true;
+
 	rendercontext.context = &context;
 
 	// 2. creer la render pass
 
-	// creation d'une render surface pour le depth buffer
+	// le depth buffer est une image transiente du render graph (cf BuildFrameGraph)
 	// on va donc avoir un second attachment mais de type depth/stencil
 	// le depth buffer n'est utilise qu'en lecture/ecriture dans la passe principale
 	// il est important de le clear en debut de passe mais inutile de conserver son contenu
 	// Par contre, dans le cas ou un effet a besoin d'acceder au depth buffer, 
 	// il faut alors specifier STORE_OP_STORE pour le champ storeOp du depth attachment
-	colorBuffer.CreateSurface(rendercontext, context.swapchainExtent.width, context.swapchainExtent.height, PIXFMT_SRGBA8, 1, IMAGE_USAGE_RENDERTARGET | IMAGE_USAGE_TEXTURE);
-	depthBuffer.CreateSurface(rendercontext, context.swapchainExtent.width, context.swapchainExtent.height, PIXFMT_DEPTH32F, 1, IMAGE_USAGE_RENDERTARGET);
+	// la passe principale dessine dans un color buffer hors ecran (lui aussi transient) a resolution variable
+	// recopie ensuite dans la swapchain : son format est donc independant de celui de la surface
+	const VkFormat colorFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	const VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
 
 	// 2.a configurer les attachments
 	VkAttachmentDescription attachments[2];
@@ -203,17 +244,20 @@ bool VulkanGraphicsApplication::Prepare()
 		attachments[id].storeOp = VK_ATTACHMENT_STORE_OP_STORE;// ou DONT_CARE;
 		attachments[id].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachments[id].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		attachments[id].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	}
-	attachments[RenderTarget::SWAPCHAIN].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	attachments[RenderTarget::SWAPCHAIN].format = context.surfaceFormat.format;
+	// les transitions de layout (et la synchro avec l'acquire) sont faites par le render graph
+	// la render pass trouve et laisse donc ses attachments dans leur layout d'attachment
+	attachments[RenderTarget::COLOR].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[RenderTarget::COLOR].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[RenderTarget::COLOR].format = colorFormat;
+	attachments[RenderTarget::DEPTH].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	attachments[RenderTarget::DEPTH].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-	attachments[RenderTarget::DEPTH].format = depthBuffer.format;
+	attachments[RenderTarget::DEPTH].format = depthFormat;
 	attachments[RenderTarget::DEPTH].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
 	VkAttachmentReference references[2];
-	uint32_t id = RenderTarget::SWAPCHAIN;
-	references[id].attachment = RenderTarget::SWAPCHAIN;
+	uint32_t id = RenderTarget::COLOR;
+	references[id].attachment = RenderTarget::COLOR;
 	references[id].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	id = RenderTarget::DEPTH;
 	references[id].attachment = RenderTarget::DEPTH;
@@ -237,15 +281,8 @@ bool VulkanGraphicsApplication::Prepare()
 	renderPassCreateInfo.pAttachments = attachments;
 	renderPassCreateInfo.subpassCount = 1;
 	renderPassCreateInfo.pSubpasses = subpasses;
-	VkSubpassDependency depInfo = {};
-	depInfo.srcSubpass = VK_SUBPASS_EXTERNAL;
-	depInfo.dstSubpass = 0;
-	depInfo.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	depInfo.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	depInfo.srcAccessMask = VK_ACCESS_NONE;
-	depInfo.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	renderPassCreateInfo.dependencyCount = 1;
-	renderPassCreateInfo.pDependencies = &depInfo;
+	// pas de dependance externe : les barrieres avant/apres la passe sont emises par le render graph
+	renderPassCreateInfo.dependencyCount = 0;
 	DEBUG_CHECK_VK(vkCreateRenderPass(context.device, &renderPassCreateInfo, nullptr, &rendercontext.renderPass));
 
 	// 1. recuperer les image views correspondant aux images de la swap chain
@@ -260,17 +297,18 @@ bool VulkanGraphicsApplication::Prepare()
 
 	// 3. creer le framebuffer
 	VkFramebufferAttachmentImageInfo fbAttachImageInfo[2] = {};
-	VkFormat viewFormats[] = { context.surfaceFormat.format };
+	// les usages doivent etre identiques a ceux des images transientes declarees dans BuildFrameGraph
+	VkFormat viewFormats[] = { colorFormat };
 	fbAttachImageInfo[0].sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO;
-	fbAttachImageInfo[0].usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	fbAttachImageInfo[0].usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 	fbAttachImageInfo[0].width = context.swapchainExtent.width;
 	fbAttachImageInfo[0].height = context.swapchainExtent.height;
 	fbAttachImageInfo[0].layerCount = 1;
 	fbAttachImageInfo[0].pViewFormats = viewFormats;
 	fbAttachImageInfo[0].viewFormatCount = 1;
-	VkFormat depthviewFormats[] = { depthBuffer.format };
+	VkFormat depthviewFormats[] = { depthFormat };
 	fbAttachImageInfo[1].sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO;
-	fbAttachImageInfo[1].usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	fbAttachImageInfo[1].usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | rendercontext.transientAttachmentUsage;
 	fbAttachImageInfo[1].width = context.swapchainExtent.width;
 	fbAttachImageInfo[1].height = context.swapchainExtent.height;
 	fbAttachImageInfo[1].layerCount = 1;
@@ -292,45 +330,62 @@ bool VulkanGraphicsApplication::Prepare()
 	fbCreateInfo.pNext = &fbAttachsCreateInfo;
 	fbCreateInfo.attachmentCount = 2;
 
-	VkImageView framebufferAttachments[2] = { nullptr, depthBuffer.view };
-
 	for (uint32_t i = 0; i < context.swapchainImageCount; i++) {
+		// les render surfaces du mode headless ont deja leur view
+		if (headless) {
+			context.swapchainImages[i].view = offscreenTargets[i].view;
+			continue;
+		}
 		viewCreateInfo.image = context.swapchainImages[i].image;
 		DEBUG_CHECK_VK(vkCreateImageView(context.device, &viewCreateInfo, nullptr, &context.swapchainImages[i].view));
 	}
 	DEBUG_CHECK_VK(vkCreateFramebuffer(context.device, &fbCreateInfo, nullptr, &context.framebuffer));
 
-	// Staging buffer
-
-	// On cree un staging buffer "global" pour charger un maximum de ressources (essentiellement statiques)
-	Buffer& stagingBuffer = rendercontext.stagingBuffer;
-	memset(&stagingBuffer, 0, sizeof(Buffer));
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = 4096 * 4096 * 4 * sizeof(float);	// maximum 1 texture RGBA32F en 4k = 256Mio
-	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	stagingBuffer.size = bufferInfo.size;
-	stagingBuffer.usage = bufferInfo.usage;
-	DEBUG_CHECK_VK(vkCreateBuffer(context.device, &bufferInfo, nullptr, &stagingBuffer.buffer));
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(context.device, stagingBuffer.buffer, &memRequirements);
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = context.findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	DEBUG_CHECK_VK(vkAllocateMemory(context.device, &allocInfo, nullptr, &stagingBuffer.memory));
-	DEBUG_CHECK_VK(vkBindBufferMemory(context.device, stagingBuffer.buffer, stagingBuffer.memory, 0));
-	DEBUG_CHECK_VK(vkMapMemory(context.device, stagingBuffer.memory, 0, VK_WHOLE_SIZE, 0, &stagingBuffer.data));
-
-	std::array<VkDescriptorPoolSize, 4> poolSizes;
-	poolSizes[0] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (MATRIXBUFFER_COUNT + 1) * rendercontext.PENDING_FRAMES };
-	poolSizes[1] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6 };
-	poolSizes[2] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (MATRIXBUFFER_COUNT + 4) * rendercontext.PENDING_FRAMES };
-	poolSizes[3] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * rendercontext.PENDING_FRAMES };
+	// resolution dynamique : temps GPU mesure par 2 timestamps par frame
+	if (rendercontext.timestampValidBits > 0 && context.props.limits.timestampComputeAndGraphics)
+	{
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2 * rendercontext.PENDING_FRAMES;
+		DEBUG_CHECK_VK(vkCreateQueryPool(context.device, &queryPoolInfo, nullptr, &rendercontext.timestampPool));
+	}
+	else {
+		std::cout << "warning: no timestamp support, dynamic resolution disabled" << std::endl;
+		gpuBudgetMs = 0.f;
+	}
+	resolution.Create(context.swapchainExtent.width, context.swapchainExtent.height, gpuBudgetMs, renderScale);
+	m_renderExtent = { resolution.width, resolution.height };
+
+	// Staging
+
+	// anneau de staging partage par tous les chargements : les copies sont regroupees en quelques lots
+	// (une texture RGBA32F 4k = 256Mio passe par bandes de lignes)
+	if (!rendercontext.staging.Create(rendercontext, 64ull << 20))
+		return false;
+
+	// Constantes par frame : un buffer circulaire persistant, une region par frame en cours
+	// (view/projection, parametres de simulation, plus tard des donnees par draw)
+	if (!rendercontext.frameAllocator.Create(rendercontext, 256 * 1024, rendercontext.PENDING_FRAMES))
+		return false;
+	rendercontext.frameArena.Create(256 * 1024, "frame");
+
+	// table de textures bindless, bornee par les limites update-after-bind du device
+	uint32_t textureTableSize = MAX_BINDLESS_TEXTURES;
+	if (context.maxBindlessTextures > 0 && context.maxBindlessTextures - 1 < textureTableSize)
+		textureTableSize = context.maxBindlessTextures - 1; // -1 pour l'envmap du meme set
+
+	// les push descriptors ne consomment rien dans le pool, il ne reste que les sets PERFRAME et SHARED
+	std::array<VkDescriptorPoolSize, 3> poolSizes;
+	poolSizes[0] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 };
+	poolSizes[1] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + textureTableSize };
+	poolSizes[2] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 };
 
 	VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
 	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolInfo.maxSets = (MATRIXBUFFER_COUNT + 4) * rendercontext.PENDING_FRAMES;
+	// requis pour allouer un set dont le layout est UPDATE_AFTER_BIND_POOL
+	descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	descriptorPoolInfo.maxSets = DESCRIPTORSET_COUNT - 1;
 	descriptorPoolInfo.poolSizeCount = poolSizes.size();
 	descriptorPoolInfo.pPoolSizes = poolSizes.data();
 	DEBUG_CHECK_VK(vkCreateDescriptorPool(context.device, &descriptorPoolInfo, nullptr, &scene.descriptorPool));
@@ -338,12 +393,12 @@ bool VulkanGraphicsApplication::Prepare()
 	int sceneSetCount = 0;
 	int sceneSetBindingsCount[16];
 	// layout : on doit decrire le format de chaque descriptor (binding, type, array count, stage)
-	VkDescriptorSetLayoutBinding sceneSetBindings[MATRIXBUFFER_COUNT /*UBO*/ + MATERIALTEXTURE_COUNT /*SAMPLER*/];
+	VkDescriptorSetLayoutBinding sceneSetBindings[MATRIXBUFFER_COUNT /*SSBO+UBO*/ + SHAREDBINDING_COUNT];
 	//
 	VkDescriptorSetLayoutCreateInfo sceneSetInfo = {};
 	sceneSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 
-	// set 0
+	// set 0 (push descriptor)
 	sceneSetBindingsCount[sceneSetCount] = 0;
 	sceneSetBindings[0] = { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
 	sceneSetBindingsCount[sceneSetCount]++;
@@ -351,26 +406,44 @@ bool VulkanGraphicsApplication::Prepare()
 
 	// set 1
 	sceneSetBindingsCount[sceneSetCount] = 0;
-	sceneSetBindings[1] = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+	// offset dynamique dans le frameAllocator
+	sceneSetBindings[1] = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
 	sceneSetBindingsCount[sceneSetCount]++;
 	++sceneSetCount;
 
-	uint32_t frameSetCount = sceneSetCount;
-	// set 2
+	// set 2 : envmap, materiaux et table de textures (toujours le dernier binding, taille variable)
 	sceneSetBindingsCount[sceneSetCount] = 0;
-	for (uint32_t i = 0; i < MATERIALTEXTURE_COUNT; i++) {
-		sceneSetBindings[i + 2] = { i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
-		sceneSetBindingsCount[sceneSetCount]++;
-	}
+	sceneSetBindings[2 + ENVMAP] = { ENVMAP, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	sceneSetBindings[2 + MATERIALS] = { MATERIALS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	sceneSetBindings[2 + TEXTURETABLE] = { TEXTURETABLE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureTableSize, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr };
+	sceneSetBindingsCount[sceneSetCount] += SHAREDBINDING_COUNT;
 	++sceneSetCount;
 
-	uint32_t commonSets = sceneSetCount - frameSetCount;
+	// seule la table est "bindless" : partiellement remplie, taille fixee a l'allocation, mise a jour apres le bind
+	// et pendant l'execution des command buffers qui l'utilisent (elements qu'ils ne lisent pas, cf. Texture::UpdateTextureTable)
+	VkDescriptorBindingFlags sharedBindingFlags[SHAREDBINDING_COUNT] = { 0, 0,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT };
+	VkDescriptorSetLayoutBindingFlagsCreateInfo sharedBindingFlagsInfo = {};
+	sharedBindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	sharedBindingFlagsInfo.bindingCount = SHAREDBINDING_COUNT;
+	sharedBindingFlagsInfo.pBindingFlags = sharedBindingFlags;
 
 	// on cree 3 descriptor set layouts, 1 par set
+	int firstBinding = 0;
 	for (int i = 0; i < sceneSetCount; i++) {
+		sceneSetInfo.flags = 0;
+		sceneSetInfo.pNext = nullptr;
+		if (i == DescriptorSetType::DYNAMIC)
+			sceneSetInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		if (i == DescriptorSetType::SHARED) {
+			sceneSetInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+			sceneSetInfo.pNext = &sharedBindingFlagsInfo;
+		}
 		sceneSetInfo.bindingCount = sceneSetBindingsCount[i];
-		sceneSetInfo.pBindings = &sceneSetBindings[i];
+		sceneSetInfo.pBindings = &sceneSetBindings[firstBinding];
 		DEBUG_CHECK_VK(vkCreateDescriptorSetLayout(context.device, &sceneSetInfo, nullptr, &scene.descriptorSetLayout[i]));
+		firstBinding += sceneSetBindingsCount[i];
 	}
 
 	VkDescriptorSetLayoutBinding computeBindings[5];
@@ -398,6 +471,7 @@ bool VulkanGraphicsApplication::Prepare()
 	computeBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 	computeBindings[3].pImmutableSamplers = nullptr;
 
+	// les push descriptors n'acceptent pas les types *_DYNAMIC, l'offset dans le frameAllocator est pousse directement
 	computeBindings[4].binding = 4;
 	computeBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	computeBindings[4].descriptorCount = 1;
@@ -406,36 +480,41 @@ bool VulkanGraphicsApplication::Prepare()
 
 	VkDescriptorSetLayoutCreateInfo computeLayoutInfo = {};
 	computeLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	computeLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
 	computeLayoutInfo.bindingCount = 5;
 	computeLayoutInfo.pBindings = computeBindings;
 	DEBUG_CHECK_VK(vkCreateDescriptorSetLayout(context.device, &computeLayoutInfo, nullptr, &scene.computeDescriptorSetLayout));
 
-	// Frame data (double buffer)
+	// un seul exemplaire de chaque set, le set DYNAMIC (push) et le set du compute ne s'allouent pas
 
 	VkDescriptorSetAllocateInfo allocateDescInfo = {};
 	allocateDescInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocateDescInfo.descriptorPool = scene.descriptorPool;
-	allocateDescInfo.descriptorSetCount = frameSetCount;
-	allocateDescInfo.pSetLayouts = scene.descriptorSetLayout;
-	// on cree les descriptor sets en double buffer (il faut donc allouer 2*N sets)
-	for (int i = 0; i < rendercontext.PENDING_FRAMES; i++) {
-		DEBUG_CHECK_VK(vkAllocateDescriptorSets(context.device, &allocateDescInfo, &scene.frameData[i].descriptorSet[0]));
-	}
-
-	allocateDescInfo.descriptorSetCount = commonSets;
-	allocateDescInfo.pSetLayouts = &scene.descriptorSetLayout[frameSetCount];
+	allocateDescInfo.descriptorSetCount = 1;
+	allocateDescInfo.pSetLayouts = &scene.descriptorSetLayout[DescriptorSetType::PERFRAME];
+	DEBUG_CHECK_VK(vkAllocateDescriptorSets(context.device, &allocateDescInfo, &scene.globalDescriptorSet));
+
+	// la taille reelle de la table (dernier binding, VARIABLE_DESCRIPTOR_COUNT) est donnee a l'allocation
+	VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo = {};
+	variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+	variableCountInfo.descriptorSetCount = 1;
+	variableCountInfo.pDescriptorCounts = &textureTableSize;
+	allocateDescInfo.pNext = &variableCountInfo;
+	allocateDescInfo.pSetLayouts = &scene.descriptorSetLayout[DescriptorSetType::SHARED];
 	DEBUG_CHECK_VK(vkAllocateDescriptorSets(context.device, &allocateDescInfo, &scene.sharedDescriptorSet));
 
-	allocateDescInfo.descriptorSetCount = 1;
-	allocateDescInfo.pSetLayouts = &scene.computeDescriptorSetLayout;
-	for (int i = 0; i < rendercontext.PENDING_FRAMES; i++) {
-		DEBUG_CHECK_VK(vkAllocateDescriptorSets(context.device, &allocateDescInfo, &scene.frameData[i].computeDescriptorSet));
-	}
+	// a partir d'ici chaque texture chargee par le texture manager est ecrite dans la table
+	rendercontext.textureTable = scene.sharedDescriptorSet;
+	rendercontext.textureTableBinding = TEXTURETABLE;
+	rendercontext.textureTableSize = textureTableSize;
 
+	// index du materiau du draw courant
+	VkPushConstantRange drawConstantsRange = { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t) };
 
 	VkPipelineLayoutCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineInfo.pushConstantRangeCount = 0;
+	pipelineInfo.pushConstantRangeCount = 1;
+	pipelineInfo.pPushConstantRanges = &drawConstantsRange;
 	pipelineInfo.setLayoutCount = 1;
 	pipelineInfo.setLayoutCount += 2;
 
@@ -448,180 +527,62 @@ bool VulkanGraphicsApplication::Prepare()
 	computePipelineLayoutInfo.pSetLayouts = &scene.computeDescriptorSetLayout;
 	DEBUG_CHECK_VK(vkCreatePipelineLayout(context.device, &computePipelineLayoutInfo, nullptr, &scene.computePipelineLayout));
 
-	auto vertShaderCode = readFile("shaders/Instancing_Test.vert.spv");
-	auto fragShaderCode = readFile("shaders/mesh.frag.spv");
-
-	VkShaderModule vertShaderModule = context.createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = context.createShaderModule(fragShaderCode);
-
-	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
-	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilInfo.depthTestEnable = VK_TRUE;
-	depthStencilInfo.depthWriteEnable = VK_TRUE;
-	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)context.swapchainExtent.width;
-	viewport.height = (float)context.swapchainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	VkRect2D scissor = {
-		{ 0, 0 },{ (int)viewport.width, (int)viewport.height }
-	};
-	VkPipelineViewportStateCreateInfo viewportInfo = {};
-	viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportInfo.viewportCount = 1;
-	viewportInfo.pViewports = &viewport;
-	viewportInfo.scissorCount = 1;
-	viewportInfo.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
-	rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizationInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizationInfo.lineWidth = 1.f;
-
-	VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
-	multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = false;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
-	colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlendInfo.attachmentCount = 1;
-	colorBlendInfo.pAttachments = &colorBlendAttachment;
-
-	VkGraphicsPipelineCreateInfo gfxPipelineInfo = {};
-	gfxPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	gfxPipelineInfo.pViewportState = &viewportInfo;
-	gfxPipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-	gfxPipelineInfo.pRasterizationState = &rasterizationInfo;
-	gfxPipelineInfo.pDepthStencilState = &depthStencilInfo;
-	gfxPipelineInfo.pMultisampleState = &multisampleInfo;
-	gfxPipelineInfo.pColorBlendState = &colorBlendInfo;
-	gfxPipelineInfo.renderPass = rendercontext.renderPass;
-	gfxPipelineInfo.basePipelineIndex = -1;
-	gfxPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	gfxPipelineInfo.subpass = 0;
+	// le cache est valide pour ce GPU/driver uniquement, il est ignore sinon
+	pipelineCache.Create(context, "pipelines.cache");
+	std::cout << "pipelines: " << (pipelineCache.warm ? "warm" : "cold") << " start, "
+		<< (pipelineCache.loadedSize >> 10) << " KB cache loaded" << std::endl;
 
 	//
 	// pipelines opaques
 	//
 
-	// 
-	// shaders
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	gfxPipelineInfo.stageCount = 2;
-	gfxPipelineInfo.pStages = shaderStages;
-	gfxPipelineInfo.layout = mainPipelineLayout;
-
 	// VAO / input layout
+	PipelineDesc opaqueDesc;
+	opaqueDesc.name = "opaque";
+	opaqueDesc.vertexShader = "shaders/Instancing_Test.vert.spv";
+	opaqueDesc.fragmentShader = "shaders/mesh.frag.spv";
+	opaqueDesc.layout = mainPipelineLayout;
+	opaqueDesc.renderPass = rendercontext.renderPass;
 	uint32_t stride = 0;
-	VkVertexInputAttributeDescription vertexInputLayouts[4];
-	vertexInputLayouts[0] = { 0/*location*/, 0/*binding*/, VK_FORMAT_R32G32B32_SFLOAT/*format*/, stride/*offset*/ };
+	opaqueDesc.vertexAttributes.push_back({ 0/*location*/, 0/*binding*/, VK_FORMAT_R32G32B32_SFLOAT/*format*/, stride/*offset*/ });
 	stride += sizeof(glm::vec3);
-	vertexInputLayouts[1] = { 1/*location*/, 0/*binding*/, VK_FORMAT_R32G32_SFLOAT/*format*/, stride/*offset*/ };
+	opaqueDesc.vertexAttributes.push_back({ 1/*location*/, 0/*binding*/, VK_FORMAT_R32G32_SFLOAT/*format*/, stride/*offset*/ });
 	stride += sizeof(glm::vec2);
-	vertexInputLayouts[2] = { 2/*location*/, 0/*binding*/, VK_FORMAT_R32G32B32_SFLOAT/*format*/, stride/*offset*/ };
+	opaqueDesc.vertexAttributes.push_back({ 2/*location*/, 0/*binding*/, VK_FORMAT_R32G32B32_SFLOAT/*format*/, stride/*offset*/ });
 	stride += sizeof(glm::vec3);
 	// tangent
-	vertexInputLayouts[3] = { 3/*location*/, 0/*binding*/, VK_FORMAT_R32G32B32A32_SFLOAT/*format*/, stride/*offset*/ };
+	opaqueDesc.vertexAttributes.push_back({ 3/*location*/, 0/*binding*/, VK_FORMAT_R32G32B32A32_SFLOAT/*format*/, stride/*offset*/ });
 	stride += sizeof(glm::vec4);
-	VkVertexInputBindingDescription vertexInputBindings = { 0, stride, VK_VERTEX_INPUT_RATE_VERTEX };
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &vertexInputBindings;
-	vertexInputInfo.vertexAttributeDescriptionCount = _countof(vertexInputLayouts);
-	vertexInputInfo.pVertexAttributeDescriptions = vertexInputLayouts;
-	gfxPipelineInfo.pVertexInputState = &vertexInputInfo;
-
-
-	vkCreateGraphicsPipelines(context.device, nullptr, 1, &gfxPipelineInfo
-		, nullptr, &mainPipelineOpaque);
-
-	vkDestroyShaderModule(context.device, vertShaderModule, nullptr);
-	vkDestroyShaderModule(context.device, fragShaderModule, nullptr);
+	opaqueDesc.vertexStride = stride;
+	opaquePipelineId = pipelines.Add(opaqueDesc);
 
 	//
 	// environment map cubiques
+	// optionnelle : tant qu'elle n'est pas compilee le fond reste a la couleur de clear
 	//
 
-	vertShaderCode.clear();
-	vertShaderCode = readFile("shaders/envmap.vert.spv");
-	vertShaderModule = context.createShaderModule(vertShaderCode);
-	shaderStages[0].module = vertShaderModule;
-	fragShaderCode.clear();
-	fragShaderCode = readFile("shaders/envmap.frag.spv");
-	fragShaderModule = context.createShaderModule(fragShaderCode);
-	shaderStages[1].module = fragShaderModule;
-
-	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-	depthStencilInfo.depthTestEnable = VK_TRUE;
-	depthStencilInfo.depthWriteEnable = VK_FALSE;
-	colorBlendAttachment.blendEnable = false;
-
-	VkPipelineVertexInputStateCreateInfo dummyVertexInputInfo = {};
-	dummyVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	dummyVertexInputInfo.vertexBindingDescriptionCount = 0;
-	dummyVertexInputInfo.pVertexBindingDescriptions = nullptr;
-	dummyVertexInputInfo.vertexAttributeDescriptionCount = 0;
-	dummyVertexInputInfo.pVertexAttributeDescriptions = nullptr;
-
-	rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
-	rasterizationInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-	gfxPipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-	gfxPipelineInfo.pVertexInputState = &dummyVertexInputInfo;
-
-	vkCreateGraphicsPipelines(context.device, nullptr, 1, &gfxPipelineInfo
-		, nullptr, &mainPipelineEnvMap);
-
-	vkDestroyShaderModule(context.device, vertShaderModule, nullptr);
-	vkDestroyShaderModule(context.device, fragShaderModule, nullptr);
-
-	auto compShaderCode = readFile("shaders/boid.comp.spv");
-	VkShaderModule compShaderModule = context.createShaderModule(compShaderCode);
-
-	VkPipelineShaderStageCreateInfo compShaderStageInfo = {};
-	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	compShaderStageInfo.module = compShaderModule;
-	compShaderStageInfo.pName = "main";
-
-	VkComputePipelineCreateInfo computePipelineInfo = {};
-	computePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineInfo.stage = compShaderStageInfo;
-	computePipelineInfo.layout = scene.computePipelineLayout;
-
-	DEBUG_CHECK_VK(vkCreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &scene.computePipeline));
-
-	vkDestroyShaderModule(context.device, compShaderModule, nullptr);
+	PipelineDesc envMapDesc;
+	envMapDesc.name = "envmap";
+	envMapDesc.vertexShader = "shaders/envmap.vert.spv";
+	envMapDesc.fragmentShader = "shaders/envmap.frag.spv";
+	envMapDesc.layout = mainPipelineLayout;
+	envMapDesc.renderPass = rendercontext.renderPass;
+	envMapDesc.depthCompare = VK_COMPARE_OP_LESS_OR_EQUAL;
+	envMapDesc.depthWrite = false;
+	envMapDesc.cullMode = VK_CULL_MODE_NONE;
+	envMapDesc.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	envMapDesc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+	envMapDesc.required = false;
+	envMapPipelineId = pipelines.Add(envMapDesc);
+
+	PipelineDesc simulationDesc;
+	simulationDesc.name = "boid simulation";
+	simulationDesc.computeShader = "shaders/boid.comp.spv";
+	simulationDesc.layout = scene.computePipelineLayout;
+	simulationPipelineId = pipelines.Add(simulationDesc);
+
+	// compilation sur les workers pendant que le thread principal cree les ressources de la scene
+	pipelines.CompileAsync(context, jobs, pipelineCache.cache);
 
 	//
 	// Ressources ---
@@ -635,46 +596,15 @@ bool VulkanGraphicsApplication::Prepare()
 	scene.matrices.projection = glm::perspective(glm::radians(45.f), context.swapchainExtent.width / (float)context.swapchainExtent.height, 1.f, 1000.f);
 	scene.matrices.projection[1][1] *= -1.f;
 
-	// UBOs INSTANCE et GLOBAL
+	// UBOs INSTANCE et GLOBAL (taille d'une allocation dans le frameAllocator)
 	size_t constantSizes[] = { 1 * sizeof(glm::mat4), 2 * sizeof(glm::mat4) };
 
-	memset(scene.matrices.constantBuffers, 0, sizeof(scene.matrices.constantBuffers));
-
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	bufferInfo.queueFamilyIndexCount = 1;
-	uint32_t queueFamilyIndices[] = { rendercontext.graphicsQueueIndex };
-	bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
-	VkMemoryRequirements bufferMemReq;
-
-	char* matrixData = (char*)&scene.matrices.view;
-	for (uint32_t i = 0; i < MATRIXBUFFER_COUNT; i++)
-	{
-		bufferInfo.size = constantSizes[i];
-		Buffer& ubo = scene.matrices.constantBuffers[i];
-
-		DEBUG_CHECK_VK(vkCreateBuffer(context.device, &bufferInfo, nullptr, &ubo.buffer));
-		vkGetBufferMemoryRequirements(context.device, ubo.buffer, &bufferMemReq);
-
-		VkMemoryAllocateInfo bufferAllocInfo = {};
-		bufferAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		bufferAllocInfo.allocationSize = bufferMemReq.size;
-		bufferAllocInfo.memoryTypeIndex = context.findMemoryType(bufferMemReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		DEBUG_CHECK_VK(vkAllocateMemory(context.device, &bufferAllocInfo, nullptr, &ubo.memory));
-		DEBUG_CHECK_VK(vkBindBufferMemory(context.device, ubo.buffer, ubo.memory, 0));
-		ubo.size = bufferMemReq.size;
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = ubo.memory;
-		mappedRange.size = ubo.size;
-		DEBUG_CHECK_VK(vkMapMemory(context.device, ubo.memory, 0, VK_WHOLE_SIZE, 0, &ubo.data));
-		memcpy(ubo.data, matrixData, bufferInfo.size);
-		matrixData += bufferInfo.size;
-	}
-
 	// models
 	Texture::rendercontext = &rendercontext;
+	// les images des materiaux sont decodees par les workers pendant que le thread principal continue
+	Texture::decodeJobs = &jobs;
 	Texture::SetupManager();
+	auto textureLoadStart = std::chrono::high_resolution_clock::now();
 
 	// mesh 
 	Material material;
@@ -689,55 +619,80 @@ bool VulkanGraphicsApplication::Prepare()
 	Buffer::CreateDualBuffer(rendercontext, scene.meshes[0].staticBuffers[0], scene.meshes[0].staticBuffers[1]
 		, verticesSize, vertices.data(), indicesSize, indices.data());
 
+	scene.meshes[0].materialIndex = (uint32_t)scene.materials.size();
 	scene.materials.push_back(material);
 
+	// materiaux -> SSBO, les handles de textures deviennent des indices dans la table bindless
+	{
+		std::vector<MaterialData> gpuMaterials(scene.materials.size());
+		for (size_t i = 0; i < scene.materials.size(); i++) {
+			const Material& src = scene.materials[i];
+			MaterialData& dst = gpuMaterials[i];
+			dst.diffuseColor = glm::vec4(src.diffuseColor, 1.f);
+			dst.emissiveColor = glm::vec4(src.emissiveColor, 1.f);
+			dst.roughness = src.roughness;
+			dst.metalness = src.metalness;
+			dst.diffuseTexture = Texture::TableIndex(src.diffuseTexture);
+			dst.normalTexture = Texture::TableIndex(src.normalTexture);
+			dst.roughnessTexture = Texture::TableIndex(src.roughnessTexture);
+			dst.ambientTexture = Texture::TableIndex(src.ambientTexture);
+			dst.emissiveTexture = Texture::TableIndex(src.emissiveTexture);
+			dst.padding = 0;
+		}
+		if (gpuMaterials.size() > MAX_MATERIALS)
+			std::cout << "error: too many materials (" << gpuMaterials.size() << ")" << std::endl;
+		Buffer::CreateBuffer(rendercontext, scene.materialSSBO, MAX_MATERIALS * sizeof(MaterialData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+			, gpuMaterials.data(), (uint32_t)(std::min(gpuMaterials.size(), (size_t)MAX_MATERIALS) * sizeof(MaterialData)));
+	}
+
 	// textures
 
 	scene.textures.resize(8);
 	scene.textures[0].Load(rendercontext, "../data/envmaps/pisa.hdr", false);
+	// transfert des textures des materiaux, dans le meme lot de staging que le reste de la scene
+	Texture::FinishPendingLoads();
+	double textureLoadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - textureLoadStart).count();
+	std::cout << "textures: " << Texture::liveCount << " loaded in " << textureLoadMs << " ms (" << jobs.ThreadCount() << " decode threads)" << std::endl;
+	// cold : tout a ete decode (et ecrit dans le cache), warm : tout vient du cache
+	if (TextureCache::Enabled()) {
+		const uint32_t hits = TextureCache::hits, misses = TextureCache::misses;
+		std::cout << "texture cache: " << (misses == 0 ? "warm" : hits == 0 ? "cold" : "partial") << " load, "
+			<< hits << " hits, " << misses << " misses, " << (TextureCache::bytesWritten >> 20) << " MB written" << std::endl;
+	}
 
 
 	{
-		// memes ubos avec double buffer des descriptor sets
-		VkDescriptorBufferInfo sceneBufferInfo[MATRIXBUFFER_COUNT];
-		sceneBufferInfo[0] = { scene.matrices.constantBuffers[MatrixBufferUsageType::INSTANCE].buffer, 0, constantSizes[MatrixBufferUsageType::INSTANCE] };
-		sceneBufferInfo[1] = { scene.matrices.constantBuffers[MatrixBufferUsageType::GLOBAL].buffer, 0, constantSizes[MatrixBufferUsageType::GLOBAL] };
-
-		VkWriteDescriptorSet writeDescriptorSet[DescriptorSetsDuplicatedCount] = {};
-		for (int i = 1; i < MATRIXBUFFER_COUNT; i++)
-		{
-			writeDescriptorSet[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSet[i].pImageInfo = nullptr;
-			writeDescriptorSet[i].descriptorCount = 1;
-			writeDescriptorSet[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			writeDescriptorSet[i].pBufferInfo = &sceneBufferInfo[i];
-			for (int fb = 0; fb < rendercontext.PENDING_FRAMES; fb++)
-			{
-				writeDescriptorSet[i].dstSet = scene.frameData[fb].descriptorSet[i];
-				vkUpdateDescriptorSets(context.device, 1, &writeDescriptorSet[i], 0, nullptr);
-			}
-		}
+		// le descriptor pointe sur le debut du frameAllocator, l'offset reel est donne au bind (UBO dynamique)
+		VkDescriptorBufferInfo globalBufferInfo = { rendercontext.frameAllocator.buffer.buffer, 0, constantSizes[MatrixBufferUsageType::GLOBAL] };
+
+		VkWriteDescriptorSet writeDescriptorSet = {};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.pImageInfo = nullptr;
+		writeDescriptorSet.descriptorCount = 1;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writeDescriptorSet.pBufferInfo = &globalBufferInfo;
+		writeDescriptorSet.dstSet = scene.globalDescriptorSet;
+		vkUpdateDescriptorSets(context.device, 1, &writeDescriptorSet, 0, nullptr);
 
 		{
-			VkDescriptorImageInfo sceneImageInfo[MATERIALTEXTURE_COUNT];
-
-			uint32_t textureIds[] = { scene.materials[0].diffuseTexture, scene.materials[0].normalTexture, scene.materials[0].roughnessTexture, scene.materials[0].ambientTexture, scene.materials[0].emissiveTexture };
-			sceneImageInfo[0] = { scene.textures[0].sampler, scene.textures[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-			for (int i = 1; i < MATERIALTEXTURE_COUNT; i++)
-			{
-				uint32_t id = textureIds[i - 1];
-				sceneImageInfo[i] = { Texture::textures[id].sampler, Texture::textures[id].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-			};
-
-			int texDescIndex = DescriptorSetType::SHARED;
-			VkWriteDescriptorSet writeSharedDescriptorSet{};
-			writeSharedDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeSharedDescriptorSet.pBufferInfo = nullptr;
-			writeSharedDescriptorSet.descriptorCount = MATERIALTEXTURE_COUNT;
-			writeSharedDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			writeSharedDescriptorSet.pImageInfo = &sceneImageInfo[0];
-			writeSharedDescriptorSet.dstSet = scene.sharedDescriptorSet;
-			vkUpdateDescriptorSets(context.device, 1, &writeSharedDescriptorSet, 0, nullptr);
+			// envmap et materiaux, la table de textures est deja alimentee par Texture::FinishPendingLoads()
+			VkDescriptorImageInfo envmapInfo = { scene.textures[0].sampler, scene.textures[0].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			VkDescriptorBufferInfo materialsInfo = { scene.materialSSBO.buffer, 0, VK_WHOLE_SIZE };
+
+			VkWriteDescriptorSet writeSharedDescriptorSet[2] = {};
+			writeSharedDescriptorSet[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeSharedDescriptorSet[0].dstBinding = ENVMAP;
+			writeSharedDescriptorSet[0].descriptorCount = 1;
+			writeSharedDescriptorSet[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writeSharedDescriptorSet[0].pImageInfo = &envmapInfo;
+			writeSharedDescriptorSet[0].dstSet = scene.sharedDescriptorSet;
+			writeSharedDescriptorSet[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeSharedDescriptorSet[1].dstBinding = MATERIALS;
+			writeSharedDescriptorSet[1].descriptorCount = 1;
+			writeSharedDescriptorSet[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeSharedDescriptorSet[1].pBufferInfo = &materialsInfo;
+			writeSharedDescriptorSet[1].dstSet = scene.sharedDescriptorSet;
+			vkUpdateDescriptorSets(context.device, 2, writeSharedDescriptorSet, 0, nullptr);
 		}
 	}
 
@@ -789,7 +744,8 @@ bool VulkanGraphicsApplication::Prepare()
 
 	VkBufferCreateInfo ssboInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
 	ssboInfo.size = sizeof(InstanceData) * scene.instanceCount;
-	ssboInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	// initialises une fois par le CPU puis lus et ecrits par la simulation a chaque frame : memoire video
+	ssboInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	ssboInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	for (uint32_t f = 0; f < rendercontext.PENDING_FRAMES; f++)
@@ -797,22 +753,11 @@ bool VulkanGraphicsApplication::Prepare()
 		Buffer& ssbo = scene.instanceSSBO[f];
 
 		vkCreateBuffer(context.device, &ssboInfo, nullptr, &ssbo.buffer);
+		if (!rendercontext.memoryAllocator.AllocateBuffer(ssbo.buffer, MEMORY_USAGE_STATIC, MEMORY_CATEGORY_SIMULATION, ssbo.allocation))
+			return false;
+		ssbo.data = nullptr;
 
-		VkMemoryRequirements memReq;
-		vkGetBufferMemoryRequirements(context.device, ssbo.buffer, &memReq);
-
-		VkMemoryAllocateInfo alloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-		alloc.allocationSize = memReq.size;
-		alloc.memoryTypeIndex = context.findMemoryType(
-			memReq.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		);
-
-		vkAllocateMemory(context.device, &alloc, nullptr, &ssbo.memory);
-		vkBindBufferMemory(context.device, ssbo.buffer, ssbo.memory, 0);
-		vkMapMemory(context.device, ssbo.memory, 0, VK_WHOLE_SIZE, 0, &ssbo.data);
-
-		memcpy(ssbo.data, scene.cpuInstances.data(), sizeof(InstanceData) * scene.instanceCount);
+		ssbo.Upload(rendercontext, scene.cpuInstances.data(), sizeof(InstanceData) * scene.instanceCount);
 	}
 
 	ssboInfo.size = sizeof(BoidVelocity) * scene.instanceCount;
@@ -821,137 +766,84 @@ bool VulkanGraphicsApplication::Prepare()
 		Buffer& velSSBO = scene.velocitySSBO[f];
 
 		vkCreateBuffer(context.device, &ssboInfo, nullptr, &velSSBO.buffer);
+		if (!rendercontext.memoryAllocator.AllocateBuffer(velSSBO.buffer, MEMORY_USAGE_STATIC, MEMORY_CATEGORY_SIMULATION, velSSBO.allocation))
+			return false;
+		velSSBO.data = nullptr;
 
-		VkMemoryRequirements memReq;
-		vkGetBufferMemoryRequirements(context.device, velSSBO.buffer, &memReq);
-
-		VkMemoryAllocateInfo alloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-		alloc.allocationSize = memReq.size;
-		alloc.memoryTypeIndex = context.findMemoryType(
-			memReq.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		);
+		velSSBO.Upload(rendercontext, scene.cpuVelocities.data(), sizeof(BoidVelocity) * scene.instanceCount);
+	}
 
-		vkAllocateMemory(context.device, &alloc, nullptr, &velSSBO.memory);
-		vkBindBufferMemory(context.device, velSSBO.buffer, velSSBO.memory, 0);
-		vkMapMemory(context.device, velSSBO.memory, 0, VK_WHOLE_SIZE, 0, &velSSBO.data);
+	// la premiere frame n'a besoin que des pipelines requis, les optionnels continuent en arriere-plan
+	if (!pipelines.WaitRequired())
+		return false;
 
-		memcpy(velSSBO.data, scene.cpuVelocities.data(), sizeof(BoidVelocity) * scene.instanceCount);
+	// l'anneau de relecture a la taille de l'image finale (swapchain), pas de la taille de rendu
+	if (capturePrefix && !capture.Create(rendercontext, capturePrefix, capturePng, context.swapchainExtent.width, context.swapchainExtent.height, context.surfaceFormat.format)) {
+		capture.Destroy(rendercontext);
+		capturePrefix = nullptr;
 	}
 
-	VkBufferCreateInfo paramUBOInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-	paramUBOInfo.size = sizeof(SimulationParams);
-	paramUBOInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	paramUBOInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	for (uint32_t f = 0; f < rendercontext.PENDING_FRAMES; f++)
-	{
-		Buffer& paramUBO = scene.simParamsUBO[f];
+	if (!BuildFrameGraph())
+		return false;
 
-		vkCreateBuffer(context.device, &paramUBOInfo, nullptr, &paramUBO.buffer);
+	// toutes les ressources de la scene sont creees, les copies restantes partent avant la premiere frame
+	rendercontext.staging.Flush();
+	rendercontext.staging.Acquire(true);
+	std::cout << "staging: " << (rendercontext.staging.uploadedBytes >> 10) << " KiB uploaded in " << rendercontext.staging.submitCount
+		<< " submits, " << rendercontext.staging.waitCount << " waits" << std::endl;
+	rendercontext.memoryAllocator.PrintStats();
+	return true;
+}
 
-		VkMemoryRequirements memReq;
-		vkGetBufferMemoryRequirements(context.device, paramUBO.buffer, &memReq);
+bool VulkanGraphicsApplication::BuildFrameGraph()
+{
+	// etats laisses par la frame precedente (meme graphe) :
+	// - les buffers "prev" ont ete ecrits par la simulation de la frame precedente
+	// - les buffers courants ont ete lus (compute/vertex) lors des frames precedentes
+	// - l'image de la swapchain sort de l'acquire, attendu au stage TRANSFER par le submit (premier usage = copie)
+	RGState writtenByCompute = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+	RGState readByPreviousFrames = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+	RGState acquired = { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+
+	rgPrevInstances = frameGraph.ImportBuffer("prev instances", writtenByCompute);
+	rgPrevVelocities = frameGraph.ImportBuffer("prev velocities", writtenByCompute);
+	rgInstances = frameGraph.ImportBuffer("instances", readByPreviousFrames);
+	rgVelocities = frameGraph.ImportBuffer("velocities", readByPreviousFrames);
+	// en headless l'image finale reste lisible par une copie (capture, comparaison)
+	rgSwapchain = frameGraph.ImportImage("swapchain", VK_IMAGE_ASPECT_COLOR_BIT, acquired, headless ? RG_TRANSFER_SRC : RG_PRESENT);
+	// les usages doivent etre identiques a ceux declares dans le framebuffer imageless
+	// taille max (swapchain), seul le coin m_renderExtent est utilise
+	rgColor = frameGraph.CreateTransientImage("color", context.swapchainExtent.width, context.swapchainExtent.height
+		, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+	// depth : storeOp DONT_CARE, jamais relu => memoire LAZILY_ALLOCATED quand elle existe
+	rgDepth = frameGraph.CreateTransientImage("depth", context.swapchainExtent.width, context.swapchainExtent.height
+		, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | rendercontext.transientAttachmentUsage);
 
-		VkMemoryAllocateInfo alloc{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-		alloc.allocationSize = memReq.size;
-		alloc.memoryTypeIndex = context.findMemoryType(
-			memReq.memoryTypeBits,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		);
+#ifdef RUN_COMPUTE
+	frameGraph.AddPass("boid simulation", [this](VkCommandBuffer commandBuffer) { RecordSimulationPass(commandBuffer); })
+		.Read(rgPrevInstances, RG_COMPUTE_READ)
+		.Read(rgPrevVelocities, RG_COMPUTE_READ)
+		.Write(rgInstances, RG_COMPUTE_WRITE)
+		.Write(rgVelocities, RG_COMPUTE_WRITE);
+#endif
 
-		vkAllocateMemory(context.device, &alloc, nullptr, &paramUBO.memory);
-		vkBindBufferMemory(context.device, paramUBO.buffer, paramUBO.memory, 0);
-		vkMapMemory(context.device, paramUBO.memory, 0, VK_WHOLE_SIZE, 0, &paramUBO.data);
-	}
+	// opaques + envmap, meme render pass
+	frameGraph.AddPass("forward", [this](VkCommandBuffer commandBuffer) { RecordForwardPass(commandBuffer); })
+		.Read(rgInstances, RG_VERTEX_READ)
+		.Write(rgColor, RG_COLOR_ATTACHMENT)
+		.Write(rgDepth, RG_DEPTH_ATTACHMENT);
 
-	VkDescriptorBufferInfo instanceBufferInfo;
-	for (uint32_t f = 0; f < rendercontext.PENDING_FRAMES; f++)
-	{
-		instanceBufferInfo = {
-			scene.instanceSSBO[f].buffer,
-			0,
-			VK_WHOLE_SIZE
-		};
-
-		VkWriteDescriptorSet instanceWrite{};
-		instanceWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		instanceWrite.dstSet = scene.frameData[f].descriptorSet[0];
-		instanceWrite.dstBinding = 0;
-		instanceWrite.descriptorCount = 1;
-		instanceWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		instanceWrite.pBufferInfo = &instanceBufferInfo;
-
-		vkUpdateDescriptorSets(context.device, 1, &instanceWrite, 0, nullptr);
-	}
+	// mise a l'echelle de la taille de rendu vers la swapchain
+	frameGraph.AddPass("upscale", [this](VkCommandBuffer commandBuffer) { RecordUpscalePass(commandBuffer); })
+		.Read(rgColor, RG_TRANSFER_SRC)
+		.Write(rgSwapchain, RG_TRANSFER_DST);
 
-	for (uint32_t f = 0; f < rendercontext.PENDING_FRAMES; f++)
-	{
-		VkDescriptorBufferInfo computeBufferInfos[5];
-
-		uint32_t prev = (f + 1) % rendercontext.PENDING_FRAMES;
-
-		computeBufferInfos[0].buffer = scene.instanceSSBO[prev].buffer;
-		computeBufferInfos[0].offset = 0;
-		computeBufferInfos[0].range = VK_WHOLE_SIZE;
-
-		computeBufferInfos[1].buffer = scene.velocitySSBO[prev].buffer;
-		computeBufferInfos[1].offset = 0;
-		computeBufferInfos[1].range = VK_WHOLE_SIZE;
-
-		computeBufferInfos[2].buffer = scene.instanceSSBO[f].buffer;
-		computeBufferInfos[2].offset = 0;
-		computeBufferInfos[2].range = VK_WHOLE_SIZE;
-
-		computeBufferInfos[3].buffer = scene.velocitySSBO[f].buffer;
-		computeBufferInfos[3].offset = 0;
-		computeBufferInfos[3].range = VK_WHOLE_SIZE;
-
-		computeBufferInfos[4].buffer = scene.simParamsUBO[f].buffer;
-		computeBufferInfos[4].offset = 0;
-		computeBufferInfos[4].range = VK_WHOLE_SIZE;
-
-		VkWriteDescriptorSet computeWrites[5] = {};
-
-		computeWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		computeWrites[0].dstSet = scene.frameData[f].computeDescriptorSet;
-		computeWrites[0].dstBinding = 0;
-		computeWrites[0].descriptorCount = 1;
-		computeWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		computeWrites[0].pBufferInfo = &computeBufferInfos[0];
-
-		computeWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		computeWrites[1].dstSet = scene.frameData[f].computeDescriptorSet;
-		computeWrites[1].dstBinding = 1;
-		computeWrites[1].descriptorCount = 1;
-		computeWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		computeWrites[1].pBufferInfo = &computeBufferInfos[1];
-
-		computeWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		computeWrites[2].dstSet = scene.frameData[f].computeDescriptorSet;
-		computeWrites[2].dstBinding = 2;
-		computeWrites[2].descriptorCount = 1;
-		computeWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		computeWrites[2].pBufferInfo = &computeBufferInfos[2];
-
-		computeWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		computeWrites[3].dstSet = scene.frameData[f].computeDescriptorSet;
-		computeWrites[3].dstBinding = 3;
-		computeWrites[3].descriptorCount = 1;
-		computeWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		computeWrites[3].pBufferInfo = &computeBufferInfos[3];
-
-		computeWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		computeWrites[4].dstSet = scene.frameData[f].computeDescriptorSet;
-		computeWrites[4].dstBinding = 4;
-		computeWrites[4].descriptorCount = 1;
-		computeWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		computeWrites[4].pBufferInfo = &computeBufferInfos[4];
-
-		vkUpdateDescriptorSets(context.device, 5, computeWrites, 0, nullptr);
-	}
+	// relecture de l'image finale, le graphe ajoute la transition vers PRESENT ensuite
+	if (capturePrefix)
+		frameGraph.AddPass("capture", [this](VkCommandBuffer commandBuffer) { RecordCapturePass(commandBuffer); })
+			.Read(rgSwapchain, RG_TRANSFER_SRC);
 
-	return true;
+	return frameGraph.Compile(rendercontext);
 }
 
 // tout detruire ici
@@ -965,7 +857,10 @@ void VulkanGraphicsApplication::Terminate()
 		}
 	}
 
+	scene.materialSSBO.Destroy(rendercontext);
+
 	// destruction des textures
+	rendercontext.textureTable = VK_NULL_HANDLE;
 	Texture::PurgeTextures();
 
 	for (uint32_t i = 0; i < scene.textures.size(); i++) {
@@ -973,16 +868,16 @@ void VulkanGraphicsApplication::Terminate()
 	}
 
 	// destruction des UBO
-	for (uint32_t i = 0; i < MATRIXBUFFER_COUNT; i++) {
-		scene.matrices.constantBuffers[i].Destroy(rendercontext);
-	}
+	rendercontext.frameAllocator.Destroy(rendercontext);
+	rendercontext.frameArena.Destroy();
+
+	if (capturePrefix)
+		capture.Destroy(rendercontext);
 
 	for (uint32_t i = 0; i < rendercontext.PENDING_FRAMES; i++) {
 		scene.velocitySSBO[i].Destroy(rendercontext);
-		scene.simParamsUBO[i].Destroy(rendercontext);
 	}
 
-	vkDestroyPipeline(context.device, scene.computePipeline, nullptr);
 	vkDestroyPipelineLayout(context.device, scene.computePipelineLayout, nullptr);
 	vkDestroyDescriptorSetLayout(context.device, scene.computeDescriptorSetLayout, nullptr);
 
@@ -993,38 +888,40 @@ void VulkanGraphicsApplication::Terminate()
 	vkDestroyDescriptorPool(context.device, scene.descriptorPool, nullptr);
 
 	// destruction des pipelines
-	vkDestroyPipeline(context.device, mainPipelineEnvMap, nullptr);
-	vkDestroyPipeline(context.device, mainPipelineOpaque, nullptr);
+	pipelines.Destroy(context);
+	pipelineCache.Destroy(context);
 	vkDestroyPipelineLayout(context.device, mainPipelineLayout, nullptr);
 
-	// destruction du staging buffer
-	vkDestroyBuffer(context.device, rendercontext.stagingBuffer.buffer, nullptr);
-	vkUnmapMemory(context.device, rendercontext.stagingBuffer.memory);
-	vkFreeMemory(context.device, rendercontext.stagingBuffer.memory, nullptr);
+	// destruction de l'anneau de staging
+	rendercontext.staging.Destroy(rendercontext);
 
 	vkDestroyRenderPass(context.device, rendercontext.renderPass, nullptr);
 
-	// destruction du depth buffer
-	vkDestroyImageView(context.device, colorBuffer.view, nullptr);
-	vkDestroyImage(context.device, colorBuffer.image, nullptr);
-	vkFreeMemory(context.device, colorBuffer.memory, nullptr);
-
-	vkDestroyImageView(context.device, depthBuffer.view, nullptr);
-	vkDestroyImage(context.device, depthBuffer.image, nullptr);
-	vkFreeMemory(context.device, depthBuffer.memory, nullptr);
+	// color et depth buffers appartiennent au render graph
+	frameGraph.Destroy(rendercontext);
+	vkDestroyQueryPool(context.device, rendercontext.timestampPool, nullptr);
 
 	vkDestroyFramebuffer(context.device, context.framebuffer, nullptr);
 	for (uint32_t i = 0; i < context.swapchainImageCount; i++)
 	{
-		vkDestroyImageView(context.device, context.swapchainImages[i].view, nullptr);
+		if (headless)
+			offscreenTargets[i].Destroy(rendercontext);
+		else
+			vkDestroyImageView(context.device, context.swapchainImages[i].view, nullptr);
 	}
 
 	for (uint32_t i = 0; i < rendercontext.PENDING_FRAMES; i++) {
 		vkDestroyFence(context.device, rendercontext.mainFences[i], nullptr);
 	}
 
+	jobs.Destroy();
+
 	// note: detruire le command pool detruit automatiquement les command buffers
 	for (uint32_t i = 0; i < rendercontext.PENDING_FRAMES; i++) {
+		for (uint32_t slot = 0; slot < rendercontext.recordSlotCount; slot++)
+			vkDestroyCommandPool(context.device, rendercontext.recordCommandPools[i][slot], nullptr);
+		if (cacheCommandBuffers)
+			vkDestroyCommandPool(context.device, rendercontext.cachedCommandPool[i], nullptr);
 		vkDestroyCommandPool(context.device, rendercontext.mainCommandPool[i], nullptr);
 		vkDestroySemaphore(context.device, context.renderSemaphores[i], nullptr);
 		scene.instanceSSBO[i].Destroy(rendercontext);
@@ -1042,30 +939,112 @@ bool VulkanGraphicsApplication::Begin()
 	vkResetFences(context.device, 1, &rendercontext.mainFences[rendercontext.currentFrame]);
 
 	vkResetCommandPool(context.device, rendercontext.mainCommandPool[rendercontext.currentFrame], VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	// les secondaires sont reenregistres chaque frame avec un volume similaire : on garde leur memoire
+	for (uint32_t slot = 0; slot < rendercontext.recordSlotCount; slot++)
+		vkResetCommandPool(context.device, rendercontext.recordCommandPools[rendercontext.currentFrame][slot], 0);
+
+	// le GPU a fini de lire la region de cette frame, on peut la reecrire
+	rendercontext.frameAllocator.Reset(rendercontext.currentFrame);
+	// les temporaires CPU de la frame precedente ne sont plus utilises
+	if (memoryReportInterval && m_frame > 0 && m_frame % memoryReportInterval == 0)
+		rendercontext.frameArena.PrintStats();
+	rendercontext.frameArena.Reset();
+	// les objets detruits il y a PENDING_FRAMES frames ne sont plus references
+	rendercontext.deferredDestroy.BeginFrame(m_frame, rendercontext.PENDING_FRAMES, rendercontext.frameArena);
+	// lots dont la copie est terminee (queue de transfert) : acquisition par la graphics queue,
+	// puis recyclage des regions de staging des lots termines
+	rendercontext.staging.Acquire(false);
+	rendercontext.staging.Retire();
+	// textures demandees en cours d'execution (RequestTexture) dont le decodage est termine,
+	// les copies partent avec le lot de staging de cette frame ; celles des lots termines sont publiees
+	Texture::ProcessPendingUploads();
+
+	// budget memoire : depassement => callbacks d'eviction (les ressources de cette frame ne sont plus lues)
+	rendercontext.memoryAllocator.CheckBudget();
+	// allocations sur le tas depuis le Begin() precedent : 0 attendu en regime permanent
+	uint64_t heapAllocations = HeapAllocationCount();
+	m_frameHeapAllocations = heapAllocations - m_heapAllocationMark;
+	m_heapAllocationMark = heapAllocations;
+	if (memoryReportInterval && m_frame > 0 && m_frame % memoryReportInterval == 0) {
+		rendercontext.memoryAllocator.PrintStats();
+		std::cout << "heap allocations during last frame: " << m_frameHeapAllocations << std::endl;
+	}
+
+	// les copies de cette frame sont terminees : encodage en arriere-plan
+	if (capturePrefix)
+		capture.Collect(rendercontext.memoryAllocator, rendercontext.currentFrame);
+
+	UpdateRenderScale();
 
-	DEBUG_CHECK_VK(vkAcquireNextImageKHR(context.device, context.swapchain, timeout, context.presentSemaphores[context.semaphoreIndex], VK_NULL_HANDLE, &m_imageIndex));
+	// headless : pas d'acquire, les cibles hors ecran sont utilisees a tour de role
+	// (la fence de la frame garantit que la cible n'est plus utilisee par le GPU)
+	if (headless)
+		m_imageIndex = m_frame % context.swapchainImageCount;
+	else
+		DEBUG_CHECK_VK(vkAcquireNextImageKHR(context.device, context.swapchain, timeout, context.presentSemaphores[context.semaphoreIndex], VK_NULL_HANDLE, &m_imageIndex));
 
 	return true;
 }
 
+void VulkanGraphicsApplication::UpdateRenderScale()
+{
+	// les timestamps de cette frame n'ont ete ecrits qu'apres un premier passage
+	if (rendercontext.timestampPool == VK_NULL_HANDLE || m_frame < (uint32_t)rendercontext.PENDING_FRAMES)
+		return;
+
+	uint64_t timestamps[2];
+	VkResult result = vkGetQueryPoolResults(context.device, rendercontext.timestampPool, rendercontext.currentFrame * 2, 2
+		, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+		return;
+
+	uint64_t mask = rendercontext.timestampValidBits >= 64 ? ~0ull : ((1ull << rendercontext.timestampValidBits) - 1);
+	uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+	float gpuMs = (float)(ticks * (double)context.props.limits.timestampPeriod * 1e-6);
+
+	if (resolution.Update(gpuMs))
+	{
+		m_renderExtent = { resolution.width, resolution.height };
+		std::cout << "dynamic resolution: gpu " << resolution.smoothedGpuMs << " ms (budget " << resolution.budgetMs << " ms), render "
+			<< m_renderExtent.width << "x" << m_renderExtent.height << " (" << (int)(resolution.scale * 100.f) << "%)" << std::endl;
+	}
+}
+
 bool VulkanGraphicsApplication::End()
 {
 	uint64_t timeout = UINT64_MAX;
 
 	VkSubmitInfo submitInfo = {};
-	uint32_t stageMask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	// premier acces a l'image de la swapchain : la copie du color buffer (passe "upscale")
+	uint32_t stageMask[] = { VK_PIPELINE_STAGE_TRANSFER_BIT };
 	submitInfo.pWaitDstStageMask = stageMask;
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &rendercontext.mainCommandBuffers[rendercontext.currentFrame];
+	submitInfo.pCommandBuffers = &m_submitCommandBuffer;
 
-	submitInfo.waitSemaphoreCount = 1;
+	// headless : ni acquire ni present, donc aucun semaphore
+	submitInfo.waitSemaphoreCount = headless ? 0 : 1;
 	submitInfo.pWaitSemaphores = &context.presentSemaphores[context.semaphoreIndex];
 
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 	submitInfo.pSignalSemaphores = &context.renderSemaphores[context.semaphoreIndex];
+
+	// "late latching" : la camera est calculee avec les entrees les plus recentes, apres l'enregistrement
+	LatchCamera();
+	// transferts enregistres depuis la frame precedente : sur la queue de transfert ils ne sont utilisables
+	// qu'une fois staging.IsComplete(valeur) (acquire soumis par un Begin() suivant), sinon des cette frame
+	// (soumis avant elle). Les textures du manager ne sont publiees qu'a ce moment (Texture::ProcessPendingUploads)
+	rendercontext.staging.Flush();
 	vkQueueSubmit(rendercontext.graphicsQueue, 1, &submitInfo, rendercontext.mainFences[rendercontext.currentFrame]);
 
+	if (headless)
+	{
+		latency.OnPresent();
+		m_frame++;
+		rendercontext.currentFrame = m_frame % rendercontext.PENDING_FRAMES;
+		return true;
+	}
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
@@ -1074,6 +1053,7 @@ bool VulkanGraphicsApplication::End()
 	presentInfo.pSwapchains = &context.swapchain;
 	presentInfo.pImageIndices = &m_imageIndex;
 	DEBUG_CHECK_VK(vkQueuePresentKHR(rendercontext.presentQueue, &presentInfo));
+	latency.OnPresent();
 
 	context.semaphoreIndex++;
 	context.semaphoreIndex = context.semaphoreIndex % context.swapchainImageCount;
@@ -1099,24 +1079,35 @@ static bool moveEnabled = false;
 
 bool VulkanGraphicsApplication::Update()
 {
-	int width, height;
-	glfwGetWindowSize(window, &width, &height);
-	glfwGetFramebufferSize(window, &width, &height);
-	while (width == 0 || height == 0)
+	if (!headless)
 	{
-		glfwWaitEvents();
+		int width, height;
+		glfwGetWindowSize(window, &width, &height);
 		glfwGetFramebufferSize(window, &width, &height);
+		while (width == 0 || height == 0)
+		{
+			glfwWaitEvents();
+			glfwGetFramebufferSize(window, &width, &height);
+		}
 	}
-	static double previousTime = glfwGetTime() - 0.017f;
-	static double currentTime = glfwGetTime();
+	// headless : pas de temps fixe (60 Hz), la simulation est identique d'une execution a l'autre
+	static double previousTime = headless ? -1.0 / 60.0 : glfwGetTime() - 0.017f;
+	static double currentTime = headless ? 0.0 : glfwGetTime();
 
-	currentTime = glfwGetTime();
+	currentTime = headless ? m_frame / 60.0 : glfwGetTime();
 	double deltaTime = currentTime - previousTime;
 	std::cout << "[" << m_frame << "] frame time = " << deltaTime * 1000.0 << " ms [" << 1.0 / deltaTime << " fps]" << std::endl;
 	previousTime = currentTime;
 
-	float time = (float)currentTime;
+	// la camera n'est plus mise a jour ici mais dans LatchCamera(), juste avant le submit
+	scene.simParams.deltaTime = (float)deltaTime;
+
+	return true;
+}
 
+// integre les entrees souris accumulees depuis le dernier appel et retourne la matrice de vue
+static glm::mat4 UpdateCamera(float deltaTime)
+{
 	glm::vec3 up = glm::vec3(0.f, 1.f, 0.f);
 
 	static float currentX = 0.f;
@@ -1169,70 +1160,161 @@ bool VulkanGraphicsApplication::Update()
 	camPos += (right * moveSpeed.x + newUp * moveSpeed.y + forward * moveSpeed.z);
 
 	target = camPos - cam_forward;
-	scene.matrices.view = glm::lookAt(camPos, target, up);
-
 	mouseDelta = glm::vec3(0.f);
 
-	scene.simParams.deltaTime = (float)deltaTime;
+	return glm::lookAt(camPos, target, up);
+}
 
-	return true;
+void VulkanGraphicsApplication::LatchCamera()
+{
+	// dernieres entrees disponibles : les callbacks sont appeles ici plutot qu'apres la frame
+	if (!headless)
+		glfwPollEvents();
+
+	double now = headless ? m_frame / 60.0 : glfwGetTime();
+	static double previousLatch = now - 1.0 / 60.0;
+	double deltaTime = now - previousLatch;
+	previousLatch = now;
+
+	scene.matrices.view = UpdateCamera((float)deltaTime);
+	// region reservee par Display(), memoire COHERENT : visible par le GPU des le vkQueueSubmit
+	if (m_latchedMatrices)
+		memcpy(m_latchedMatrices, &scene.matrices.view, sizeof(glm::mat4) * 2);
+
+	latency.OnLatch();
 }
 
 bool VulkanGraphicsApplication::Display()
 {
 	uint32_t f = rendercontext.currentFrame;
 
-	Buffer& paramUBO = scene.simParamsUBO[f];
-	VkMappedMemoryRange mappedRange = {};
-	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mappedRange.memory = paramUBO.memory;
-	mappedRange.size = sizeof(SimulationParams);
-	DEBUG_CHECK_VK(vkInvalidateMappedMemoryRanges(context.device, 1, &mappedRange));
-	memcpy(paramUBO.data, &scene.simParams, sizeof(SimulationParams));
-	DEBUG_CHECK_VK(vkFlushMappedMemoryRanges(context.device, 1, &mappedRange));
-
-	char* viewData = (char*)&scene.matrices.view;
-	Buffer& uboVP = scene.matrices.constantBuffers[MatrixBufferUsageType::GLOBAL];
-	mappedRange.memory = uboVP.memory;
-	mappedRange.size = sizeof(glm::mat4) * 2;
-	DEBUG_CHECK_VK(vkInvalidateMappedMemoryRanges(context.device, 1, &mappedRange));
-	memcpy(uboVP.data, viewData, sizeof(glm::mat4) * 2);
-	DEBUG_CHECK_VK(vkFlushMappedMemoryRanges(context.device, 1, &mappedRange));
+	// constantes de la frame, memoire COHERENT donc pas de flush
+	FrameAllocator& frameAllocator = rendercontext.frameAllocator;
+	scene.simParamsOffset = frameAllocator.Push(scene.simParams);
+
+	// view/projection reservees ici (l'offset est fige dans le command buffer) mais ecrites au dernier moment dans End()
+	scene.globalOffset = frameAllocator.Allocate(sizeof(glm::mat4) * 2, &m_latchedMatrices);
+	// region pleine : aucun offset valide a lier, la frame est enregistree sans simulation ni dessin (effacement seul)
+	m_skipScene = scene.simParamsOffset == FrameAllocator::INVALID_OFFSET || scene.globalOffset == FrameAllocator::INVALID_OFFSET;
+	if (m_skipScene)
+		std::cout << "error: frame constants not allocated, scene skipped for frame " << m_frame << std::endl;
+
+	// un pipeline optionnel vient d'etre compile : les command buffers pre-enregistres ne le dessinent pas
+	uint32_t readyPipelines = pipelines.ReadyCount();
+	if (readyPipelines != m_readyPipelineCount) {
+		m_readyPipelineCount = readyPipelines;
+		sceneDirty = true;
+	}
+
+	// le buffer de relecture change a chaque frame : pas de command buffers pre-enregistres pendant une capture
+	// (ni pour une frame sans scene, qui ne doit pas remplacer un command buffer valide du cache)
+	if (!cacheCommandBuffers || capturePrefix || m_skipScene)
+	{
+		m_submitCommandBuffer = rendercontext.mainCommandBuffers[f];
+		RecordFrame(m_submitCommandBuffer, false);
+		return true;
+	}
+
+	// mode "pre-enregistre" : seul le contenu des buffers change d'une frame a l'autre
+	// on reenregistre uniquement si la scene a change ou si les offsets ne sont plus ceux enregistres
+	if (sceneDirty) {
+		for (uint32_t i = 0; i < rendercontext.PENDING_FRAMES; i++)
+			for (uint32_t j = 0; j < context.SWAPCHAIN_IMAGES; j++)
+				rendercontext.cachedCommandValid[i][j] = false;
+		sceneDirty = false;
+	}
+
+	CachedFrameOffsets& recorded = rendercontext.cachedOffsets[f][m_imageIndex];
+	bool& valid = rendercontext.cachedCommandValid[f][m_imageIndex];
+	if (valid && (recorded.globalOffset != scene.globalOffset || recorded.simParamsOffset != scene.simParamsOffset))
+		valid = false;
+	// taille de rendu figee dans la render area, le viewport et la copie finale
+	if (valid && (recorded.renderExtent.width != m_renderExtent.width || recorded.renderExtent.height != m_renderExtent.height))
+		valid = false;
+
+	m_submitCommandBuffer = rendercontext.cachedCommandBuffers[f][m_imageIndex];
+	if (!valid)
+	{
+		// la fence de cette frame a ete attendue dans Begin() : le command buffer n'est plus en vol
+		RecordFrame(m_submitCommandBuffer, true);
+		recorded.globalOffset = scene.globalOffset;
+		recorded.simParamsOffset = scene.simParamsOffset;
+		recorded.renderExtent = m_renderExtent;
+		valid = true;
+	}
+	return true;
+}
+
+void VulkanGraphicsApplication::RecordFrame(VkCommandBuffer commandBuffer, bool reusable)
+{
+	uint32_t f = rendercontext.currentFrame;
 
 	// "begin" du command buffer
-	VkCommandBuffer commandBuffer = rendercontext.mainCommandBuffers[rendercontext.currentFrame];
+	// un command buffer reutilisable ne doit pas etre ONE_TIME_SUBMIT
+	// (vkBeginCommandBuffer le reset implicitement, son pool a RESET_COMMAND_BUFFER_BIT)
 	VkCommandBufferBeginInfo cmdBeginInfo = {};
 	cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	cmdBeginInfo.flags = reusable ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo);
 
-#ifdef RUN_COMPUTE
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scene.computePipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-		scene.computePipelineLayout, 0, 1, &scene.frameData[f].computeDescriptorSet, 0, nullptr);
+	// liaison des ressources reelles de cette frame aux handles du graphe
+	uint32_t prev = (f + 1) % rendercontext.PENDING_FRAMES;
+	frameGraph.BindBuffer(rgPrevInstances, scene.instanceSSBO[prev].buffer);
+	frameGraph.BindBuffer(rgPrevVelocities, scene.velocitySSBO[prev].buffer);
+	frameGraph.BindBuffer(rgInstances, scene.instanceSSBO[f].buffer);
+	frameGraph.BindBuffer(rgVelocities, scene.velocitySSBO[f].buffer);
+	frameGraph.BindImage(rgSwapchain, context.swapchainImages[m_imageIndex].image, context.swapchainImages[m_imageIndex].view);
+
+	// temps GPU de la frame complete, relu dans UpdateRenderScale() une fois la fence attendue
+	if (rendercontext.timestampPool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(commandBuffer, rendercontext.timestampPool, f * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, rendercontext.timestampPool, f * 2);
+	}
+
+	m_recordReusable = reusable;
+	frameGraph.Execute(commandBuffer);
+
+	if (rendercontext.timestampPool != VK_NULL_HANDLE)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, rendercontext.timestampPool, f * 2 + 1);
+
+	vkEndCommandBuffer(commandBuffer);
+}
+
+void VulkanGraphicsApplication::RecordSimulationPass(VkCommandBuffer commandBuffer)
+{
+	if (m_skipScene)
+		return;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.Get(simulationPipelineId));
+
+	// entrees = resultat de la frame precedente, sorties = buffers de cette frame
+	// la barriere compute -> vertex est emise par le graphe avant la passe forward
+	VkDescriptorBufferInfo computeBufferInfos[5] = {
+		{ frameGraph.GetBuffer(rgPrevInstances), 0, VK_WHOLE_SIZE },
+		{ frameGraph.GetBuffer(rgPrevVelocities), 0, VK_WHOLE_SIZE },
+		{ frameGraph.GetBuffer(rgInstances), 0, VK_WHOLE_SIZE },
+		{ frameGraph.GetBuffer(rgVelocities), 0, VK_WHOLE_SIZE },
+		{ rendercontext.frameAllocator.buffer.buffer, scene.simParamsOffset, sizeof(SimulationParams) }
+	};
+	VkWriteDescriptorSet computeWrites[5] = {};
+	for (uint32_t i = 0; i < 5; i++)
+	{
+		computeWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		computeWrites[i].dstBinding = i;
+		computeWrites[i].descriptorCount = 1;
+		computeWrites[i].descriptorType = i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		computeWrites[i].pBufferInfo = &computeBufferInfos[i];
+	}
+	vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scene.computePipelineLayout, 0, 5, computeWrites);
 
 	uint32_t workgroupCount = (scene.instanceCount + 255) / 256;
 	vkCmdDispatch(commandBuffer, workgroupCount, 1, 1);
+}
 
-	VkBufferMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.buffer = scene.instanceSSBO[rendercontext.currentFrame].buffer;
-	barrier.offset = 0;
-	barrier.size = VK_WHOLE_SIZE;
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
-		0, 0, nullptr, 1, &barrier, 0, nullptr
-	);
-#endif
+void VulkanGraphicsApplication::RecordForwardPass(VkCommandBuffer commandBuffer)
+{
+	uint32_t f = rendercontext.currentFrame;
 
-	VkImageView framebufferAttachments[2] = { context.swapchainImages[m_imageIndex].view, depthBuffer.view };
+	VkImageView framebufferAttachments[2] = { frameGraph.GetView(rgColor), frameGraph.GetView(rgDepth) };
 	VkRenderPassAttachmentBeginInfo renderPassAttachmentBeginInfo = {};
 	renderPassAttachmentBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO;
 	renderPassAttachmentBeginInfo.attachmentCount = 2;
@@ -1249,35 +1331,168 @@ bool VulkanGraphicsApplication::Display()
 	renderPassBeginInfo.renderPass = rendercontext.renderPass;
 	renderPassBeginInfo.pClearValues = clearValues;
 	renderPassBeginInfo.clearValueCount = 2;
-	renderPassBeginInfo.renderArea.extent = context.swapchainExtent;
+	renderPassBeginInfo.renderArea.extent = m_renderExtent;
 	renderPassBeginInfo.pNext = &renderPassAttachmentBeginInfo;
-	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipelineLayout, DescriptorSetType::DYNAMIC, 2, &scene.frameData[rendercontext.currentFrame].descriptorSet[0], 0, nullptr);
+	// les secondaires sont reinitialises chaque frame dans Begin(), un command buffer reutilisable
+	// ne peut donc pas les referencer : enregistrement direct (c'est rare, seulement si la scene change)
+	uint32_t slotCount = m_recordReusable ? 0 : rendercontext.recordSlotCount;
+	if (slotCount == 0)
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		RecordScenePass(commandBuffer, 0, scene.instanceCount, 0, true);
+	}
+	else
+	{
+		// chaque slot enregistre une tranche des instances, l'envmap est dessinee en dernier (dernier slot)
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		uint32_t instancesPerSlot = (scene.instanceCount + slotCount - 1) / slotCount;
+		jobs.ParallelFor(slotCount, [&](uint32_t slot, uint32_t threadIndex) {
+			VkCommandBuffer secondary = rendercontext.recordCommandBuffers[f][slot];
+			rendercontext.BeginSecondaryCommandBuffer(secondary, context.framebuffer);
+			uint32_t first = std::min(slot * instancesPerSlot, scene.instanceCount);
+			uint32_t count = std::min(instancesPerSlot, scene.instanceCount - first);
+			RecordScenePass(secondary, first, count, 0, slot == slotCount - 1);
+			vkEndCommandBuffer(secondary);
+		});
+		vkCmdExecuteCommands(commandBuffer, slotCount, rendercontext.recordCommandBuffers[f]);
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void VulkanGraphicsApplication::RecordUpscalePass(VkCommandBuffer commandBuffer)
+{
+	// filtrage bilineaire, convertit aussi le format (RGBA sRGB -> format de la surface)
+	VkImageBlit blit = {};
+	blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.srcOffsets[1] = { (int32_t)m_renderExtent.width, (int32_t)m_renderExtent.height, 1 };
+	blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.dstOffsets[1] = { (int32_t)context.swapchainExtent.width, (int32_t)context.swapchainExtent.height, 1 };
+	vkCmdBlitImage(commandBuffer,
+		frameGraph.GetImage(rgColor), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		frameGraph.GetImage(rgSwapchain), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, VK_FILTER_LINEAR);
+}
+
+void VulkanGraphicsApplication::RecordCapturePass(VkCommandBuffer commandBuffer)
+{
+	// anneau plein : la frame n'est pas capturee (comptee dans capture.droppedCount)
+	capture.Record(commandBuffer, frameGraph.GetImage(rgSwapchain), m_frame, rendercontext.currentFrame);
+}
+
+void VulkanGraphicsApplication::RecordScenePass(VkCommandBuffer commandBuffer, uint32_t firstInstance, uint32_t instanceCount, uint32_t instancesPerDraw, bool drawEnvMap)
+{
+	if (m_skipScene)
+		return;
+	uint32_t f = rendercontext.currentFrame;
+
+	// un command buffer n'herite d'aucun etat : chaque secondaire rebinde tout
+
+	VkViewport viewport = { 0.0f, 0.0f, (float)m_renderExtent.width, (float)m_renderExtent.height, 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, m_renderExtent };
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// instances de cette frame (ecrites par le compute juste avant)
+	VkDescriptorBufferInfo instanceBufferInfo = { scene.instanceSSBO[f].buffer, 0, VK_WHOLE_SIZE };
+	VkWriteDescriptorSet instanceWrite = {};
+	instanceWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	instanceWrite.dstBinding = 0;
+	instanceWrite.descriptorCount = 1;
+	instanceWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceWrite.pBufferInfo = &instanceBufferInfo;
+	vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipelineLayout, DescriptorSetType::DYNAMIC, 1, &instanceWrite);
+
+	// un seul offset dynamique : le GLOBAL UBO du set PERFRAME
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipelineLayout, DescriptorSetType::PERFRAME, 1, &scene.globalDescriptorSet, 1, &scene.globalOffset);
 	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipelineLayout, DescriptorSetType::SHARED, 1, &scene.sharedDescriptorSet, 0, nullptr);
 
 	VkDeviceSize offsets[] = { 0 };
 
 	// "Passe" Opaques & Cutouts & Environnement
+	if (instanceCount > 0)
 	{
 		VkBuffer buffers[] = { scene.meshes[0].staticBuffers[Mesh::BufferType::VBO].buffer };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, scene.meshes[0].staticBuffers[Mesh::BufferType::IBO].buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipelineOpaque);
-		vkCmdDrawIndexed(commandBuffer, scene.meshes[0].indexCount, scene.instanceCount, 0, 0, 0);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.Get(opaquePipelineId));
+		// changer de materiau = changer d'index, aucun descriptor set a rebinder
+		vkCmdPushConstants(commandBuffer, mainPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &scene.meshes[0].materialIndex);
+
+		// gl_InstanceIndex inclut firstInstance, le vertex shader lit donc la bonne matrice world
+		if (instancesPerDraw == 0)
+			instancesPerDraw = instanceCount;
+		uint32_t lastInstance = firstInstance + instanceCount;
+		for (uint32_t first = firstInstance; first < lastInstance; first += instancesPerDraw)
+			vkCmdDrawIndexed(commandBuffer, scene.meshes[0].indexCount, std::min(instancesPerDraw, lastInstance - first), 0, 0, first);
+	}
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipelineEnvMap);
+	// pipeline optionnel, saute tant qu'il est en cours de compilation
+	VkPipeline envMapPipeline = pipelines.Get(envMapPipelineId);
+	if (drawEnvMap && envMapPipeline != VK_NULL_HANDLE)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, envMapPipeline);
 		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
 	}
+}
 
-	vkCmdEndRenderPass(commandBuffer);
+void VulkanGraphicsApplication::BenchmarkRecording(uint32_t maxThreads)
+{
+	// charge artificielle : chaque instance est dessinee drawRepeat fois, un draw par instance
+	// seul l'enregistrement CPU est mesure, rien n'est soumis
+	const uint32_t iterations = 100;
+	const uint32_t drawRepeat = 32;
+
+	if (maxThreads > rendercontext.recordSlotCount)
+		maxThreads = rendercontext.recordSlotCount;
+	if (maxThreads == 0) {
+		std::cout << "error: recording benchmark needs worker threads (--record-threads > 1)" << std::endl;
+		return;
+	}
 
-	vkEndCommandBuffer(commandBuffer);
-	return true;
+	vkDeviceWaitIdle(context.device);
+	uint32_t f = rendercontext.currentFrame;
+
+	std::cout << "recording benchmark: " << scene.instanceCount * drawRepeat << " draws, " << iterations << " iterations" << std::endl;
+
+	double reference = 0.0;
+	for (uint32_t threads = 1; threads <= maxThreads; threads++)
+	{
+		uint32_t instancesPerSlot = (scene.instanceCount + threads - 1) / threads;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t it = 0; it < iterations; it++)
+		{
+			for (uint32_t slot = 0; slot < threads; slot++)
+				vkResetCommandPool(context.device, rendercontext.recordCommandPools[f][slot], 0);
+
+			jobs.ParallelFor(threads, [&](uint32_t slot, uint32_t threadIndex) {
+				VkCommandBuffer secondary = rendercontext.recordCommandBuffers[f][slot];
+				rendercontext.BeginSecondaryCommandBuffer(secondary, context.framebuffer);
+				uint32_t first = std::min(slot * instancesPerSlot, scene.instanceCount);
+				uint32_t count = std::min(instancesPerSlot, scene.instanceCount - first);
+				for (uint32_t r = 0; r < drawRepeat; r++)
+					RecordScenePass(secondary, first, count, 1, false);
+				vkEndCommandBuffer(secondary);
+			});
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+		if (threads == 1)
+			reference = ms;
+		std::cout << "  " << threads << " thread(s): " << ms << " ms/frame, speedup x" << (reference / ms) << std::endl;
+	}
+
+	for (uint32_t slot = 0; slot < maxThreads; slot++)
+		vkResetCommandPool(context.device, rendercontext.recordCommandPools[f][slot], 0);
 }
 
 void scrollCallback(GLFWwindow* window, double delta_x, double delta_y)
 {
+	((VulkanGraphicsApplication*)glfwGetWindowUserPointer(window))->latency.OnInput();
+
 	prevMouse.z = float(currentMouse.z);
 	currentMouse.z += delta_y;
 	mouseDelta.z = prevMouse.z - float(currentMouse.z);
@@ -1285,6 +1500,8 @@ void scrollCallback(GLFWwindow* window, double delta_x, double delta_y)
 
 void cursorCallback(GLFWwindow* window, double pos_x, double pos_y)
 {
+	((VulkanGraphicsApplication*)glfwGetWindowUserPointer(window))->latency.OnInput();
+
 	prevMouse = glm::vec3(currentMouse.x, currentMouse.y, 0.0);
 	currentMouse.x = pos_x; currentMouse.y = pos_y;
 
@@ -1293,6 +1510,8 @@ void cursorCallback(GLFWwindow* window, double pos_x, double pos_y)
 
 void mouseCallback(GLFWwindow* window, int button, int action, int mods)
 {
+	((VulkanGraphicsApplication*)glfwGetWindowUserPointer(window))->latency.OnInput();
+
 	if (action == GLFW_PRESS)
 	{
 		prevMouse = glm::vec3(currentMouse.x, currentMouse.y, 0.0);
@@ -1312,15 +1531,115 @@ void mouseCallback(GLFWwindow* window, int button, int action, int mods)
 		moveEnabled = false;
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+	// options :
+	// --record-threads N : nombre de threads d'enregistrement des command buffers (1 = thread principal)
+	// --bench-record : mesure l'enregistrement de 1 a N threads puis quitte
+	// --cache-commands : command buffers enregistres une fois et resoumis tels quels
+	// --gpu-budget MS : temps GPU vise par la resolution dynamique (0 = echelle fixe)
+	// --render-scale S : echelle de rendu initiale (0.5 a 1)
+	// --capture PREFIX : ecrit chaque frame dans PREFIX_NNNNNN.png (--capture-raw : RGBA8 brut, plus rapide)
+	// --memory-budget MB : budget souple de memoire DEVICE_LOCAL (eviction au dela), --memory-report N : rapport toutes les N frames
+	// --headless : sans fenetre ni swapchain, rend --frames N frames (300 par defaut) en --width x --height puis quitte
+	// --mip-filter box|kaiser : filtre des mips calculees au chargement des textures (kaiser par defaut)
+	// --no-texture-cache : decode toujours les images (pas de lecture ni d'ecriture de texture_cache/)
+	uint32_t recordThreads = 0;
+	bool benchRecord = false;
+	bool cacheCommands = false;
+	float gpuBudget = 12.f;
+	float renderScale = 1.f;
+	const char* capturePrefix = nullptr;
+	bool capturePng = true;
+	uint32_t memoryBudgetMB = 0;
+	uint32_t memoryReport = 0;
+	bool headless = false;
+	uint32_t headlessFrames = 300;
+	VkExtent2D headlessExtent = { 1920, 1080 };
+	bool textureCache = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc)
+			recordThreads = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bench-record") == 0)
+			benchRecord = true;
+		else if (strcmp(argv[i], "--cache-commands") == 0)
+			cacheCommands = true;
+		else if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+			gpuBudget = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+			renderScale = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			capturePrefix = argv[++i];
+		else if (strcmp(argv[i], "--capture-raw") == 0)
+			capturePng = false;
+		else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc)
+			memoryBudgetMB = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--memory-report") == 0 && i + 1 < argc)
+			memoryReport = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			headlessFrames = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+			headlessExtent.width = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+			headlessExtent.height = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc)
+			Texture::mipFilter = strcmp(argv[++i], "box") == 0 ? MIP_FILTER_BOX : MIP_FILTER_KAISER;
+		else if (strcmp(argv[i], "--no-texture-cache") == 0)
+			textureCache = false;
+	}
+	if (textureCache)
+		TextureCache::Open("texture_cache");
+
+	VulkanGraphicsApplication app;
+	app.recordThreadCount = recordThreads;
+	app.cacheCommandBuffers = cacheCommands;
+	app.gpuBudgetMs = gpuBudget;
+	app.renderScale = renderScale;
+	app.capturePrefix = capturePrefix;
+	app.capturePng = capturePng;
+	app.memoryReportInterval = memoryReport;
+	app.rendercontext.memoryAllocator.SetSoftBudget((VkDeviceSize)memoryBudgetMB << 20);
+
+	// pas de GLFW du tout en headless : glfwInit() echoue sans display
+	if (headless)
+	{
+		app.headless = true;
+		app.headlessExtent = headlessExtent;
+
+		auto startupStart = std::chrono::high_resolution_clock::now();
+		if (!app.Initialize(APP_NAME)) {
+			std::cout << "error: headless initialization failed" << std::endl;
+			app.Shutdown();
+			return -1;
+		}
+		double startupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count();
+		std::cout << "startup: " << startupMs << " ms (" << (app.pipelineCache.warm ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+		if (benchRecord)
+			app.BenchmarkRecording(app.rendercontext.recordSlotCount);
+		else
+		{
+			auto runStart = std::chrono::high_resolution_clock::now();
+			for (uint32_t frame = 0; frame < headlessFrames; frame++)
+				app.Run();
+			vkDeviceWaitIdle(app.context.device);
+			double runMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runStart).count();
+			std::cout << "headless: " << headlessFrames << " frames in " << runMs << " ms, "
+				<< (headlessFrames ? runMs / headlessFrames : 0.0) << " ms/frame" << std::endl;
+		}
+
+		app.Shutdown();
+		return 0;
+	}
+
 	/* Initialize the library */
 	if (!glfwInit())
 		return -1;
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-	VulkanGraphicsApplication app;
-
 	/* Create a windowed mode window and its OpenGL context */
 	app.window = glfwCreateWindow(1920, 1080, APP_NAME, NULL, NULL);
 	if (!app.window)
@@ -1329,11 +1648,28 @@ int main(void)
 		return -1;
 	}
 
+	glfwSetWindowUserPointer(app.window, &app);
 	glfwSetMouseButtonCallback(app.window, mouseCallback);
 	glfwSetCursorPosCallback(app.window, cursorCallback);
 	glfwSetScrollCallback(app.window, scrollCallback);
 
-	app.Initialize(APP_NAME);
+	auto startupStart = std::chrono::high_resolution_clock::now();
+	if (!app.Initialize(APP_NAME)) {
+		std::cout << "error: initialization failed" << std::endl;
+		app.Shutdown();
+		glfwTerminate();
+		return -1;
+	}
+	double startupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count();
+	std::cout << "startup: " << startupMs << " ms (" << (app.pipelineCache.warm ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+	if (benchRecord)
+	{
+		app.BenchmarkRecording(app.rendercontext.recordSlotCount);
+		app.Shutdown();
+		glfwTerminate();
+		return 0;
+	}
 
 	glfwGetCursorPos(app.window, &currentMouse.x, &currentMouse.y);
 
@@ -1341,12 +1677,11 @@ int main(void)
 	while (!glfwWindowShouldClose(app.window))
 	{
 		/* Render here */
+		/* les evenements sont traites dans End(), juste avant le submit (LatchCamera) */
 		app.Run();
-
-		/* Poll for and process events */
-		glfwPollEvents();
 	}
 
+	app.latency.Report();
 	app.Shutdown();
 
 	glfwTerminate();